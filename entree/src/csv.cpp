@@ -68,6 +68,42 @@ void readCsv(std::istream& is,
     }
 }
 
+// read header row of csv data from stream; return column names
+void readCsvHeader(std::istream& is,
+                   std::vector<std::string>& colNames)
+{
+    vector<bool> lineQuoted;
+    
+    nextCsvLine(is, colNames, lineQuoted);
+}
+
+// read up to maxRows rows of csv data from stream, continuing from current position; return
+// cells, and whether cells are quoted; return true if more rows may follow, false if reached end
+bool readCsvRows(std::istream& is,
+                 size_t maxRows,
+                 std::vector< std::vector<std::string> >& cells,
+                 std::vector< std::vector<bool> >& quoted)
+{
+    cells.clear();
+    quoted.clear();
+    
+    vector<string> line;
+    vector<bool> lineQuoted;
+    
+    bool more = true;
+    
+    while (more && cells.size() < maxRows) {
+        more = nextCsvLine(is, line, lineQuoted);
+        
+        if (more) {
+            cells.push_back(line);
+            quoted.push_back(lineQuoted);
+        }
+    }
+    
+    return more;
+}
+
 // -------------------------------------------------------------------------------------------------
 
 // write csv data to stream
@@ -78,7 +114,7 @@ void writeCsv(std::ostream& os,
               const std::vector<std::string>& colNames)
 {
     size_t numRows = cells.size();
-    size_t numCols = cells[0].size();
+    size_t numCols = numRows > 0 ? cells[0].size() : 0;
     
     if (writeHeader) {
         for (size_t col = 0; col < colNames.size(); col++) {
@@ -463,6 +499,41 @@ void ctest_csv(int& totalPassed, int& totalFailed, bool verbose)
     // ~~~~~~~~~~~~~~~~~~~~~~
     // readCsv
     
+    // ~~~~~~~~~~~~~~~~~~~~~~
+    // readCsvHeader
+    
+    {
+        istringstream iss("A,B\n1,2\n");
+        
+        vector<string> colNames;
+        
+        readCsvHeader(iss, colNames);
+        
+        string next;
+        getline(iss, next);
+        
+        if (colNames.size() == 2 && colNames[1] == "B" && next == "1,2") passed++; else failed++;
+    }
+    
+    // ~~~~~~~~~~~~~~~~~~~~~~
+    // readCsvRows
+    
+    {
+        istringstream iss("1,2\n3,4\n5,6\n\n7,8\n");
+        
+        vector< vector<string> > cells;
+        vector< vector<bool> > quoted;
+        
+        bool more1 = readCsvRows(iss, 2, cells, quoted);
+        bool ok1 = more1 && cells.size() == 2 && cells[1][0] == "3";
+        
+        // blank line terminates reading
+        bool more2 = readCsvRows(iss, 2, cells, quoted);
+        bool ok2 = !more2 && cells.size() == 1 && cells[0][1] == "6";
+        
+        if (ok1 && ok2) passed++; else failed++;
+    }
+    
     // ~~~~~~~~~~~~~~~~~~~~~~
     // writeCsv
     
@@ -30,6 +30,17 @@ void readCsv(std::istream& is,
              std::vector< std::vector<bool> >& quoted,
              std::vector<std::string>& colNames);
 
+// read header row of csv data from stream; return column names
+void readCsvHeader(std::istream& is,
+                   std::vector<std::string>& colNames);
+
+// read up to maxRows rows of csv data from stream, continuing from current position; return
+// cells, and whether cells are quoted; return true if more rows may follow, false if reached end
+bool readCsvRows(std::istream& is,
+                 size_t maxRows,
+                 std::vector< std::vector<std::string> >& cells,
+                 std::vector< std::vector<bool> >& quoted);
+
 // write csv data to stream
 void writeCsv(std::ostream& os,
               bool writeHeader,
@@ -29,8 +29,54 @@
 
 using namespace std;
 
+// ========== Local Types ==========================================================================
+
+// view of R integer, real or factor vector, for reading entries in place without copying vector
+typedef struct {
+    const int *ints;        // for integer or factor vector, else NULL
+    const double *reals;    // for real vector, else NULL
+    size_t length;
+} RColumnView;
+
+// model unpacked from R object; kept through external pointer in environment attached to object,
+// so that repeated calls to predict need not unpack model again
+typedef struct {
+    vector<CompactTree> trees;
+    index_t xColumnCount;
+    index_t columnsPerTree;
+    SelectIndexes selectColumns;
+    vector<ValueType> valueTypes;
+    vector<ImputeOption> imputeOptions;
+    vector<CategoryMaps> categoryMaps;
+    vector<string> colNames;
+} NativeModel;
+
 // ========== Local Headers ========================================================================
 
+// make view of R integer, real or factor vector
+void makeRColumnView(SEXP rVector, size_t rowCount, RColumnView& view);
+
+// return numeric Value for row of view of integer or real vector
+Value numericValueAt(const RColumnView& view, size_t row);
+
+// set category index for each level of R factor, or NO_INDEX if level has no category; if
+// categoryMaps is not const, insert categories for levels used by codes, in order of first use
+void mapFactorLevels(SEXP rVector,
+                     const RColumnView& codes,
+                     bool constCategoryMaps,
+                     CategoryMaps& categoryMaps,
+                     vector<index_t>& levelIndexes);
+
+// unpack model from R object made by entree_C
+void unpackModel(SEXP object, NativeModel& model);
+
+// return model kept with object, unpacking it if cache is empty or was made for other trees, as
+// after deserialization; if object has no cache, unpack into localModel and return it
+NativeModel& findNativeModel(SEXP object, NativeModel& localModel);
+
+// delete model owned by external pointer
+void finalizeNativeModel(SEXP handle);
+
 // convert R vector to vector of Value; update valueType and categoryMaps if requested
 void convertRVector(SEXP rVector,
                     size_t rowCount,
@@ -60,7 +106,10 @@ SEXP entree_C(SEXP x,
               SEXP s_maxSplitsPerNumericAttribute,
               SEXP s_xValueTypes,
               SEXP s_yValueType,
-              SEXP s_xImputeOptions)
+              SEXP s_xImputeOptions,
+              SEXP s_maxCategories,
+              SEXP s_nThreads,
+              SEXP s_progress)
 {
     if (gTrace) CERR << "entree_C" << endl;
     
@@ -106,6 +155,15 @@ SEXP entree_C(SEXP x,
         
     } else if (!Rf_isString(s_xImputeOptions)) {
         error("entree_C: wrong xImputeOptions type");
+        
+    } else if (!Rf_isInteger(s_maxCategories)) {
+        error("entree_C: wrong maxCategories type");
+        
+    } else if (!Rf_isInteger(s_nThreads)) {
+        error("entree_C: wrong nThreads type");
+        
+    } else if (!Rf_isReal(s_progress)) {
+        error("entree_C: wrong progress type");
     } 
     
     // --------------- verify x is a data.frame ---------------
@@ -216,18 +274,30 @@ SEXP entree_C(SEXP x,
     
     if (gTrace) CERR << "convert x" << endl;
     
-    vector< vector<Value> > xValues;
-    vector<CategoryMaps> xCategoryMaps;
+    // size for all columns, including <Y>, so that columns are not copied when vector grows
+    vector< vector<Value> > xValues(xCols + 1);
+    vector<CategoryMaps> xCategoryMaps(xCols);
     
     for (size_t col = 0; col < xCols; col++) {
-        xValues.push_back(vector<Value>());
-        xCategoryMaps.push_back(CategoryMaps());
-        
         convertRVector(VECTOR_ELT(x, (int)col), xRows, constXValueTypes, xValueTypes[col],
                        xValues[col], false, xCategoryMaps[col], colNames[col]);
 
     }
 
+    // --------------- fold rare categories ---------------
+    
+    if (gTrace) CERR << "fold rare categories" << endl;
+    
+    int maxCategories = *INTEGER(s_maxCategories);
+    
+    if (maxCategories > 0) {
+        for (size_t col = 0; col < xCols; col++) {
+            if (xValueTypes[col] == kCategorical) {
+                foldRareCategories((size_t)maxCategories, xValues[col], xCategoryMaps[col]);
+            }
+        }
+    }
+
     // --------------- append y to x ---------------
     
     if (gTrace) CERR << "append y to x" << endl;
@@ -235,7 +305,7 @@ SEXP entree_C(SEXP x,
     size_t targetColumn = xValueTypes.size();   // last column is used for <Y>
     
     xValueTypes.push_back(yValueType);
-    xValues.push_back(yValues);
+    xValues[targetColumn].swap(yValues);
     xCategoryMaps.push_back(yCategoryMaps);
     colNames.push_back("<Y>");
     
@@ -287,6 +357,21 @@ SEXP entree_C(SEXP x,
     double minImprovement = *REAL(s_minImprovement);
     index_t minLeafCount = *INTEGER(s_minLeafCount);
     index_t maxSplitsPerNumericAttribute = *INTEGER(s_maxSplitsPerNumericAttribute);
+    int nThreads = *INTEGER(s_nThreads);
+    
+    if (nThreads < 0) {
+        error("invalid nThreads");
+    }
+    
+    // progress is reported between batches of trees, on R main thread
+    double progress = *REAL(s_progress);
+    
+    if (progress > 0.0) {
+        setTrainProgress(printTrainProgress, NULL, progress);
+        
+    } else {
+        setTrainProgress(NULL, NULL, 0.0);
+    }
     
     SelectIndexes selectRows(xRows, true);
     
@@ -298,7 +383,7 @@ SEXP entree_C(SEXP x,
     train(trees, columnsPerTree, maxDepth, minDepth, doPrune, minImprovement, minLeafCount,
           maxSplitsPerNumericAttribute, maxTrees, maxNodes, selectRows, availableColumns,
           selectColumns, xValues, xValueTypes, xCategoryMaps, targetColumn, colNames,
-          imputeOptions);
+          imputeOptions, (size_t)nThreads);
     
     if (trees.size() == 0) {
         CERR << "no trees found" << endl;
@@ -349,7 +434,7 @@ SEXP entree_C(SEXP x,
     for (size_t k = 0; k < numTrees; k++) {
         int treeUnprotectCount = 0;
         
-        const int numTreeFields = 7;
+        const int numTreeFields = 9;
         SEXP s_splitColIndex;
         SEXP s_lessOrEqualIndex;
         SEXP s_greaterOrNotIndex;
@@ -357,6 +442,8 @@ SEXP entree_C(SEXP x,
         SEXP s_value_switch;
         SEXP s_value_d;
         SEXP s_value_i;
+        SEXP s_categorySetIndex;
+        SEXP s_categorySets;
         
         PROTECT(s_trees[k] = Rf_allocVector(VECSXP, numTreeFields));
         treeUnprotectCount++;
@@ -492,6 +579,36 @@ SEXP entree_C(SEXP x,
         fieldNum = 6;
         SET_VECTOR_ELT(s_trees[k], fieldNum, s_value_i);
 
+        // --------------------------------------------------------------
+        
+        fieldNum = 7;
+        
+        SET_STRING_ELT(field_names, fieldNum, Rf_mkChar("categorySetIndex"));
+        PROTECT(s_categorySetIndex = Rf_allocVector(INTSXP, (int)numNodes));
+        treeUnprotectCount++;
+        int *categorySetIndex = INTEGER(s_categorySetIndex);
+        for (size_t n = 0; n < numNodes; n++) {
+            categorySetIndex[n] = (int)trees[k].categorySetIndex[n];
+        }
+        
+        SET_VECTOR_ELT(s_trees[k], fieldNum, s_categorySetIndex);
+
+        // --------------------------------------------------------------
+        
+        fieldNum = 8;
+        
+        size_t numSetWords = trees[k].categorySets.size();
+        
+        SET_STRING_ELT(field_names, fieldNum, Rf_mkChar("categorySets"));
+        PROTECT(s_categorySets = Rf_allocVector(INTSXP, (int)numSetWords));
+        treeUnprotectCount++;
+        int *categorySets = INTEGER(s_categorySets);
+        for (size_t n = 0; n < numSetWords; n++) {
+            categorySets[n] = (int)trees[k].categorySets[n];
+        }
+        
+        SET_VECTOR_ELT(s_trees[k], fieldNum, s_categorySets);
+
         Rf_setAttrib(s_trees[k], R_NamesSymbol, field_names);
 
     	UNPROTECT(treeUnprotectCount);
@@ -733,203 +850,16 @@ SEXP entree_predict_C(SEXP object, SEXP x)
     
     if (gTrace) CERR << "unpack object" << endl;
     
-    vector<CompactTree> trees;
-    index_t xColumnCount;
-    index_t columnsPerTree;
-    vector<ValueType> valueTypes;
-    vector<ImputeOption> imputeOptions;
-    vector<CategoryMaps> categoryMaps;
-    vector<string> colNames;
-    
-    int resultFieldIndex = -1;
-
-    // order here must match order in entree_C
-    
-    // ---------- object$trees ---------------------------------------------------------------------
-    
-    if (gTrace) CERR << "object$trees" << endl;
-    
-    resultFieldIndex++;
-    
-    SEXP object_trees = VECTOR_ELT(object, resultFieldIndex);
-
-    size_t numTrees = (size_t)Rf_length(object_trees);
-
-    for (size_t treeIndex = 0; treeIndex < numTrees; treeIndex++) {
-        trees.push_back(CompactTree());
-
-        SEXP s_tree = VECTOR_ELT(object_trees, (int)treeIndex);
-        
-        SEXP s_splitColIndex = VECTOR_ELT(s_tree, 0);
-        SEXP s_lessOrEqualIndex = VECTOR_ELT(s_tree, 1);
-        SEXP s_greaterOrNotIndex = VECTOR_ELT(s_tree, 2);
-        SEXP s_toLessOrEqualIfNA = VECTOR_ELT(s_tree, 3);
-        SEXP s_value_switch = VECTOR_ELT(s_tree, 4);
-        SEXP s_value_d = VECTOR_ELT(s_tree, 5);
-        SEXP s_value_i = VECTOR_ELT(s_tree, 6);
-        
-        size_t numNodes = (size_t)Rf_length(s_splitColIndex);
-        
-        int *splitColIndex = INTEGER(s_splitColIndex);
-        int *lessOrEqualIndex = INTEGER(s_lessOrEqualIndex);
-        int *greaterOrNotIndex = INTEGER(s_greaterOrNotIndex);
-        int *toLessOrEqualIfNA = INTEGER(s_toLessOrEqualIfNA);
-        int *value_switch = INTEGER(s_value_switch);
-        double *value_d = REAL(s_value_d);
-        int *value_i = INTEGER(s_value_i);
-        
-        CompactTree& tree = trees[treeIndex];
-        tree.splitColIndex.resize(numNodes);
-        tree.lessOrEqualIndex.resize(numNodes);
-        tree.greaterOrNotIndex.resize(numNodes);
-        tree.toLessOrEqualIfNA.resize(numNodes);
-        tree.value.resize(numNodes);
-        
-        for (size_t nodeIndex = 0; nodeIndex < numNodes; nodeIndex++) {
-            tree.splitColIndex[nodeIndex] = splitColIndex[nodeIndex];
-            tree.lessOrEqualIndex[nodeIndex] = lessOrEqualIndex[nodeIndex];
-            tree.greaterOrNotIndex[nodeIndex] = greaterOrNotIndex[nodeIndex];
-            tree.toLessOrEqualIfNA[nodeIndex] = toLessOrEqualIfNA[nodeIndex];
-            
-            switch(value_switch[nodeIndex]) {
-                case kCategorical:
-                    tree.value[nodeIndex].i = value_i[nodeIndex];
-                    break;
-                    
-                case kNumeric:
-                    tree.value[nodeIndex].d = value_d[nodeIndex];
-                    break;
-                    
-                default:
-                    RUNTIME_ERROR_IF(true, "corrupt object");
-                    break;
-            }
-        }
-    }
-    
-    // ---------- object$xColumnCount ---------------------------------------------------------------------
-    
-    if (gTrace) CERR << "object$xColumnCount" << endl;
-    
-    resultFieldIndex++;
-    
-    SEXP object_xColumnCount = VECTOR_ELT(object, resultFieldIndex);
-    
-    xColumnCount = *INTEGER(object_xColumnCount);
-    
-    // ---------- object$selectColumns ---------------------------------------------------------------------
-    
-    if (gTrace) CERR << "object$selectColumns" << endl;
-    
-    resultFieldIndex++;
-
-    SEXP object_selectColumns = VECTOR_ELT(object, resultFieldIndex);
-
-    size_t numSelectColumns = (size_t)Rf_length(object_selectColumns);
-    
-    SelectIndexes selectColumns((size_t)xColumnCount + 1, false);
-
-    int *selectColumnsP = INTEGER(object_selectColumns);
-    
-    for (size_t k = 0; k < numSelectColumns; k++) {
-        selectColumns.select((size_t)selectColumnsP[k]);    
-    }
-    
-    // ---------- object$columnsPerTree ---------------------------------------------------------------------
-    
-    if (gTrace) CERR << "object$columnsPerTree" << endl;
-    
-    resultFieldIndex++;
-    
-    SEXP object_columnsPerTree = VECTOR_ELT(object, resultFieldIndex);
-    
-    columnsPerTree = *INTEGER(object_columnsPerTree);
-    
-    // ---------- object$valueTypes ---------------------------------------------------------------------
-    
-    if (gTrace) CERR << "object$valueTypes" << endl;
-    
-    resultFieldIndex++;
-    
-    SEXP object_valueTypes = VECTOR_ELT(object, resultFieldIndex);
-
-    for (int k = 0; k < Rf_length(object_valueTypes); k++) {
-        string nextValueType = CHAR(STRING_ELT(object_valueTypes, k));
-
-        ValueType valueType = stringToValueType(nextValueType);
-        
-        valueTypes.push_back(valueType);
-    }
-    
-    // ---------- object$imputeOptions ---------------------------------------------------------------------
-    
-    if (gTrace) CERR << "object$imputeOptions" << endl;
-    
-    resultFieldIndex++;
-    
-    SEXP object_imputeOptions = VECTOR_ELT(object, resultFieldIndex);
-
-    for (int k = 0; k < Rf_length(object_imputeOptions); k++) {
-        string nextImputeOption = CHAR(STRING_ELT(object_imputeOptions, k));
-        
-        ImputeOption imputeOption = stringToImputeOption(nextImputeOption, valueTypes[(size_t)k]);
-
-        imputeOptions.push_back(imputeOption);    
-    }
-    
-    // ---------- object$columnCategories ---------------------------------------------------------------------
-    
-    if (gTrace) CERR << "object$columnCategories" << endl;
-    
-    resultFieldIndex++;
-    
-    SEXP object_columnCategories = VECTOR_ELT(object, resultFieldIndex);
-
-    size_t numCols = (size_t)Rf_length(object_columnCategories);
-    
-    for (size_t col = 0; col < numCols; col++) {
-        categoryMaps.push_back(CategoryMaps());
-        
-        SEXP s_categories = VECTOR_ELT(object_columnCategories, (int)col);
-        
-        int numCategories = Rf_length(s_categories);
-        
-        for (int catIndex = 0; catIndex < numCategories; catIndex++) {
-            string nextCategory = CHAR(STRING_ELT(s_categories, catIndex));
-            
-            categoryMaps[col].insertCategory(nextCategory);
-        }
-    }
-
-    // ---------- object$useNaCategory ---------------------------------------------------------------------
-    
-    if (gTrace) CERR << "object$useNaCategory" << endl;
-    
-    resultFieldIndex++;
-    
-    SEXP object_useNaCategory = VECTOR_ELT(object, resultFieldIndex);
-    
-    int *useNaCategoryP = INTEGER(object_useNaCategory);
-    
-    size_t numUseNaCategory = (size_t)Rf_length(object_useNaCategory);
-    
-    for (size_t k = 0; k < numUseNaCategory; k++) {
-        categoryMaps[k].setUseNaCategory((bool)useNaCategoryP[k]);
-    }
-    
-    // ---------- object$colNames ------------------------------------------------------------------
-    
-    if (gTrace) CERR << "object$colNames" << endl;
-    
-    resultFieldIndex++;
+    // model is unpacked once and kept with object for later calls
+    NativeModel localModel;
+    NativeModel& model = findNativeModel(object, localModel);
     
-    SEXP object_colNames = VECTOR_ELT(object, resultFieldIndex);
-
-    for (int k = 0; k < Rf_length(object_colNames); k++) {
-        string nextColName = CHAR(STRING_ELT(object_colNames, k));
-        
-        colNames.push_back(nextColName);    
-    }
+    const vector<CompactTree>& trees = model.trees;
+    index_t xColumnCount = model.xColumnCount;
+    const SelectIndexes& selectColumns = model.selectColumns;
+    vector<ValueType>& valueTypes = model.valueTypes;
+    vector<CategoryMaps>& categoryMaps = model.categoryMaps;
+    const vector<string>& colNames = model.colNames;
 
     // --------------- convert x ---------------
     
@@ -949,8 +879,6 @@ SEXP entree_predict_C(SEXP object, SEXP x)
     
     if (gTrace) CERR << "convert x" << endl;
     
-    vector< vector<Value> > values;
-    
     size_t xCols = (size_t)Rf_length(x);
     
     size_t xRows = 0;
@@ -958,11 +886,12 @@ SEXP entree_predict_C(SEXP object, SEXP x)
         xRows = (size_t)Rf_length(VECTOR_ELT(x, 0));
     }
     
+    // size for all columns, including prediction, so that columns are not copied when vector grows
+    vector< vector<Value> > values(xCols + 1);
+    
     for (size_t col = 0; col < xCols; col++) {
         //        CERR << "col = " << col << endl;
         
-        values.push_back(vector<Value>());
-        
         convertRVector(VECTOR_ELT(x, (int)col), xRows, true, valueTypes[col], values[col], true,
                        categoryMaps[col], colNames[col]);
     }
@@ -973,7 +902,7 @@ SEXP entree_predict_C(SEXP object, SEXP x)
     
     size_t targetColumn = xCols;
     
-    values.push_back(vector<Value>(xRows, gNaValue));
+    values[targetColumn].assign(xRows, gNaValue);
     
     // --------------- verify dimensions match ---------------
     
@@ -1106,7 +1035,11 @@ void convertRVector(SEXP rVector,
                 
                 index_t index;
                 
-                if (categoryMaps.findIndexForCategory(str, index)) {
+                bool found =
+                    constCategoryMaps ? categoryMaps.findIndexOrOther(str, index) :
+                                        categoryMaps.findIndexForCategory(str, index);
+                
+                if (found) {
                     nextValue.number.i = index;
                     
                 } else if (constCategoryMaps) {
@@ -1137,7 +1070,11 @@ void convertRVector(SEXP rVector,
  
                     index_t index;
                     
-                    if (categoryMaps.findIndexForCategory(str, index)) {
+                    bool found =
+                        constCategoryMaps ? categoryMaps.findIndexOrOther(str, index) :
+                                            categoryMaps.findIndexForCategory(str, index);
+                    
+                    if (found) {
                         nextValue.number.i = index;
                         
                     } else if (constCategoryMaps) {
@@ -1154,12 +1091,12 @@ void convertRVector(SEXP rVector,
         } else {
             valueType = kNumeric;
             
-            for (int row = 0; row < (int)rowCount; row++) {
-                Value nextValue;
-                nextValue.number.d = INTEGER(rVector)[row];
-                nextValue.na = INTEGER(rVector)[row] == NA_INTEGER;
-                
-                values.push_back(nextValue);
+            RColumnView view;
+            makeRColumnView(rVector, rowCount, view);
+            
+            values.resize(rowCount);
+            for (size_t row = 0; row < rowCount; row++) {
+                values[row] = numericValueAt(view, row);
             }
         }
         
@@ -1180,7 +1117,11 @@ void convertRVector(SEXP rVector,
 
                     index_t index;
                     
-                    if (categoryMaps.findIndexForCategory(str, index)) {
+                    bool found =
+                        constCategoryMaps ? categoryMaps.findIndexOrOther(str, index) :
+                                            categoryMaps.findIndexForCategory(str, index);
+                    
+                    if (found) {
                         nextValue.number.i = index;
                         
                     } else if (constCategoryMaps) {
@@ -1197,12 +1138,12 @@ void convertRVector(SEXP rVector,
         } else {
             valueType = kNumeric;
             
-            for (int row = 0; row < (int)rowCount; row++) {
-                Value nextValue;
-                nextValue.number.d = REAL(rVector)[row];
-                nextValue.na = ISNA(nextValue.number.d);
-                
-                values.push_back(nextValue);
+            RColumnView view;
+            makeRColumnView(rVector, rowCount, view);
+            
+            values.resize(rowCount);
+            for (size_t row = 0; row < rowCount; row++) {
+                values[row] = numericValueAt(view, row);
             }
         }
         
@@ -1216,56 +1157,41 @@ void convertRVector(SEXP rVector,
             RUNTIME_ERROR_IF(true, oss.str());
         }
         
-        // get map of factors
-        map<int, string> levelMap;
+        valueType = kCategorical;
         
-        // convert levels to entries in categoryMaps
-        int levelCount;
-        {
-            SEXP levels;
-            PROTECT(levels = Rf_getAttrib(rVector, R_LevelsSymbol));
-            
-            levelCount = Rf_length(levels);
-            for (int level = 0; level < levelCount; level++) {
-                string str = CHAR(STRING_ELT(levels, level));
-                
-                // R levels are 1-based
-                levelMap.insert(make_pair(level + 1, str));
-            }
-            
-            UNPROTECT(1);
-        }
+        // factor codes are used through category index for each level, without looking up name of
+        // level for each row
         
-        valueType = kCategorical;
+        RColumnView codes;
+        makeRColumnView(rVector, rowCount, codes);
         
-        for (int row = 0; row < (int)rowCount; row++) {
-            int level = INTEGER(rVector)[row];
-
-            Value nextValue;
+        vector<index_t> levelIndexes;
+        mapFactorLevels(rVector, codes, constCategoryMaps, categoryMaps, levelIndexes);
+        
+        values.resize(rowCount);
+        for (size_t row = 0; row < rowCount; row++) {
+            int level = codes.ints[row];
+            Value& nextValue = values[row];
             
             if (level == NA_INTEGER) {
                 nextValue = gNaValue;
                 
             } else {
-                map<int, string>::const_iterator iter = levelMap.find(level);
-                RUNTIME_ERROR_IF(iter == levelMap.end(), "broken levels list");
+                // R levels are 1-based
+                RUNTIME_ERROR_IF(level < 1 || (size_t)level > levelIndexes.size(),
+                                 "broken levels list");
                 
-                string category = iter->second;
+                index_t index = levelIndexes[(size_t)(level - 1)];
                 
-                if (constCategoryMaps) {
-                    // if not found in existing categoryMaps, use NA
-                    if (categoryMaps.findIndexForCategory(category, nextValue.number.i)) {
-                        nextValue.na = false;
-                    }
+                if (index == NO_INDEX) {
+                    // not found in const categoryMaps and no otherCategory
+                    nextValue = gNaValue;
                     
                 } else {
-                    // create entry in categoryMaps if necessary
-                    nextValue.number.i = categoryMaps.findOrInsertCategory(category);
+                    nextValue.number.i = index;
                     nextValue.na = false;
                 }
             }
-            
-            values.push_back(nextValue);
         }
         
     } else {
@@ -1275,4 +1201,362 @@ void convertRVector(SEXP rVector,
     
 }
 
+// make view of R integer, real or factor vector
+void makeRColumnView(SEXP rVector, size_t rowCount, RColumnView& view)
+{
+    RUNTIME_ERROR_IF((size_t)Rf_length(rVector) < rowCount, "column too short");
+    
+    view.ints = NULL;
+    view.reals = NULL;
+    view.length = rowCount;
+    
+    if (Rf_isReal(rVector)) {
+        view.reals = REAL(rVector);
+        
+    } else if (Rf_isInteger(rVector) || Rf_isFactor(rVector)) {
+        view.ints = INTEGER(rVector);
+        
+    } else {
+        RUNTIME_ERROR_IF(true, "unrecognized column type");
+    }
+}
+
+// return numeric Value for row of view of integer or real vector
+Value numericValueAt(const RColumnView& view, size_t row)
+{
+    Value value;
+    
+    if (view.reals != NULL) {
+        value.number.d = view.reals[row];
+        value.na = ISNA(value.number.d);
+        
+    } else {
+        value.number.d = view.ints[row];
+        value.na = view.ints[row] == NA_INTEGER;
+    }
+    
+    return value;
+}
+
+// set category index for each level of R factor, or NO_INDEX if level has no category; if
+// categoryMaps is not const, insert categories for levels used by codes, in order of first use
+void mapFactorLevels(SEXP rVector,
+                     const RColumnView& codes,
+                     bool constCategoryMaps,
+                     CategoryMaps& categoryMaps,
+                     vector<index_t>& levelIndexes)
+{
+    SEXP levels;
+    PROTECT(levels = Rf_getAttrib(rVector, R_LevelsSymbol));
+    
+    size_t levelCount = (size_t)Rf_length(levels);
+    levelIndexes.assign(levelCount, NO_INDEX);
+    
+    if (constCategoryMaps) {
+        // use otherCategory if present, else NO_INDEX, for levels not in categoryMaps
+        for (size_t level = 0; level < levelCount; level++) {
+            index_t index;
+            if (categoryMaps.findIndexOrOther(CHAR(STRING_ELT(levels, (int)level)), index)) {
+                levelIndexes[level] = index;
+            }
+        }
+        
+    } else {
+        // insert in order of first use, as when converting names row by row; unused levels are
+        // not inserted
+        
+        categoryMaps.reserve(categoryMaps.countNamedCategories() + levelCount);
+        
+        for (size_t row = 0; row < codes.length; row++) {
+            int level = codes.ints[row];
+            
+            if (level != NA_INTEGER && level >= 1 && (size_t)level <= levelCount &&
+                levelIndexes[(size_t)(level - 1)] == NO_INDEX) {
+                
+                string category = CHAR(STRING_ELT(levels, level - 1));
+                levelIndexes[(size_t)(level - 1)] = categoryMaps.findOrInsertCategory(category);
+            }
+        }
+    }
+    
+    UNPROTECT(1);
+}
+
+
+// unpack model from R object made by entree_C
+void unpackModel(SEXP object, NativeModel& model)
+{
+    vector<CompactTree>& trees = model.trees;
+    index_t& xColumnCount = model.xColumnCount;
+    index_t& columnsPerTree = model.columnsPerTree;
+    SelectIndexes& selectColumns = model.selectColumns;
+    vector<ValueType>& valueTypes = model.valueTypes;
+    vector<ImputeOption>& imputeOptions = model.imputeOptions;
+    vector<CategoryMaps>& categoryMaps = model.categoryMaps;
+    vector<string>& colNames = model.colNames;
+    
+    int resultFieldIndex = -1;
+
+    // order here must match order in entree_C
+    
+    // ---------- object$trees ---------------------------------------------------------------------
+    
+    if (gTrace) CERR << "object$trees" << endl;
+    
+    resultFieldIndex++;
+    
+    SEXP object_trees = VECTOR_ELT(object, resultFieldIndex);
+
+    size_t numTrees = (size_t)Rf_length(object_trees);
+
+    for (size_t treeIndex = 0; treeIndex < numTrees; treeIndex++) {
+        trees.push_back(CompactTree());
+
+        SEXP s_tree = VECTOR_ELT(object_trees, (int)treeIndex);
+        
+        SEXP s_splitColIndex = VECTOR_ELT(s_tree, 0);
+        SEXP s_lessOrEqualIndex = VECTOR_ELT(s_tree, 1);
+        SEXP s_greaterOrNotIndex = VECTOR_ELT(s_tree, 2);
+        SEXP s_toLessOrEqualIfNA = VECTOR_ELT(s_tree, 3);
+        SEXP s_value_switch = VECTOR_ELT(s_tree, 4);
+        SEXP s_value_d = VECTOR_ELT(s_tree, 5);
+        SEXP s_value_i = VECTOR_ELT(s_tree, 6);
+        
+        size_t numNodes = (size_t)Rf_length(s_splitColIndex);
+        
+        int *splitColIndex = INTEGER(s_splitColIndex);
+        int *lessOrEqualIndex = INTEGER(s_lessOrEqualIndex);
+        int *greaterOrNotIndex = INTEGER(s_greaterOrNotIndex);
+        int *toLessOrEqualIfNA = INTEGER(s_toLessOrEqualIfNA);
+        int *value_switch = INTEGER(s_value_switch);
+        double *value_d = REAL(s_value_d);
+        int *value_i = INTEGER(s_value_i);
+        
+        CompactTree& tree = trees[treeIndex];
+        tree.splitColIndex.resize(numNodes);
+        tree.lessOrEqualIndex.resize(numNodes);
+        tree.greaterOrNotIndex.resize(numNodes);
+        tree.toLessOrEqualIfNA.resize(numNodes);
+        tree.value.resize(numNodes);
+        tree.categorySetIndex.assign(numNodes, NO_INDEX);
+        
+        if (Rf_length(s_tree) > 7) {
+            // splits on sets of categories; missing from objects made by earlier versions
+            SEXP s_categorySetIndex = VECTOR_ELT(s_tree, 7);
+            SEXP s_categorySets = VECTOR_ELT(s_tree, 8);
+            
+            int *categorySetIndex = INTEGER(s_categorySetIndex);
+            int *categorySets = INTEGER(s_categorySets);
+            size_t numSetWords = (size_t)Rf_length(s_categorySets);
+            
+            for (size_t nodeIndex = 0; nodeIndex < numNodes; nodeIndex++) {
+                tree.categorySetIndex[nodeIndex] = categorySetIndex[nodeIndex];
+            }
+            
+            for (size_t n = 0; n < numSetWords; n++) {
+                tree.categorySets.push_back((unsigned int)categorySets[n]);
+            }
+        }
+        
+        for (size_t nodeIndex = 0; nodeIndex < numNodes; nodeIndex++) {
+            tree.splitColIndex[nodeIndex] = splitColIndex[nodeIndex];
+            tree.lessOrEqualIndex[nodeIndex] = lessOrEqualIndex[nodeIndex];
+            tree.greaterOrNotIndex[nodeIndex] = greaterOrNotIndex[nodeIndex];
+            tree.toLessOrEqualIfNA[nodeIndex] = toLessOrEqualIfNA[nodeIndex];
+            
+            switch(value_switch[nodeIndex]) {
+                case kCategorical:
+                    tree.value[nodeIndex].i = value_i[nodeIndex];
+                    break;
+                    
+                case kNumeric:
+                    tree.value[nodeIndex].d = value_d[nodeIndex];
+                    break;
+                    
+                default:
+                    RUNTIME_ERROR_IF(true, "corrupt object");
+                    break;
+            }
+        }
+    }
+    
+    // ---------- object$xColumnCount ---------------------------------------------------------------------
+    
+    if (gTrace) CERR << "object$xColumnCount" << endl;
+    
+    resultFieldIndex++;
+    
+    SEXP object_xColumnCount = VECTOR_ELT(object, resultFieldIndex);
+    
+    xColumnCount = *INTEGER(object_xColumnCount);
+    
+    // ---------- object$selectColumns ---------------------------------------------------------------------
+    
+    if (gTrace) CERR << "object$selectColumns" << endl;
+    
+    resultFieldIndex++;
+
+    SEXP object_selectColumns = VECTOR_ELT(object, resultFieldIndex);
+
+    size_t numSelectColumns = (size_t)Rf_length(object_selectColumns);
+    
+    selectColumns.clear((size_t)xColumnCount + 1);
+
+    int *selectColumnsP = INTEGER(object_selectColumns);
+    
+    for (size_t k = 0; k < numSelectColumns; k++) {
+        selectColumns.select((size_t)selectColumnsP[k]);    
+    }
+    
+    // ---------- object$columnsPerTree ---------------------------------------------------------------------
+    
+    if (gTrace) CERR << "object$columnsPerTree" << endl;
+    
+    resultFieldIndex++;
+    
+    SEXP object_columnsPerTree = VECTOR_ELT(object, resultFieldIndex);
+    
+    columnsPerTree = *INTEGER(object_columnsPerTree);
+    
+    // ---------- object$valueTypes ---------------------------------------------------------------------
+    
+    if (gTrace) CERR << "object$valueTypes" << endl;
+    
+    resultFieldIndex++;
+    
+    SEXP object_valueTypes = VECTOR_ELT(object, resultFieldIndex);
+
+    for (int k = 0; k < Rf_length(object_valueTypes); k++) {
+        string nextValueType = CHAR(STRING_ELT(object_valueTypes, k));
+
+        ValueType valueType = stringToValueType(nextValueType);
+        
+        valueTypes.push_back(valueType);
+    }
+    
+    // ---------- object$imputeOptions ---------------------------------------------------------------------
+    
+    if (gTrace) CERR << "object$imputeOptions" << endl;
+    
+    resultFieldIndex++;
+    
+    SEXP object_imputeOptions = VECTOR_ELT(object, resultFieldIndex);
+
+    for (int k = 0; k < Rf_length(object_imputeOptions); k++) {
+        string nextImputeOption = CHAR(STRING_ELT(object_imputeOptions, k));
+        
+        ImputeOption imputeOption = stringToImputeOption(nextImputeOption, valueTypes[(size_t)k]);
+
+        imputeOptions.push_back(imputeOption);    
+    }
+    
+    // ---------- object$columnCategories ---------------------------------------------------------------------
+    
+    if (gTrace) CERR << "object$columnCategories" << endl;
+    
+    resultFieldIndex++;
+    
+    SEXP object_columnCategories = VECTOR_ELT(object, resultFieldIndex);
+
+    size_t numCols = (size_t)Rf_length(object_columnCategories);
+    
+    for (size_t col = 0; col < numCols; col++) {
+        categoryMaps.push_back(CategoryMaps());
+        
+        SEXP s_categories = VECTOR_ELT(object_columnCategories, (int)col);
+        
+        int numCategories = Rf_length(s_categories);
+        categoryMaps[col].reserve((size_t)numCategories);
+        
+        for (int catIndex = 0; catIndex < numCategories; catIndex++) {
+            string nextCategory = CHAR(STRING_ELT(s_categories, catIndex));
+            
+            categoryMaps[col].insertCategory(nextCategory);
+        }
+    }
+
+    // ---------- object$useNaCategory ---------------------------------------------------------------------
+    
+    if (gTrace) CERR << "object$useNaCategory" << endl;
+    
+    resultFieldIndex++;
+    
+    SEXP object_useNaCategory = VECTOR_ELT(object, resultFieldIndex);
+    
+    int *useNaCategoryP = INTEGER(object_useNaCategory);
+    
+    size_t numUseNaCategory = (size_t)Rf_length(object_useNaCategory);
+    
+    for (size_t k = 0; k < numUseNaCategory; k++) {
+        categoryMaps[k].setUseNaCategory((bool)useNaCategoryP[k]);
+    }
+    
+    // ---------- object$colNames ------------------------------------------------------------------
+    
+    if (gTrace) CERR << "object$colNames" << endl;
+    
+    resultFieldIndex++;
+    
+    SEXP object_colNames = VECTOR_ELT(object, resultFieldIndex);
+
+    for (int k = 0; k < Rf_length(object_colNames); k++) {
+        string nextColName = CHAR(STRING_ELT(object_colNames, k));
+        
+        colNames.push_back(nextColName);    
+    }
+}
+
+// return model kept with object, unpacking it if cache is empty or was made for other trees, as
+// after deserialization; if object has no cache, unpack into localModel and return it
+NativeModel& findNativeModel(SEXP object, NativeModel& localModel)
+{
+    NativeModel *modelP = &localModel;
+    
+    SEXP cache = Rf_getAttrib(object, Rf_install("native"));
+    SEXP objectTrees = VECTOR_ELT(object, 0);
+    
+    if (!Rf_isEnvironment(cache)) {
+        // made by earlier version
+        unpackModel(object, localModel);
+        
+    } else {
+        SEXP handleSymbol = Rf_install("handle");
+        SEXP handle = Rf_findVarInFrame(cache, handleSymbol);
+        
+        if (TYPEOF(handle) == EXTPTRSXP && R_ExternalPtrAddr(handle) != NULL &&
+            R_ExternalPtrProtected(handle) == objectTrees) {
+            
+            if (gTrace) CERR << "use kept model" << endl;
+            modelP = (NativeModel*)R_ExternalPtrAddr(handle);
+            
+        } else {
+            // handle owns model before unpacking, so that finalizer deletes model if unpacking
+            // fails; handle protects trees, so that their address identifies them while kept
+            
+            modelP = new NativeModel();
+            
+            PROTECT(handle = R_MakeExternalPtr(modelP, R_NilValue, objectTrees));
+            R_RegisterCFinalizerEx(handle, finalizeNativeModel, TRUE);
+            
+            unpackModel(object, *modelP);
+            Rf_defineVar(handleSymbol, handle, cache);
+            
+            UNPROTECT(1);
+        }
+    }
+    
+    return *modelP;
+}
+
+// delete model owned by external pointer
+void finalizeNativeModel(SEXP handle)
+{
+    NativeModel *modelP = (NativeModel*)R_ExternalPtrAddr(handle);
+    
+    if (modelP != NULL) {
+        delete modelP;
+        R_ClearExternalPtr(handle);
+    }
+}
+
 #endif
@@ -54,7 +54,10 @@ extern "C" {
                   SEXP s_maxSplitsPerNumericAttribute,
                   SEXP s_xValueTypes,
                   SEXP s_yValueType,
-                  SEXP s_xImputeOptions);
+                  SEXP s_xImputeOptions,
+                  SEXP s_maxCategories,
+                  SEXP s_nThreads,
+                  SEXP s_progress);
     
     // call from R to predict response from model and attributes
 	SEXP entree_predict_C(SEXP object, SEXP x);
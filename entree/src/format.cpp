@@ -14,6 +14,8 @@
 //
 
 #include <algorithm>
+#include <cstring>
+#include <iterator>
 #include <iostream>
 #include <iomanip>
 #include <sstream>
@@ -25,6 +27,61 @@
 
 using namespace std;
 
+// ========== Local Types ==========================================================================
+
+// compares category names stored in CategoryMaps, for sorting category indexes by name
+struct CategoryNameLess {
+    const char *chars;
+    const size_t *starts;
+    
+    bool operator()(index_t a, index_t b) const;
+};
+typedef struct CategoryNameLess CategoryNameLess;
+
+// for foldRareCategories; orders category indexes by descending count, then by name
+struct CategoryCountMore {
+    const std::vector<size_t> *counts;
+    const CategoryMaps *categoryMaps;
+    
+    bool operator()(index_t a, index_t b) const;
+};
+typedef struct CategoryCountMore CategoryCountMore;
+
+// columns to sort in makeSortedIndexes, shared by sorting threads
+struct SortColumnsWork {
+    const std::vector< std::vector<Value> > *values;
+    const std::vector<ValueType> *valueTypes;
+    std::vector<size_t> columns;
+    std::vector< std::vector<size_t> > *sortedIndexes;
+};
+typedef struct SortColumnsWork SortColumnsWork;
+
+// ========== Local Headers ========================================================================
+
+// compare names in same order as std::string; return negative, zero or positive
+int compareNames(const char *a, size_t aLength, const char *b, size_t bLength);
+
+// compare values as in SortValueVector, without regard to index; return negative, zero or positive
+int compareValues(const Value& a, const Value& b, ValueType valueType);
+
+// for imputeValues; restore sort order after imputing values, where imputedRows (in ascending
+// order) were NA before imputing and so were left out of sorted indexes; imputed rows are merged in
+// by index among rows with same value
+void spliceImputedRows(const std::vector<Value>& valuesColumn,
+                       ValueType valueType,
+                       const Value& imputedValue,
+                       const std::vector<size_t>& imputedRows,
+                       std::vector<size_t>& sortedColumn);
+
+// for makeSortedIndexes; sort one column, called on sorting thread
+void sortColumnWork(size_t item, void *context);
+
+// sort indexes of valueVector in same order as SortValueVector::sort, but leaving out indexes of NA
+// values; categorical values are sorted by counting and numeric values by radix sort
+void radixSortValues(const std::vector<Value>& valueVector,
+                     ValueType valueType,
+                     std::vector<size_t>& indexVector);
+
 // ========== Globals ==============================================================================
 
 const Value gNaValue = { { 0.0 }, true };
@@ -36,8 +93,11 @@ const Value gNaValue = { { 0.0 }, true };
 
 const string CategoryMaps::naCategory = " <NA> ";
 
+const string CategoryMaps::otherCategory = " <other> ";
+
 CategoryMaps::CategoryMaps() :
-useNaCategory(false)
+useNaCategory(false),
+nameStarts(1, 0)
 {
 }
 
@@ -51,9 +111,7 @@ index_t CategoryMaps::findOrInsertCategory(const std::string& category)
     index_t index;
     
     if (!findIndexForCategory(category, index)) {
-        categories.push_back(category);
-        index = (index_t)categoryToIndex.size();
-        categoryToIndex.insert(make_pair(category, index));
+        index = appendCategory(category, hashName(category.data(), category.length()));
     }
     
     return index;
@@ -68,9 +126,7 @@ index_t CategoryMaps::insertCategory(const std::string& category)
         RUNTIME_ERROR_IF(true, "insertCategory: duplicate category name");
         
     } else {
-        categories.push_back(category);
-        index = (index_t)categoryToIndex.size();
-        categoryToIndex.insert(make_pair(category, index));
+        index = appendCategory(category, hashName(category.data(), category.length()));
     }
     
     return index;
@@ -80,13 +136,24 @@ index_t CategoryMaps::insertCategory(const std::string& category)
 // param and return false
 bool CategoryMaps::findIndexForCategory(const std::string& category, index_t& index) const
 {
-    bool found = false;
     index = NO_INDEX;
     
-    map<string, index_t>::const_iterator iter = categoryToIndex.find(category);
-    if (iter != categoryToIndex.end()) {
-        found = true;
-        index = iter->second;
+    if (slots.size() > 0) {
+        size_t hash = hashName(category.data(), category.length());
+        index = slots[findSlot(category.data(), category.length(), hash)];
+    }
+    
+    return index != NO_INDEX;
+}
+
+// look for category, or for otherCategory if category is missing; if either is found, write
+// index into param and return true, else write NO_INDEX into param and return false
+bool CategoryMaps::findIndexOrOther(const std::string& category, index_t& index) const
+{
+    bool found = findIndexForCategory(category, index);
+    
+    if (!found) {
+        found = findIndexForCategory(otherCategory, index);
     }
     
     return found;
@@ -102,8 +169,9 @@ bool CategoryMaps::findCategoryForIndex(index_t index, std::string& category) co
     if (index == NO_INDEX && useNaCategory) {
         found = true;
         
-    } else if (index >= 0 && index < (index_t)categories.size()) {
-        category = categories[(size_t)index];
+    } else if (index >= 0 && index < endIndex()) {
+        category.assign(nameChars.begin() + (ptrdiff_t)nameStarts[(size_t)index],
+                        nameChars.begin() + (ptrdiff_t)nameStarts[(size_t)index + 1]);
         found = true;
     }
     
@@ -143,26 +211,164 @@ index_t CategoryMaps::beginIndex() const
 // return higest index number + 1; for enumeration
 index_t CategoryMaps::endIndex() const
 {
-    return (index_t)categories.size();
+    return (index_t)nameHashes.size();
 }
 
 // return count of all categories, excluding NA category
 size_t CategoryMaps::countNamedCategories() const
 {
-    return categories.size();
+    return nameHashes.size();
 }
 
 // return count of all categories, including NA category if used
 size_t CategoryMaps::countAllCategories() const
 {
-    return useNaCategory ? categories.size() + 1 : categories.size();
+    return useNaCategory ? nameHashes.size() + 1 : nameHashes.size();
+}
+
+// write rank of each category name in alphabetical order into ranks, indexed by category index
+// minus beginIndex(); for comparing names without string compares
+void CategoryMaps::rankCategories(std::vector<size_t>& ranks) const
+{
+    size_t numNamed = nameHashes.size();
+    
+    vector<index_t> sortedIndexes(numNamed);
+    for (size_t k = 0; k < numNamed; k++) {
+        sortedIndexes[k] = (index_t)k;
+    }
+    
+    CategoryNameLess nameLess = { nameChars.empty() ? NULL : &nameChars[0], &nameStarts[0] };
+    sort(sortedIndexes.begin(), sortedIndexes.end(), nameLess);
+    
+    ranks.assign(countAllCategories(), 0);
+    
+    // NA category is not in hash table; it goes before first name that sorts after it
+    
+    size_t rank = 0;
+    bool naRanked = !useNaCategory;
+    
+    for (size_t k = 0; k < numNamed; k++) {
+        size_t index = (size_t)sortedIndexes[k];
+        
+        if (!naRanked && compareNames(naCategory.data(), naCategory.length(),
+                                      nameLess.chars + nameStarts[index],
+                                      nameStarts[index + 1] - nameStarts[index]) < 0) {
+            ranks[0] = rank++;
+            naRanked = true;
+        }
+        
+        ranks[(size_t)((index_t)index - beginIndex())] = rank++;
+    }
+    
+    if (!naRanked) {
+        ranks[0] = rank++;
+    }
+}
+
+// prepare to hold at least count named categories without growing hash table
+void CategoryMaps::reserve(size_t count)
+{
+    nameStarts.reserve(count + 1);
+    nameHashes.reserve(count);
+    
+    if (2 * count > slots.size()) {
+        rehash(count);
+    }
 }
 
 // clear all named categories
 void CategoryMaps::clear()
 {
-    categories.clear();
-    categoryToIndex.clear();
+    nameChars.clear();
+    nameStarts.assign(1, 0);
+    nameHashes.clear();
+    slots.assign(slots.size(), NO_INDEX);
+}
+
+// return hash of name
+size_t CategoryMaps::hashName(const char *chars, size_t length)
+{
+    // FNV-1a
+    size_t hash = 2166136261U;
+    
+    for (size_t k = 0; k < length; k++) {
+        hash ^= (unsigned char)chars[k];
+        hash *= 16777619U;
+    }
+    
+    return hash;
+}
+
+// return slot holding index for name, or empty slot where it would go; hash table must not be
+// empty
+size_t CategoryMaps::findSlot(const char *chars, size_t length, size_t hash) const
+{
+    size_t mask = slots.size() - 1;
+    size_t slot = hash & mask;
+    
+    while (true) {
+        index_t index = slots[slot];
+        
+        if (index == NO_INDEX) {
+            break;
+        }
+        
+        size_t start = nameStarts[(size_t)index];
+        
+        if (nameHashes[(size_t)index] == hash &&
+            nameStarts[(size_t)index + 1] - start == length &&
+            (length == 0 || memcmp(&nameChars[start], chars, length) == 0)) {
+            
+            break;
+        }
+        
+        // linear probing
+        slot = (slot + 1) & mask;
+    }
+    
+    return slot;
+}
+
+// add category, which must not be present; return index
+index_t CategoryMaps::appendCategory(const std::string& category, size_t hash)
+{
+    index_t index = (index_t)nameHashes.size();
+    
+    // keep hash table at most half full
+    if (2 * (nameHashes.size() + 1) > slots.size()) {
+        rehash(nameHashes.size() + 1);
+    }
+    
+    nameChars.insert(nameChars.end(), category.begin(), category.end());
+    nameStarts.push_back(nameChars.size());
+    nameHashes.push_back(hash);
+    
+    slots[findSlot(category.data(), category.length(), hash)] = index;
+    
+    return index;
+}
+
+// resize hash table to have room for at least count categories
+void CategoryMaps::rehash(size_t count)
+{
+    size_t numSlots = 16;
+    while (numSlots < 2 * count) {
+        numSlots *= 2;
+    }
+    
+    slots.assign(numSlots, NO_INDEX);
+    
+    size_t mask = numSlots - 1;
+    
+    for (size_t index = 0; index < nameHashes.size(); index++) {
+        size_t slot = nameHashes[index] & mask;
+        
+        while (slots[slot] != NO_INDEX) {
+            slot = (slot + 1) & mask;
+        }
+        
+        slots[slot] = (index_t)index;
+    }
 }
 
 // for debugging; print info
@@ -170,23 +376,88 @@ void CategoryMaps::dump() const
 {
     CERR << "~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~" << endl;
     CERR << "useNaCategory = " << (useNaCategory ? "T" : "F") << endl;    
-    CERR << "categories.size() = " << categories.size() << endl;    
-    CERR << "categoryToIndex.size() = " << categoryToIndex.size() << endl;    
+    CERR << "countNamedCategories() = " << countNamedCategories() << endl;    
+    CERR << "nameChars.size() = " << nameChars.size() << endl;    
+    CERR << "slots.size() = " << slots.size() << endl;    
     
     for (index_t index = beginIndex(); index < endIndex(); index++) {
         CERR << index << "\t" << getCategoryForIndex(index) << endl;
     }
     
     CERR << endl;
+    CERR << "~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~" << endl;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+// assigns consecutive slot numbers to the categories seen in the rows at a tree node, so that
+// per-category statistics take space and time in proportion to count of rows, not count of
+// categories in column
+
+CategorySlots::CategorySlots()
+{
+}
+
+CategorySlots::~CategorySlots()
+{
+}
+
+// forget all categories; prepare to hold up to count categories without growing hash table
+void CategorySlots::clear(size_t count)
+{
+    categories.clear();
+    rehash(count);
+}
+
+// return slot for category, assigning next slot number if category has not been seen
+size_t CategorySlots::findOrInsert(index_t category)
+{
+    size_t position = findPosition(category);
     
-    map<string, index_t>::const_iterator iter2 = categoryToIndex.begin();
-    while (iter2 != categoryToIndex.end()) {
-        CERR << iter2->first << "\t" << iter2->second << endl;
-        iter2++;
+    if (table[position] == 0) {
+        // keep hash table at most half full
+        if (2 * (categories.size() + 1) > table.size()) {
+            rehash(categories.size() + 1);
+            position = findPosition(category);
+        }
+        
+        categories.push_back(category);
+        table[position] = categories.size();
     }
     
-    CERR << endl;
-    CERR << "~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~" << endl;
+    return table[position] - 1;
+}
+
+// return hash table position holding slot for category, or empty position where it would go
+size_t CategorySlots::findPosition(index_t category) const
+{
+    size_t mask = table.size() - 1;
+    
+    // multiplicative hash; category + 1 so NA category (NO_INDEX) hashes like any other
+    size_t hash = (size_t)(category + 1) * 2654435761u;
+    size_t position = (hash ^ (hash >> 15)) & mask;
+    
+    while (table[position] != 0 && categories[table[position] - 1] != category) {
+        // linear probing
+        position = (position + 1) & mask;
+    }
+    
+    return position;
+}
+
+// resize hash table to have room for at least count categories
+void CategorySlots::rehash(size_t count)
+{
+    size_t numPositions = 8;
+    while (numPositions < 2 * count) {
+        numPositions *= 2;
+    }
+    
+    table.assign(numPositions, 0);
+    
+    for (size_t slot = 0; slot < categories.size(); slot++) {
+        table[findPosition(categories[slot])] = slot + 1;
+    }
 }
 
 // -------------------------------------------------------------------------------------------------
@@ -285,6 +556,14 @@ void SelectIndexes::unselect(size_t index)
     }
 }
 
+// exchange contents with other without copying lists
+void SelectIndexes::swap(SelectIndexes& other)
+{
+    bitMap.swap(other.bitMap);
+    indexes.swap(other.indexes);
+    std::swap(selected, other.selected);
+}
+
 // return bool vector with item for each possible index (0 to size - 1), valued true if index is
 // selected and false if not selected
 const vector<bool>& SelectIndexes::boolVector() const
@@ -416,8 +695,87 @@ void SortValueVector::sort(vector<size_t>& indexVector, const SelectIndexes& sel
     std::sort(indexVector.begin(), indexVector.end(), *this);
 }
 
+// -------------------------------------------------------------------------------------------------
+
+// for foldRareCategories; orders category indexes by descending count, then by name
+bool CategoryCountMore::operator()(index_t a, index_t b) const
+{
+    size_t countA = counts->at((size_t)a);
+    size_t countB = counts->at((size_t)b);
+    
+    bool result;
+    
+    if (countA != countB) {
+        result = countA > countB;
+        
+    } else {
+        result = categoryMaps->getCategoryForIndex(a) < categoryMaps->getCategoryForIndex(b);
+    }
+    
+    return result;
+}
+
 // ========== Functions ============================================================================
 
+// if column has more than maxCategories categories, keep the maxCategories - 1 most frequent (ties
+// go to name that sorts earlier alphabetically) and fold the others into otherCategory; categories
+// are renumbered, and values are changed to match
+void foldRareCategories(size_t maxCategories,
+                        std::vector<Value>& valuesColumn,
+                        CategoryMaps& categoryMaps)
+{
+    size_t numNamed = categoryMaps.countNamedCategories();
+    
+    if (maxCategories > 0 && numNamed > maxCategories) {
+        // NA values and NA category are left alone
+        vector<size_t> counts(numNamed, 0);
+        for (size_t row = 0; row < valuesColumn.size(); row++) {
+            const Value& value = valuesColumn[row];
+            if (!value.na && value.number.i >= 0 && (size_t)value.number.i < numNamed) {
+                counts[(size_t)value.number.i]++;
+            }
+        }
+        
+        vector<index_t> byCount(numNamed);
+        for (size_t index = 0; index < numNamed; index++) {
+            byCount[index] = (index_t)index;
+        }
+        
+        CategoryCountMore countMore = { &counts, &categoryMaps };
+        sort(byCount.begin(), byCount.end(), countMore);
+        
+        vector<bool> keep(numNamed, false);
+        for (size_t k = 0; k + 1 < maxCategories; k++) {
+            keep[(size_t)byCount[k]] = true;
+        }
+        
+        // kept categories stay in same relative order, followed by otherCategory
+        CategoryMaps foldedMaps;
+        foldedMaps.setUseNaCategory(categoryMaps.getUseNaCategory());
+        foldedMaps.reserve(maxCategories);
+        
+        vector<index_t> newIndexes(numNamed, NO_INDEX);
+        for (size_t index = 0; index < numNamed; index++) {
+            if (keep[index]) {
+                string category = categoryMaps.getCategoryForIndex((index_t)index);
+                newIndexes[index] = foldedMaps.insertCategory(category);
+            }
+        }
+        
+        index_t otherIndex = foldedMaps.findOrInsertCategory(CategoryMaps::otherCategory);
+        
+        for (size_t row = 0; row < valuesColumn.size(); row++) {
+            Value& value = valuesColumn[row];
+            if (!value.na && value.number.i >= 0 && (size_t)value.number.i < numNamed) {
+                index_t newIndex = newIndexes[(size_t)value.number.i];
+                value.number.i = newIndex == NO_INDEX ? otherIndex : newIndex;
+            }
+        }
+        
+        categoryMaps = foldedMaps;
+    }
+}
+
 // for debugging or logging; print vector of Value
 void printValuesColumn(const std::vector<Value>& valuesColumn,
                        ValueType valueType,
@@ -574,41 +932,60 @@ Value meanValue(const std::vector<Value>& valuesColumn, const SelectIndexes& sel
     return value;
 }
 
-// calculate median of selected rows in a vector of numerical Values; must supply vector of sorted
-// indexes that at least includes all of the selected rows
-Value medianValue(const std::vector<Value>& valuesColumn,
-                  const SelectIndexes& selectRows,
-                  const std::vector<size_t>& sortedIndexes)
+// calculate quantile of selected rows in a vector of numerical Values, ignoring NA; fraction from 0
+// to 1 picks value at index (size_t)(fraction * count) of values in sorted order; uses selection
+// instead of sorting, so takes time proportional to count of selected rows
+Value quantileValue(const std::vector<Value>& valuesColumn,
+                    const SelectIndexes& selectRows,
+                    double fraction)
 {
-    vector<size_t> valueRows;
-    valueRows.reserve(selectRows.countSelected());
+    vector<double> numbers;
+    numbers.reserve(selectRows.countSelected());
     
-    const vector<bool>& rowSelected = selectRows.boolVector();
-    for (size_t index = 0; index < sortedIndexes.size(); index++) {
-        size_t row = sortedIndexes[index];
-        LOGIC_ERROR_IF(row >= valuesColumn.size() || row >= rowSelected.size(), "out of range");
-
+    const vector<size_t>& rowIndexes = selectRows.indexVector();
+    for (size_t rowIndex = 0; rowIndex < rowIndexes.size(); rowIndex++) {
+        size_t row = rowIndexes[rowIndex];
+        LOGIC_ERROR_IF(row >= valuesColumn.size(), "out of range");
+        
         // ignore NA values
-        if (rowSelected[row] && !valuesColumn[row].na) {
-            valueRows.push_back(row);
+        if (!valuesColumn[row].na) {
+            numbers.push_back(valuesColumn[row].number.d);
         }
     }
     
     Value value;
-    if (valueRows.size() == 0) {
-        // if empty vector, return NA as mean
+    if (numbers.size() == 0) {
+        // if empty vector, return NA as quantile
         value = gNaValue;
         
     } else {
-        // values were added in sorted order, so pick middle value
-        size_t index = valueRows.size() / 2;
-        size_t row = valueRows[index];
-        value = valuesColumn.at(row);
+        size_t index;
+        if (!(fraction > 0.0)) {
+            index = 0;
+            
+        } else if (fraction * numbers.size() >= numbers.size() - 1) {
+            index = numbers.size() - 1;
+            
+        } else {
+            index = (size_t)(fraction * numbers.size());
+        }
+        
+        // partial sort that places element at index in its sorted position
+        nth_element(numbers.begin(), numbers.begin() + index, numbers.end());
+        
+        value.na = false;
+        value.number.d = numbers[index];
     }
     
     return value;
 }
 
+// calculate median of selected rows in a vector of numerical Values
+Value medianValue(const std::vector<Value>& valuesColumn, const SelectIndexes& selectRows)
+{
+    return quantileValue(valuesColumn, selectRows, 0.5);
+}
+
 // select modal value of selected rows in a vector of categorical Values; in case of tie, choose
 // category with name that sorts earlier alphabetically; NA category (if used) has name " <NA> "
 Value modeValue(const std::vector<Value>& valuesColumn,
@@ -690,14 +1067,89 @@ Value modeValue(const std::vector<Value>& valuesColumn,
 
 // -------------------------------------------------------------------------------------------------
 
+// append set of specified categories to categorySets; return index of first word of set; set is
+// stored as count of following words, then bitset in which bit k is set if category with index
+// k - 1 is in set, so that NA category (index NO_INDEX) is bit 0
+size_t appendCategorySet(const std::vector<index_t>& categories,
+                         std::vector<unsigned int>& categorySets)
+{
+    size_t start = categorySets.size();
+    
+    index_t maxCategory = NO_INDEX;
+    for (size_t k = 0; k < categories.size(); k++) {
+        LOGIC_ERROR_IF(categories[k] < NO_INDEX, "out of range");
+        maxCategory = max(maxCategory, categories[k]);
+    }
+    
+    size_t numWords = (size_t)(maxCategory + 1) / 32 + 1;
+    
+    categorySets.push_back((unsigned int)numWords);
+    categorySets.resize(start + 1 + numWords, 0);
+    
+    for (size_t k = 0; k < categories.size(); k++) {
+        size_t bit = (size_t)(categories[k] + 1);
+        categorySets[start + 1 + bit / 32] |= 1U << (bit % 32);
+    }
+    
+    return start;
+}
+
+// return true if category is in set stored by appendCategorySet beginning at categorySet
+bool isInCategorySet(index_t category, const unsigned int *categorySet)
+{
+    // categories below NO_INDEX wrap around to large bit numbers, so are not in set
+    size_t bit = (size_t)(category + 1);
+    
+    return bit / 32 < categorySet[0] && ((categorySet[1 + bit / 32] >> (bit % 32)) & 1U) != 0;
+}
+
+// for debugging or logging; return names of categories in set stored by appendCategorySet
+// beginning at categorySet
+std::string categorySetToString(const unsigned int *categorySet, const CategoryMaps& categoryMaps)
+{
+    string str = "{";
+    
+    size_t numBits = 32 * (size_t)categorySet[0];
+    for (size_t bit = 0; bit < numBits; bit++) {
+        index_t category = (index_t)bit - 1;
+        
+        if (isInCategorySet(category, categorySet)) {
+            string name;
+            categoryMaps.findCategoryForIndex(category, name);
+            
+            str += str.length() > 1 ? ", " + name : name;
+        }
+    }
+    
+    str += "}";
+    
+    return str;
+}
+
+// return copy of number with only the field used for valueType set and other bytes zero, so that
+// equal values have equal bytes
+Number numberForType(Number number, ValueType valueType)
+{
+    Number result;
+    memset(&result, 0, sizeof(result));
+    
+    switch (valueType) {
+        case kCategorical:  result.i = number.i;    break;
+        case kNumeric:      result.d = number.d;    break;
+    }
+    
+    return result;
+}
+
+// -------------------------------------------------------------------------------------------------
+
 // return Value to be used as replacement for NA for specified column and selection of rows 
 Value imputedValue(size_t col,
                    const std::vector<ImputeOption>& convertTypes,
                    const std::vector< std::vector<Value> >& values,
                    const std::vector<ValueType>& valueTypes,
                    const SelectIndexes& selectRows,
-                   const std::vector<CategoryMaps>& categoryMaps,
-                   const std::vector< std::vector<size_t> >& sortedIndexes)
+                   const std::vector<CategoryMaps>& categoryMaps)
 {
     size_t numCols = values.size();
 
@@ -710,6 +1162,7 @@ Value imputedValue(size_t col,
         {
             switch (convertTypes[col]) {
                 case kNoImpute:
+                case kToLearnedBranch:
                     break;
                     
                 case kToCategory:
@@ -720,6 +1173,7 @@ Value imputedValue(size_t col,
                     break;
                     
                 case kToMode:
+                case kToBranchMode:
                 {
                     value = modeValue(values[col], selectRows, categoryMaps[col]);
                 }
@@ -727,6 +1181,8 @@ Value imputedValue(size_t col,
                     
                 case kToMean:
                 case kToMedian:
+                case kToBranchMean:
+                case kToBranchMedian:
                     RUNTIME_ERROR_IF(true, "invalid NA conversion for categorical type")
                     break;
                     
@@ -741,22 +1197,26 @@ Value imputedValue(size_t col,
         {
             switch (convertTypes[col]) {
                 case kNoImpute:
+                case kToLearnedBranch:
                     break;
                     
                 case kToCategory:
                 case kToMode:
+                case kToBranchMode:
                     RUNTIME_ERROR_IF(true, "invalid NA conversion for numerical type")
                     break;
                     
                 case kToMean:
+                case kToBranchMean:
                 {
                     value = meanValue(values[col], selectRows);
                 }
                     break;
                     
                 case kToMedian:
+                case kToBranchMedian:
                 {
-                    value = medianValue(values[col], selectRows, sortedIndexes[col]);
+                    value = medianValue(values[col], selectRows);
                 }
                     break;
                     
@@ -771,7 +1231,8 @@ Value imputedValue(size_t col,
     return value;
 }
 
-// replace NA values in selected columns and rows in array of Values
+// replace NA values in selected columns and rows in array of Values; columns with branch
+// ImputeOptions are left unchanged, to be imputed separately at each node during training
 void imputeValues(const std::vector<ImputeOption>& convertTypes,
                   const std::vector<ValueType>& valueTypes,
                   std::vector< std::vector<Value> >& values,
@@ -807,26 +1268,27 @@ void imputeValues(const std::vector<ImputeOption>& convertTypes,
         
         LOGIC_ERROR_IF(convertTypes[col] == kToDefault, "unconverted kToDefault");
         
-        if (convertTypes[col] != kNoImpute) {
+        if (convertTypes[col] != kNoImpute && !isBranchImputeOption(convertTypes[col])) {
             // get imputed value to be used for entire column
             imputedValues[col] = imputedValue(col, convertTypes, values, valueTypes, selectRows,
-                                              categoryMaps, sortedIndexes);
+                                              categoryMaps);
             
-            bool changedCol = false;
+            vector<size_t> imputedRows;
             
             for (size_t rowIndex = 0; rowIndex < selectRowIndexes.size(); rowIndex++) {
                 size_t row = selectRowIndexes[rowIndex];
                 
                 if (values[col][row].na) {
                     values[col][row] = imputedValues[col];
-                    changedCol = true;
+                    imputedRows.push_back(row);
                 }
             }
             
-            // re-sort if any values in column were changed
-            if (changedCol) {
-                SortValueVector sortValueVector(values[col], valueTypes[col]);
-                sortValueVector.sort(sortedIndexes.at(col), selectRows);
+            // add imputed rows to sorted indexes if any values in column were changed
+            if (!imputedRows.empty()) {
+                sort(imputedRows.begin(), imputedRows.end());
+                spliceImputedRows(values[col], valueTypes[col], imputedValues[col], imputedRows,
+                                  sortedIndexes.at(col));
             }
         }
     }
@@ -899,8 +1361,8 @@ void valuesToCells(const std::vector< std::vector<Value> >& values,
 // convert array of strings (as vector of rows) to array of Values (as vector of columns);
 // unquoted empty cell is treated as NA; quoted empty string is treated as string of length zero;
 //  interpretNA: also interpret unquoted NA as missing value
-//  constCategories: if true, treat any unrecognized category as NA; if false, update
-//      categoryMaps to include any new categories found
+//  constCategories: if true, treat any unrecognized category as otherCategory if present in
+//      categoryMaps, else as NA; if false, update categoryMaps to include any new categories found
 void cellsToValues(const std::vector< std::vector<std::string> >& cells,
                    const std::vector< std::vector<bool> >& quoted,
                    const std::vector<ValueType> valueTypes,
@@ -971,7 +1433,11 @@ void cellsToValues(const std::vector< std::vector<std::string> >& cells,
                         value = gNaValue;
                         
                     } else {
-                        if (categoryMap.findIndexForCategory(cell, value.number.i)) {
+                        bool found = constCategories ?
+                            categoryMap.findIndexOrOther(cell, value.number.i) :
+                            categoryMap.findIndexForCategory(cell, value.number.i);
+                        
+                        if (found) {
                             // found
                             value.na = false;
                             
@@ -1002,31 +1468,38 @@ void cellsToValues(const std::vector< std::vector<std::string> >& cells,
 
 // -------------------------------------------------------------------------------------------------
 
-// create vector of sorted indexes for each selected column in array of Values
+// create vector of sorted indexes for each selected column in array of Values; rows with NA are
+// left out, so split scans skip them, though columns of Values still hold every row; columns are
+// sorted on up to numThreads threads, or one per processor if numThreads is 0
 void makeSortedIndexes(const std::vector< std::vector<Value> >& values,
                        const std::vector<ValueType> valueTypes,
                        const SelectIndexes& selectColumns,
-                       std::vector< std::vector<size_t> >& sortedIndexes)
+                       std::vector< std::vector<size_t> >& sortedIndexes,
+                       size_t numThreads)
 {
-    sortedIndexes.clear();
-    
     size_t numCols = values.size();
     
+    LOGIC_ERROR_IF(valueTypes.size() != numCols, "values vs. valueTypes size mismatch");
+    
     const vector<bool>& columnIsSelected = selectColumns.boolVector();
     
-    size_t numRows = values[0].size();
+    sortedIndexes.assign(numCols, vector<size_t>(0));
+    
+    SortColumnsWork work;
+    work.values = &values;
+    work.valueTypes = &valueTypes;
+    work.sortedIndexes = &sortedIndexes;
     
     for (size_t col = 0; col < numCols; col++) {
         if (columnIsSelected.at(col)) {
-            sortedIndexes.push_back(vector<size_t>(numRows));
-            
-            SortValueVector sortValueVector(values.at(col), valueTypes.at(col));
-            sortValueVector.sort(sortedIndexes.at(col));
-            
-        } else {
-            sortedIndexes.push_back(vector<size_t>(0));
+            work.columns.push_back(col);
         }
     }
+    
+    string message;
+    bool success = runParallel(work.columns.size(), numThreads, sortColumnWork, &work, message);
+    
+    RUNTIME_ERROR_IF(!success, message);
 }
 
 // -------------------------------------------------------------------------------------------------
@@ -1099,15 +1572,19 @@ void valueTypeToString(ValueType valueType, string& str)
 void imputeOptionToString(ImputeOption imputeOption, string& str)
 {
     switch(imputeOption) {
-        case kNoImpute:                 str = "none";       break;
-        case kToDefault:                str = "default";    break;
-        case kToCategory:               str = "category";   break;
-        case kToMode:                   str = "mode";       break;
-        case kToMean:                   str = "mean";       break;
-        case kToMedian:                 str = "median";     break;
+        case kNoImpute:                 str = "none";         break;
+        case kToDefault:                str = "default";      break;
+        case kToCategory:               str = "category";     break;
+        case kToMode:                   str = "mode";         break;
+        case kToMean:                   str = "mean";         break;
+        case kToMedian:                 str = "median";       break;
+        case kToBranchMode:             str = "branchmode";   break;
+        case kToBranchMean:             str = "branchmean";   break;
+        case kToBranchMedian:           str = "branchmedian"; break;
+        case kToLearnedBranch:          str = "learned";      break;
             
         // suppress compiler warning
-        default:                        str = "";           break;
+        default:                        str = "";             break;
     }
 }
 
@@ -1130,6 +1607,13 @@ ImputeOption getDefaultImputeOption(ValueType valueType)
     return imputeOption;
 }
 
+// return true if ImputeOption handles NA separately at each node of tree instead of once for column
+bool isBranchImputeOption(ImputeOption imputeOption)
+{
+    return imputeOption == kToBranchMode || imputeOption == kToBranchMean ||
+        imputeOption == kToBranchMedian || imputeOption == kToLearnedBranch;
+}
+
 // get ImputeOption for name
 ImputeOption stringToImputeOption(string str, ValueType valueType)
 {
@@ -1149,6 +1633,12 @@ ImputeOption stringToImputeOption(string str, ValueType valueType)
                 } else if (str.find("mo") == 0) {
                     imputeOption = kToMode;
                     
+                } else if (str.find("branchmo") == 0) {
+                    imputeOption = kToBranchMode;
+                    
+                } else if (str.find("l") == 0) {
+                    imputeOption = kToLearnedBranch;
+                    
                 } else if (str.find("d") == 0) {
                     imputeOption = kToDefault;
                     
@@ -1167,6 +1657,15 @@ ImputeOption stringToImputeOption(string str, ValueType valueType)
                 } else if (str.find("med") == 0) {
                     imputeOption = kToMedian;
                     
+                } else if (str.find("branchmea") == 0) {
+                    imputeOption = kToBranchMean;
+                    
+                } else if (str.find("branchmed") == 0) {
+                    imputeOption = kToBranchMedian;
+                    
+                } else if (str.find("l") == 0) {
+                    imputeOption = kToLearnedBranch;
+                    
                 } else if (str.find("d") == 0) {
                     imputeOption = kToDefault;
                     
@@ -1184,32 +1683,555 @@ ImputeOption stringToImputeOption(string str, ValueType valueType)
     return imputeOption;
 }
 
-// ========== Tests ================================================================================
+// ========== Local Functions ======================================================================
 
-// component tests
-void ctest_format(int& totalPassed, int& totalFailed, bool verbose)
+// compare values as in SortValueVector, without regard to index; return negative, zero or positive
+int compareValues(const Value& a, const Value& b, ValueType valueType)
 {
-    int passed = 0;
-    int failed = 0;
+    int result = 0;
     
-    // ~~~~~~~~~~~~~~~~~~~~~~
-    // CategoryMaps
+    if (a.na || b.na) {
+        result = (int)b.na - (int)a.na;
+        
+    } else {
+        switch (valueType) {
+            case kNumeric:
+                result = a.number.d < b.number.d ? -1 : (a.number.d > b.number.d ? 1 : 0);
+                break;
+                
+            case kCategorical:
+                result = a.number.i < b.number.i ? -1 : (a.number.i > b.number.i ? 1 : 0);
+                break;
+        }
+    }
     
-    // ~~~~~~~~~~~~~~~~~~~~~~
-    // SelectIndexes
+    return result;
+}
+
+// for imputeValues; restore sort order after imputing values, where imputedRows (in ascending
+// order) were NA before imputing and so were left out of sorted indexes; imputed rows are merged in
+// by index among rows with same value
+void spliceImputedRows(const std::vector<Value>& valuesColumn,
+                       ValueType valueType,
+                       const Value& imputedValue,
+                       const std::vector<size_t>& imputedRows,
+                       std::vector<size_t>& sortedColumn)
+{
+    size_t numSorted = sortedColumn.size();
     
-    // ~~~~~~~~~~~~~~~~~~~~~~
+    vector<size_t> result;
+    result.reserve(numSorted + imputedRows.size());
+    
+    // binary search for range of rows with same value as imputed value
+    
+    size_t lower = 0;
+    size_t upper = numSorted;
+    while (lower < upper) {
+        size_t middle = lower + (upper - lower) / 2;
+        
+        if (compareValues(valuesColumn[sortedColumn[middle]], imputedValue, valueType) < 0) {
+            lower = middle + 1;
+            
+        } else {
+            upper = middle;
+        }
+    }
+    
+    size_t begin = lower;
+    
+    upper = numSorted;
+    while (lower < upper) {
+        size_t middle = lower + (upper - lower) / 2;
+        
+        if (compareValues(valuesColumn[sortedColumn[middle]], imputedValue, valueType) <= 0) {
+            lower = middle + 1;
+            
+        } else {
+            upper = middle;
+        }
+    }
+    
+    size_t end = lower;
+    
+    // rows with lower values, then rows with same value merged by index, then rows with higher
+    // values
+    
+    result.insert(result.end(), sortedColumn.begin(), sortedColumn.begin() + (ptrdiff_t)begin);
+    
+    merge(sortedColumn.begin() + (ptrdiff_t)begin, sortedColumn.begin() + (ptrdiff_t)end,
+          imputedRows.begin(), imputedRows.end(), back_inserter(result));
+    
+    result.insert(result.end(), sortedColumn.begin() + (ptrdiff_t)end, sortedColumn.end());
+    
+    sortedColumn.swap(result);
+}
+
+// for makeSortedIndexes; sort one column, called on sorting thread
+void sortColumnWork(size_t item, void *context)
+{
+    SortColumnsWork& work = *(SortColumnsWork *)context;
+    size_t col = work.columns[item];
+    
+    radixSortValues((*work.values)[col], (*work.valueTypes)[col], (*work.sortedIndexes)[col]);
+}
+
+// sort indexes of valueVector in same order as SortValueVector::sort, but leaving out indexes of NA
+// values; categorical values are sorted by counting and numeric values by radix sort
+void radixSortValues(const std::vector<Value>& valueVector,
+                     ValueType valueType,
+                     std::vector<size_t>& indexVector)
+{
+    size_t numRows = valueVector.size();
+    
+    // rows without NA values, in index order
+    
+    indexVector.clear();
+    for (size_t row = 0; row < numRows; row++) {
+        if (!valueVector[row].na) {
+            indexVector.push_back(row);
+        }
+    }
+    
+    size_t count = indexVector.size();
+    
+    index_t minIndex = 0;
+    index_t maxIndex = 0;
+    
+    if (valueType == kCategorical && count > 0) {
+        minIndex = valueVector[indexVector[0]].number.i;
+        maxIndex = minIndex;
+        
+        for (size_t k = 0; k < count; k++) {
+            index_t index = valueVector[indexVector[k]].number.i;
+            minIndex = min(minIndex, index);
+            maxIndex = max(maxIndex, index);
+        }
+    }
+    
+    if (count < 64) {
+        // few values; comparison sort is faster
+        SortValueVector sortValueVector(valueVector, valueType);
+        std::sort(indexVector.begin(), indexVector.end(), sortValueVector);
+        
+    } else if (valueType == kCategorical && (size_t)(maxIndex - minIndex) < count) {
+        // counting sort over range of category indexes
+        
+        vector<size_t> starts((size_t)(maxIndex - minIndex) + 2, 0);
+        for (size_t k = 0; k < count; k++) {
+            starts[(size_t)(valueVector[indexVector[k]].number.i - minIndex) + 1]++;
+        }
+        
+        for (size_t k = 1; k < starts.size(); k++) {
+            starts[k] += starts[k - 1];
+        }
+        
+        vector<size_t> rows(indexVector);
+        for (size_t k = 0; k < count; k++) {
+            size_t position = starts[(size_t)(valueVector[rows[k]].number.i - minIndex)]++;
+            indexVector[position] = rows[k];
+        }
+        
+    } else {
+        // make unsigned keys that sort in same order as values
+        
+        const unsigned long long signBit = 1ULL << 63;
+        
+        vector<unsigned long long> keys(count);
+        vector<size_t> rows(indexVector);
+        
+        for (size_t k = 0; k < count; k++) {
+            const Value& value = valueVector[rows[k]];
+            unsigned long long key;
+            
+            if (valueType == kNumeric) {
+                // -0.0 and 0.0 compare equal
+                double d = value.number.d == 0.0 ? 0.0 : value.number.d;
+                memcpy(&key, &d, sizeof(key));
+                
+                // flip all bits of negative numbers, so larger magnitude sorts first; set sign bit of
+                // positive numbers, so they sort after negative numbers
+                key = (key & signBit) ? ~key : (key | signBit);
+                
+            } else {
+                key = (unsigned long long)(long long)value.number.i ^ signBit;
+            }
+            
+            keys[k] = key;
+        }
+        
+        // count occurrences of each value of each byte of keys
+        
+        vector<size_t> histograms(8 * 256, 0);
+        for (size_t k = 0; k < count; k++) {
+            for (size_t pass = 0; pass < 8; pass++) {
+                histograms[pass * 256 + (size_t)((keys[k] >> (8 * pass)) & 0xFF)]++;
+            }
+        }
+        
+        // stable sort on each byte, least significant first, so rows with equal keys stay in index
+        // order; skip bytes that are same for all keys
+        
+        vector<unsigned long long> keysTemp(count);
+        vector<size_t> rowsTemp(count);
+        
+        for (size_t pass = 0; pass < 8; pass++) {
+            size_t *histogram = &histograms[pass * 256];
+            size_t shift = 8 * pass;
+            
+            if (histogram[(size_t)((keys[0] >> shift) & 0xFF)] < count) {
+                size_t offset = 0;
+                for (size_t digit = 0; digit < 256; digit++) {
+                    size_t digitCount = histogram[digit];
+                    histogram[digit] = offset;
+                    offset += digitCount;
+                }
+                
+                for (size_t k = 0; k < count; k++) {
+                    size_t position = histogram[(size_t)((keys[k] >> shift) & 0xFF)]++;
+                    keysTemp[position] = keys[k];
+                    rowsTemp[position] = rows[k];
+                }
+                
+                keys.swap(keysTemp);
+                rows.swap(rowsTemp);
+            }
+        }
+        
+        indexVector.swap(rows);
+    }
+}
+
+// compare names in same order as std::string; return negative, zero or positive
+int compareNames(const char *a, size_t aLength, const char *b, size_t bLength)
+{
+    int result = 0;
+    
+    if (aLength > 0 && bLength > 0) {
+        result = memcmp(a, b, min(aLength, bLength));
+    }
+    
+    if (result == 0) {
+        result = aLength < bLength ? -1 : (aLength > bLength ? 1 : 0);
+    }
+    
+    return result;
+}
+
+// compares category names stored in CategoryMaps, for sorting category indexes by name
+bool CategoryNameLess::operator()(index_t a, index_t b) const
+{
+    size_t aStart = starts[(size_t)a];
+    size_t bStart = starts[(size_t)b];
+    
+    return compareNames(chars + aStart, starts[(size_t)a + 1] - aStart,
+                        chars + bStart, starts[(size_t)b + 1] - bStart) < 0;
+}
+
+// ========== Tests ================================================================================
+
+// component tests
+void ctest_format(int& totalPassed, int& totalFailed, bool verbose)
+{
+    int passed = 0;
+    int failed = 0;
+    
+    // ~~~~~~~~~~~~~~~~~~~~~~
+    // CategoryMaps
+    
+    {
+        CategoryMaps oneCategoryMap;
+        oneCategoryMap.insertCategory("delta");
+        oneCategoryMap.insertCategory(" ");
+        oneCategoryMap.insertCategory("alpha");
+        oneCategoryMap.setUseNaCategory(true);
+        
+        // NO_INDEX (" <NA> "), "delta", " ", "alpha"
+        vector<size_t> ranks;
+        oneCategoryMap.rankCategories(ranks);
+        
+        if (ranks.size() == 4 && ranks[0] == 1 && ranks[1] == 3 && ranks[2] == 0 && ranks[3] == 2) {
+            passed++;
+        } else {
+            failed++;
+        }
+    }
+    
+    {
+        // names survive growing and clearing hash table; empty name is a category
+        
+        CategoryMaps oneCategoryMap;
+        oneCategoryMap.reserve(10);
+        
+        bool same = true;
+        for (int pass = 0; pass < 2; pass++) {
+            oneCategoryMap.clear();
+            oneCategoryMap.insertCategory("");
+            
+            for (int k = 0; k < 1000; k++) {
+                ostringstream oss;
+                oss << "c" << (k * 7919) % 1000;
+                same = same && oneCategoryMap.findOrInsertCategory(oss.str()) == k + 1;
+            }
+            
+            for (int k = 0; k < 1000; k++) {
+                ostringstream oss;
+                oss << "c" << (k * 7919) % 1000;
+                same = same && oneCategoryMap.getIndexForCategory(oss.str()) == k + 1;
+                same = same && oneCategoryMap.getCategoryForIndex(k + 1) == oss.str();
+            }
+            
+            index_t index;
+            same = same && oneCategoryMap.getIndexForCategory("") == 0;
+            same = same && !oneCategoryMap.findIndexForCategory("c1000", index);
+            same = same && index == NO_INDEX;
+            same = same && oneCategoryMap.countNamedCategories() == 1001;
+        }
+        
+        if (same) passed++; else failed++;
+    }
+    
+    // ~~~~~~~~~~~~~~~~~~~~~~
+    // CategorySlots
+    
+    {
+        // slots assigned in order first seen, including NO_INDEX; survive growing past clear count
+        
+        CategorySlots categorySlots;
+        
+        bool same = true;
+        for (int pass = 0; pass < 2; pass++) {
+            categorySlots.clear(4);
+            
+            for (int k = 0; k < 3000; k++) {
+                index_t category = (index_t)((k * 7919) % 1000) - 1;
+                size_t expected = (size_t)(k % 1000);
+                same = same && categorySlots.findOrInsert(category) == expected;
+            }
+            
+            same = same && categorySlots.size() == 1000;
+            same = same && categorySlots.categoryVector()[1] == 7919 % 1000 - 1;
+        }
+        
+        if (same) passed++; else failed++;
+    }
+    
+    // ~~~~~~~~~~~~~~~~~~~~~~
+    // SelectIndexes
+    
+    {
+        // swap exchanges sizes, selections and counts
+        
+        SelectIndexes first(5, false);
+        first.select(3);
+        first.select(1);
+        
+        SelectIndexes second(2, true);
+        
+        first.swap(second);
+        
+        bool ok = first.boolVector().size() == 2 && first.countSelected() == 2 &&
+                  first.indexVector()[1] == 1;
+        ok = ok && second.boolVector().size() == 5 && second.countSelected() == 2 &&
+             second.indexVector()[0] == 3 && second.boolVector()[1];
+        
+        if (ok) passed++; else failed++;
+    }
+    
+    // ~~~~~~~~~~~~~~~~~~~~~~
     // SortValueVector
     
     // ~~~~~~~~~~~~~~~~~~~~~~
     // meanValue
     
+    // ~~~~~~~~~~~~~~~~~~~~~~
+    // quantileValue
+    
+    {
+        // selection matches element of fully sorted selected non-NA values
+        
+        size_t numRows = 101;
+        
+        vector<Value> valuesColumn(numRows, gNaValue);
+        vector<bool> selected(numRows, false);
+        SelectIndexes selectRows(numRows, false);
+        for (size_t row = 0; row < numRows; row++) {
+            if (row % 7 != 0) {
+                valuesColumn[row].na = false;
+                valuesColumn[row].number.d = (double)((row * 53) % 17) - 8.0;
+            }
+            
+            selected[row] = row % 3 != 0;
+            if (selected[row]) {
+                selectRows.select(row);
+            }
+        }
+        
+        vector<double> expected;
+        for (size_t row = 0; row < numRows; row++) {
+            if (selected[row] && !valuesColumn[row].na) {
+                expected.push_back(valuesColumn[row].number.d);
+            }
+        }
+        
+        sort(expected.begin(), expected.end());
+        
+        bool ok = true;
+        
+        double fractions[] = { -1.0, 0.0, 0.1, 0.25, 0.5, 0.75, 0.999, 1.0, 2.0 };
+        for (size_t k = 0; k < sizeof(fractions) / sizeof(fractions[0]); k++) {
+            size_t index = (size_t)(max(0.0, fractions[k]) * expected.size());
+            index = min(index, expected.size() - 1);
+            
+            Value value = quantileValue(valuesColumn, selectRows, fractions[k]);
+            ok = ok && !value.na && value.number.d == expected[index];
+        }
+        
+        Value median = medianValue(valuesColumn, selectRows);
+        ok = ok && !median.na && median.number.d == expected[expected.size() / 2];
+        
+        ok = ok && medianValue(valuesColumn, SelectIndexes(numRows, false)).na;
+        
+        if (ok) {
+            passed++;
+        } else {
+            failed++;
+        }
+    }
+    
     // ~~~~~~~~~~~~~~~~~~~~~~
     // medianValue
     
     // ~~~~~~~~~~~~~~~~~~~~~~
     // modeValue
     
+    // ~~~~~~~~~~~~~~~~~~~~~~
+    // appendCategorySet
+    // isInCategorySet
+    
+    {
+        // sets of various sizes, including NA category, round-trip after earlier sets
+        
+        bool ok = true;
+        
+        vector<unsigned int> categorySets;
+        vector<size_t> starts;
+        vector< vector<index_t> > sets(4);
+        
+        sets[0].push_back(NO_INDEX);
+        sets[0].push_back(5);
+        
+        sets[1].push_back(31);
+        sets[1].push_back(30);
+        
+        sets[2].push_back(0);
+        sets[2].push_back(64);
+        sets[2].push_back(100);
+        
+        for (size_t k = 0; k < sets.size(); k++) {
+            starts.push_back(appendCategorySet(sets[k], categorySets));
+        }
+        
+        for (size_t k = 0; k < sets.size(); k++) {
+            const unsigned int *categorySet = &categorySets[starts[k]];
+            
+            for (index_t category = -3; category < 200; category++) {
+                bool expected = find(sets[k].begin(), sets[k].end(), category) != sets[k].end();
+                ok = ok && isInCategorySet(category, categorySet) == expected;
+            }
+        }
+        
+        if (ok) {
+            passed++;
+        } else {
+            failed++;
+        }
+    }
+    
+    // ~~~~~~~~~~~~~~~~~~~~~~
+    // categorySetToString
+    
+    // ~~~~~~~~~~~~~~~~~~~~~~
+    // numberForType
+    
+    {
+        // unused bytes are cleared, so copies of same category compare equal byte by byte
+        
+        Number number1;
+        Number number2;
+        memset(&number1, 0xff, sizeof(number1));
+        memset(&number2, 0x55, sizeof(number2));
+        number1.i = 7;
+        number2.i = 7;
+        
+        Number category1 = numberForType(number1, kCategorical);
+        Number category2 = numberForType(number2, kCategorical);
+        
+        number1.d = -2.5;
+        Number numeric1 = numberForType(number1, kNumeric);
+        
+        if (memcmp(&category1, &category2, sizeof(Number)) == 0 && category1.i == 7 &&
+            numeric1.d == -2.5) {
+            
+            passed++;
+            
+        } else {
+            failed++;
+        }
+    }
+    
+    // ~~~~~~~~~~~~~~~~~~~~~~
+    // foldRareCategories
+    
+    {
+        // most frequent kept in original order, tie goes to earlier name, others and unseen names
+        // go to otherCategory; NA and NA category unchanged
+        
+        CategoryMaps oneCategoryMap;
+        oneCategoryMap.setUseNaCategory(true);
+        oneCategoryMap.insertCategory("delta");
+        oneCategoryMap.insertCategory("charlie");
+        oneCategoryMap.insertCategory("bravo");
+        oneCategoryMap.insertCategory("alpha");
+        
+        // delta x1, charlie x2, bravo x3, alpha x2, NA category x1, NA x1
+        index_t indexes[] = { 0, 1, 1, 2, 2, 2, 3, 3, NO_INDEX, NO_INDEX };
+        vector<Value> valuesColumn;
+        for (size_t k = 0; k < 10; k++) {
+            Value value = { { 0.0 }, k == 9 };
+            value.number.i = indexes[k];
+            valuesColumn.push_back(value);
+        }
+        
+        foldRareCategories(3, valuesColumn, oneCategoryMap);
+        
+        // "bravo", then "alpha" beats "charlie" on name; kept in original order
+        index_t expected[] = { 2, 2, 2, 0, 0, 0, 1, 1, NO_INDEX, NO_INDEX };
+        
+        bool same = oneCategoryMap.countNamedCategories() == 3 &&
+                    oneCategoryMap.getUseNaCategory() &&
+                    oneCategoryMap.getCategoryForIndex(0) == "bravo" &&
+                    oneCategoryMap.getCategoryForIndex(1) == "alpha" &&
+                    oneCategoryMap.getCategoryForIndex(2) == CategoryMaps::otherCategory;
+        
+        for (size_t k = 0; k < 10; k++) {
+            same = same && valuesColumn[k].na == (k == 9);
+            if (k != 9) {
+                same = same && valuesColumn[k].number.i == expected[k];
+            }
+        }
+        
+        index_t index;
+        same = same && oneCategoryMap.findIndexOrOther("delta", index) && index == 2;
+        same = same && oneCategoryMap.findIndexOrOther("echo", index) && index == 2;
+        same = same && oneCategoryMap.findIndexOrOther("alpha", index) && index == 1;
+        
+        // no change if already few enough categories
+        foldRareCategories(3, valuesColumn, oneCategoryMap);
+        same = same && oneCategoryMap.countNamedCategories() == 3 && valuesColumn[0].number.i == 2;
+        
+        if (same) passed++; else failed++;
+    }
+    
     // ~~~~~~~~~~~~~~~~~~~~~~
     // printValuesColumn
     
@@ -1222,15 +2244,151 @@ void ctest_format(int& totalPassed, int& totalFailed, bool verbose)
     // ~~~~~~~~~~~~~~~~~~~~~~
     // imputeValues
     
+    {
+        // sorted indexes after imputing match full sort without NA; unselected NA rows stay NA
+        
+        size_t numRows = 300;
+        
+        vector< vector<Value> > values(2, vector<Value>(numRows, gNaValue));
+        vector<ValueType> valueTypes;
+        valueTypes.push_back(kNumeric);
+        valueTypes.push_back(kCategorical);
+        
+        vector<CategoryMaps> categoryMaps(2);
+        categoryMaps[1].insertCategory("A");
+        categoryMaps[1].insertCategory("B");
+        categoryMaps[1].insertCategory("C");
+        
+        for (size_t row = 0; row < numRows; row++) {
+            if (row % 5 != 0) {
+                values[0][row].na = false;
+                values[0][row].number.d = (double)((row * 37) % 11);
+                
+                values[1][row].na = false;
+                values[1][row].number.i = (index_t)((row * 7) % 3);
+            }
+        }
+        
+        SelectIndexes selectRows(numRows, true);
+        for (size_t row = 0; row < numRows; row += 15) {
+            selectRows.unselect(row);
+        }
+        
+        SelectIndexes selectCols(values.size(), true);
+        vector< vector<size_t> > sortedIndexes;
+        makeSortedIndexes(values, valueTypes, selectCols, sortedIndexes, 1);
+        
+        vector<ImputeOption> imputeOptions;
+        imputeOptions.push_back(kToMedian);
+        imputeOptions.push_back(kToMode);
+        
+        vector<Value> imputedValues;
+        imputeValues(imputeOptions, valueTypes, values, selectRows, selectCols, categoryMaps,
+                     sortedIndexes, imputedValues);
+        
+        bool same = true;
+        for (size_t col = 0; col < values.size(); col++) {
+            vector<size_t> expected;
+            SortValueVector sortValueVector(values[col], valueTypes[col]);
+            sortValueVector.sort(expected);
+            
+            // NA sorts to beginning
+            expected.erase(expected.begin(), expected.begin() + (ptrdiff_t)(numRows / 15));
+            
+            same = same && expected == sortedIndexes[col] && values[col][0].na &&
+                   !values[col][5].na;
+        }
+        
+        if (same) passed++; else failed++;
+    }
+    
     // ~~~~~~~~~~~~~~~~~~~~~~
     // cellsToValues
     
+    {
+        // with constCategories, unknown category goes to otherCategory if present, else NA
+        
+        vector< vector<string> > cells(2, vector<string>(2, "zulu"));
+        cells[0][0] = "alpha";
+        cells[0][1] = "alpha";
+        vector< vector<bool> > quoted(2, vector<bool>(2, false));
+        vector<ValueType> valueTypes(2, kCategorical);
+        
+        vector<CategoryMaps> categoryMaps(2);
+        categoryMaps[0].insertCategory("alpha");
+        categoryMaps[1].insertCategory("alpha");
+        categoryMaps[1].insertCategory(CategoryMaps::otherCategory);
+        
+        vector< vector<Value> > values;
+        cellsToValues(cells, quoted, valueTypes, true, "NA", values, true, categoryMaps);
+        
+        bool same = !values[0][0].na && values[0][0].number.i == 0 && values[0][1].na &&
+                    !values[1][0].na && values[1][0].number.i == 0 &&
+                    !values[1][1].na && values[1][1].number.i == 1 &&
+                    categoryMaps[0].countNamedCategories() == 1;
+        
+        if (same) passed++; else failed++;
+    }
+    
     // ~~~~~~~~~~~~~~~~~~~~~~
     // valuesToCells
     
     // ~~~~~~~~~~~~~~~~~~~~~~
     // makeSortedIndexes
     
+    {
+        // radix and counting sorts match comparison sort with NA left out, including ties, -0.0,
+        // NO_INDEX and sparse category indexes
+        
+        size_t numRows = 500;
+        
+        vector< vector<Value> > values(4, vector<Value>(numRows, gNaValue));
+        vector<ValueType> valueTypes;
+        valueTypes.push_back(kNumeric);
+        valueTypes.push_back(kNumeric);
+        valueTypes.push_back(kCategorical);
+        valueTypes.push_back(kCategorical);
+        
+        for (size_t row = 0; row < numRows; row++) {
+            if (row % 13 != 0) {
+                values[0][row].na = false;
+                values[0][row].number.d = ((double)((row * 7919) % 101) - 50.0) / 4.0;
+                
+                values[2][row].na = false;
+                values[2][row].number.i = (index_t)((row * 31) % 9) - 1;
+                
+                values[3][row].na = false;
+                values[3][row].number.i = (index_t)((row * 7919) % 37) * 100000;
+            }
+            
+            values[1][row].na = false;
+            values[1][row].number.d = row % 2 == 0 ? 0.0 : -0.0;
+        }
+        
+        SelectIndexes selectCols(values.size(), true);
+        vector< vector<size_t> > sortedIndexes;
+        makeSortedIndexes(values, valueTypes, selectCols, sortedIndexes, 2);
+        
+        bool same = true;
+        for (size_t col = 0; col < values.size(); col++) {
+            vector<size_t> expected;
+            SortValueVector sortValueVector(values[col], valueTypes[col]);
+            sortValueVector.sort(expected);
+            
+            // NA sorts to beginning
+            size_t naCount = 0;
+            while (naCount < expected.size() && values[col][expected[naCount]].na) {
+                naCount++;
+            }
+            
+            expected.erase(expected.begin(), expected.begin() + (ptrdiff_t)naCount);
+            
+            same = same && expected == sortedIndexes[col];
+        }
+        
+        if (same) passed++; else failed++;
+    }
+    
     // ~~~~~~~~~~~~~~~~~~~~~~
     // getDefaultValueTypes
     
@@ -1243,9 +2401,43 @@ void ctest_format(int& totalPassed, int& totalFailed, bool verbose)
     // ~~~~~~~~~~~~~~~~~~~~~~
     // getDefaultImputeOption
 
+    // ~~~~~~~~~~~~~~~~~~~~~~
+    // isBranchImputeOption
+    
     // ~~~~~~~~~~~~~~~~~~~~~~
     // stringToImputeOption
     
+    {
+        // names of branch options round-trip, and are not mistaken for other options
+        
+        ImputeOption categoricalOptions[] = { kToCategory, kToMode, kToBranchMode,
+            kToLearnedBranch };
+        ImputeOption numericOptions[] = { kToMean, kToMedian, kToBranchMean, kToBranchMedian,
+            kToLearnedBranch };
+        
+        bool ok = true;
+        
+        for (size_t k = 0; k < sizeof(categoricalOptions) / sizeof(categoricalOptions[0]); k++) {
+            string str;
+            imputeOptionToString(categoricalOptions[k], str);
+            ok = ok && stringToImputeOption(str, kCategorical) == categoricalOptions[k];
+            ok = ok && isBranchImputeOption(categoricalOptions[k]) == (k >= 2);
+        }
+        
+        for (size_t k = 0; k < sizeof(numericOptions) / sizeof(numericOptions[0]); k++) {
+            string str;
+            imputeOptionToString(numericOptions[k], str);
+            ok = ok && stringToImputeOption(str, kNumeric) == numericOptions[k];
+            ok = ok && isBranchImputeOption(numericOptions[k]) == (k >= 2);
+        }
+        
+        if (ok) {
+            passed++;
+        } else {
+            failed++;
+        }
+    }
+    
     // ~~~~~~~~~~~~~~~~~~~~~~
     // imputeOptionToString
     
@@ -1366,6 +2558,20 @@ void cover_format(bool verbose)
         oneCategoryMap.setUseNaCategory(true);
         oneCategoryMap.findCategoryForIndex(NO_INDEX, category);
         
+        oneCategoryMap.findIndexOrOther("charlie", index);
+    }
+
+    // ~~~~~~~~~~~~~~~~~~~~~~
+    // CategorySlots
+    
+    {
+        CategorySlots categorySlots;
+        categorySlots.clear(1);
+        categorySlots.findOrInsert(NO_INDEX);
+        categorySlots.findOrInsert(5);
+        categorySlots.findOrInsert(NO_INDEX);
+        categorySlots.size();
+        categorySlots.categoryVector();
     }
 
     // ~~~~~~~~~~~~~~~~~~~~~~
@@ -1433,10 +2639,10 @@ void cover_format(bool verbose)
     // medianValue
     
     selectCols.selectAll(values.size());
-    makeSortedIndexes(values, valueTypes, selectCols, sortedIndexes);
-    medianValue(values[0], selectRows, sortedIndexes[0]);
+    makeSortedIndexes(values, valueTypes, selectCols, sortedIndexes, 0);
+    medianValue(values[0], selectRows);
     
-    medianValue(vector<Value>(0), SelectIndexes(0, false), vector<size_t>(0));
+    medianValue(vector<Value>(0), SelectIndexes(0, false));
 
     // ~~~~~~~~~~~~~~~~~~~~~~
     // modeValue
@@ -1457,6 +2663,43 @@ void cover_format(bool verbose)
     
     modeValue(vector<Value>(0), SelectIndexes(0, false), CategoryMaps());
     
+    // ~~~~~~~~~~~~~~~~~~~~~~
+    // appendCategorySet
+    // categorySetToString
+    
+    {
+        vector<index_t> categories;
+        categories.push_back(0);
+        categories.push_back(2);
+        
+        vector<unsigned int> categorySets;
+        size_t start = appendCategorySet(categories, categorySets);
+        
+        string str = categorySetToString(&categorySets[start], categoryMaps1);
+        
+        if (verbose) {
+            CERR << str << endl;
+        }
+    }
+    
+    // ~~~~~~~~~~~~~~~~~~~~~~
+    // numberForType
+    
+    numberForType(values[1][0].number, kCategorical);
+    
+    // ~~~~~~~~~~~~~~~~~~~~~~
+    // foldRareCategories
+    
+    {
+        vector<Value> valuesColumn = values[1];
+        CategoryMaps foldedMaps = categoryMaps1;
+        foldRareCategories(2, valuesColumn, foldedMaps);
+        
+        if (verbose) {
+            foldedMaps.dump();
+        }
+    }
+    
     // ~~~~~~~~~~~~~~~~~~~~~~
     // printValuesColumn
     
@@ -1488,27 +2731,27 @@ void cover_format(bool verbose)
     convertTypes.push_back(kNoImpute);
     
     try {
-        imputedValue(0, convertTypes, values, valueTypes, selectRows, categoryMaps, sortedIndexes);        
+        imputedValue(0, convertTypes, values, valueTypes, selectRows, categoryMaps);        
     } catch(...) { }
     
-    imputedValue(1, convertTypes, values, valueTypes, selectRows, categoryMaps, sortedIndexes);
-    imputedValue(2, convertTypes, values, valueTypes, selectRows, categoryMaps, sortedIndexes);
+    imputedValue(1, convertTypes, values, valueTypes, selectRows, categoryMaps);
+    imputedValue(2, convertTypes, values, valueTypes, selectRows, categoryMaps);
     
     convertTypes.clear();
     convertTypes.push_back(kToMean);
     convertTypes.push_back(kToCategory);
     convertTypes.push_back(kToMode);
     
-    imputedValue(0, convertTypes, values, valueTypes, selectRows, categoryMaps, sortedIndexes);
-    imputedValue(1, convertTypes, values, valueTypes, selectRows, categoryMaps, sortedIndexes);
-    imputedValue(2, convertTypes, values, valueTypes, selectRows, categoryMaps, sortedIndexes);
+    imputedValue(0, convertTypes, values, valueTypes, selectRows, categoryMaps);
+    imputedValue(1, convertTypes, values, valueTypes, selectRows, categoryMaps);
+    imputedValue(2, convertTypes, values, valueTypes, selectRows, categoryMaps);
     
     convertTypes.clear();
     convertTypes.push_back(kToMedian);
     convertTypes.push_back(kToCategory);
     convertTypes.push_back(kNoImpute);
     
-    imputedValue(0, convertTypes, values, valueTypes, selectRows, categoryMaps, sortedIndexes);
+    imputedValue(0, convertTypes, values, valueTypes, selectRows, categoryMaps);
 
     // ~~~~~~~~~~~~~~~~~~~~~~
     // imputeValues
@@ -1551,7 +2794,7 @@ void cover_format(bool verbose)
     selectCols.selectAll(3);
     selectCols.unselect(2);
     
-    makeSortedIndexes(values, valueTypes, selectCols, sortedIndexes);
+    makeSortedIndexes(values, valueTypes, selectCols, sortedIndexes, 0);
 
     // ~~~~~~~~~~~~~~~~~~~~~~
     // getDefaultValueTypes
@@ -1627,6 +2870,12 @@ void cover_format(bool verbose)
         imputeOptionToString(kToMode, str);
         stringToImputeOption(str, kCategorical);
         
+        imputeOptionToString(kToBranchMode, str);
+        stringToImputeOption(str, kCategorical);
+        
+        imputeOptionToString(kToLearnedBranch, str);
+        stringToImputeOption(str, kCategorical);
+        
         imputeOptionToString(kToDefault, str);
         stringToImputeOption(str, kCategorical);
         
@@ -1641,6 +2890,15 @@ void cover_format(bool verbose)
         imputeOptionToString(kToMedian, str);
         stringToImputeOption(str, kNumeric);
         
+        imputeOptionToString(kToBranchMean, str);
+        stringToImputeOption(str, kNumeric);
+        
+        imputeOptionToString(kToBranchMedian, str);
+        stringToImputeOption(str, kNumeric);
+        
+        imputeOptionToString(kToLearnedBranch, str);
+        stringToImputeOption(str, kNumeric);
+        
         imputeOptionToString(kToDefault, str);
         stringToImputeOption(str, kNumeric);
     }
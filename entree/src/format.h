@@ -58,22 +58,25 @@ enum ImputeOption {
     // for categorical types
     kToCategory,
     kToMode,
+    kToBranchMode,      // mode of rows at each node of tree
     
     // for numerical types
     kToMean,
     kToMedian,
+    kToBranchMean,      // mean of rows at each node of tree
+    kToBranchMedian,    // median of rows at each node of tree
+    
+    // for both types
+    kToLearnedBranch,   // branch that best improves split at each node of tree
     
     kToDefault
 };
 
 // TODO more imputeOptions:
 //    kToFlagAndMode,
-//    kToBranchMode,
 //    kToFlagAndBranchMode,
 //    kToFlagAndMean,
 //    kToFlagAndMedian,
-//    kToBranchMean,
-//    kToBranchMedian,
 //    kToFlagAndBranchMean,
 //    kToFlagAndBranchMedian,
 
@@ -84,6 +87,9 @@ enum ImputeOption {
 class CategoryMaps {
 public:
     static const std::string naCategory;
+    
+    // name of category that stands for all categories folded by foldRareCategories
+    static const std::string otherCategory;
 
     CategoryMaps();
     virtual ~CategoryMaps();
@@ -101,6 +107,10 @@ public:
     // look for category; if found, write index into param and return true, else write NO_INDEX into
     // param and return false
     bool findIndexForCategory(const std::string& category, index_t& index) const;
+    
+    // look for category, or for otherCategory if category is missing; if either is found, write
+    // index into param and return true, else write NO_INDEX into param and return false
+    bool findIndexOrOther(const std::string& category, index_t& index) const;
 
     // look for index; if found, write category into param and return true, else write " <NA> " into
     // param and return false
@@ -124,6 +134,13 @@ public:
     // return count of all categories, including NA category if used
     size_t countAllCategories() const;
     
+    // write rank of each category name in alphabetical order into ranks, indexed by category index
+    // minus beginIndex(); for comparing names without string compares
+    void rankCategories(std::vector<size_t>& ranks) const;
+    
+    // prepare to hold at least count named categories without growing hash table
+    void reserve(size_t count);
+    
     // clear all named categories
     void clear();
     
@@ -134,10 +151,62 @@ private:
     // if true, treat NA values as a separate category with index NO_INDEX
     bool useNaCategory;
 
-    // map in both directions
-    std::vector<std::string> categories;
-    std::map<std::string, index_t> categoryToIndex;
+    // category names are stored one after another in nameChars; name for index k runs from
+    // nameStarts[k] to nameStarts[k + 1]
+    std::vector<char> nameChars;
+    std::vector<size_t> nameStarts;
+    std::vector<size_t> nameHashes;
+    
+    // open-addressing hash table of category indexes, NO_INDEX if empty; size is a power of 2
+    std::vector<index_t> slots;
+    
+    // return hash of name
+    static size_t hashName(const char *chars, size_t length);
+    
+    // return slot holding index for name, or empty slot where it would go; hash table must not be
+    // empty
+    size_t findSlot(const char *chars, size_t length, size_t hash) const;
+    
+    // add category, which must not be present; return index
+    index_t appendCategory(const std::string& category, size_t hash);
     
+    // resize hash table to have room for at least count categories
+    void rehash(size_t count);
+};
+
+// -------------------------------------------------------------------------------------------------
+
+// assigns consecutive slot numbers to the categories seen in the rows at a tree node, so that
+// per-category statistics take space and time in proportion to count of rows, not count of
+// categories in column
+class CategorySlots {
+public:
+    CategorySlots();
+    virtual ~CategorySlots();
+    
+    // forget all categories; prepare to hold up to count categories without growing hash table
+    void clear(size_t count);
+    
+    // return slot for category, assigning next slot number if category has not been seen
+    size_t findOrInsert(index_t category);
+    
+    // return count of categories seen
+    size_t size() const { return categories.size(); };
+    
+    // return vector of categories seen, indexed by slot
+    const std::vector<index_t>& categoryVector() const { return categories; };
+    
+private:
+    std::vector<index_t> categories;
+    
+    // open-addressing hash table of slot + 1, 0 if empty; size is a power of 2
+    std::vector<size_t> table;
+    
+    // return hash table position holding slot for category, or empty position where it would go
+    size_t findPosition(index_t category) const;
+    
+    // resize hash table to have room for at least count categories
+    void rehash(size_t count);
 };
 
 // -------------------------------------------------------------------------------------------------
@@ -170,6 +239,9 @@ public:
     // unselect specified index; must be in existing size range 
     void unselect(size_t index);
     
+    // exchange contents with other without copying lists
+    void swap(SelectIndexes& other);
+    
     // for debugging; print state
     void dump() const;
     
@@ -219,11 +291,15 @@ private:
 // calculate mean of selected rows in a vector of numerical Values
 Value meanValue(const std::vector<Value>& valuesColumn, const SelectIndexes& selectRows);
 
-// calculate median of selected rows in a vector of numerical Values; must supply vector of sorted
-// indexes that at least includes all of the selected rows
-Value medianValue(const std::vector<Value>& valuesColumn,
-                  const SelectIndexes& selectRows,
-                  const std::vector<size_t>& sortedIndexes);
+// calculate quantile of selected rows in a vector of numerical Values, ignoring NA; fraction from 0
+// to 1 picks value at index (size_t)(fraction * count) of values in sorted order; uses selection
+// instead of sorting, so takes time proportional to count of selected rows
+Value quantileValue(const std::vector<Value>& valuesColumn,
+                    const SelectIndexes& selectRows,
+                    double fraction);
+
+// calculate median of selected rows in a vector of numerical Values
+Value medianValue(const std::vector<Value>& valuesColumn, const SelectIndexes& selectRows);
 
 // select modal value of selected rows in a vector of categorical Values; in case of tie, choose
 // category with name that sorts earlier alphabetically; NA category (if used) has name " <NA> "
@@ -231,6 +307,30 @@ Value modeValue(const std::vector<Value>& valuesColumn,
                 const SelectIndexes& selectRows,
                 const CategoryMaps& categoryMaps);
 
+// append set of specified categories to categorySets; return index of first word of set; set is
+// stored as count of following words, then bitset in which bit k is set if category with index
+// k - 1 is in set, so that NA category (index NO_INDEX) is bit 0
+size_t appendCategorySet(const std::vector<index_t>& categories,
+                         std::vector<unsigned int>& categorySets);
+
+// return true if category is in set stored by appendCategorySet beginning at categorySet
+bool isInCategorySet(index_t category, const unsigned int *categorySet);
+
+// for debugging or logging; return names of categories in set stored by appendCategorySet
+// beginning at categorySet
+std::string categorySetToString(const unsigned int *categorySet, const CategoryMaps& categoryMaps);
+
+// return copy of number with only the field used for valueType set and other bytes zero, so that
+// equal values have equal bytes
+Number numberForType(Number number, ValueType valueType);
+
+// if column has more than maxCategories categories, keep the maxCategories - 1 most frequent (ties
+// go to name that sorts earlier alphabetically) and fold the others into otherCategory; categories
+// are renumbered, and values are changed to match
+void foldRareCategories(size_t maxCategories,
+                        std::vector<Value>& valuesColumn,
+                        CategoryMaps& categoryMaps);
+
 // for debugging or logging; print vector of Value
 void printValuesColumn(const std::vector<Value>& valuesColumn,
                        ValueType valueType,
@@ -249,10 +349,10 @@ Value imputedValue(size_t col,
                    const std::vector< std::vector<Value> >& values,
                    const std::vector<ValueType>& valueTypes,
                    const SelectIndexes& selectRows,
-                   const std::vector<CategoryMaps>& categoryMaps,
-                   const std::vector< std::vector<size_t> >& sortedIndexes);
+                   const std::vector<CategoryMaps>& categoryMaps);
 
-// replace NA values in selected columns and rows in array of Values
+// replace NA values in selected columns and rows in array of Values; columns with branch
+// ImputeOptions are left unchanged, to be imputed separately at each node during training
 void imputeValues(const std::vector<ImputeOption>& convertTypes,
                   const std::vector<ValueType>& valueTypes,
                   std::vector< std::vector<Value> >& values,
@@ -281,11 +381,14 @@ void valuesToCells(const std::vector< std::vector<Value> >& values,
                    std::vector< std::vector<std::string> >& cells,
                    std::vector< std::vector<bool> >& quoted);
 
-// create vector of sorted indexes for each selected column in array of Values
+// create vector of sorted indexes for each selected column in array of Values; rows with NA are
+// left out, so split scans skip them, though columns of Values still hold every row; columns are
+// sorted on up to numThreads threads, or one per processor if numThreads is 0
 void makeSortedIndexes(const std::vector< std::vector<Value> >& values,
                        const std::vector<ValueType> valueTypes,
                        const SelectIndexes& selectColumns,
-                       std::vector< std::vector<size_t> >& sortedIndexes);
+                       std::vector< std::vector<size_t> >& sortedIndexes,
+                       size_t numThreads);
 
 // get default value types (assume numeric unless cells contain other than digits or period)
 void getDefaultValueTypes(const std::vector< std::vector<std::string> >& cells,
@@ -303,6 +406,9 @@ void valueTypeToString(ValueType valueType, std::string& str);
 // get default ImputeOption
 ImputeOption getDefaultImputeOption(ValueType valueType);
 
+// return true if ImputeOption handles NA separately at each node of tree instead of once for column
+bool isBranchImputeOption(ImputeOption imputeOption);
+
 // get ImputeOption for name
 ImputeOption stringToImputeOption(std::string str, ValueType valueType);
 
@@ -17,11 +17,76 @@
 
 #include "train.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
 #include <iomanip>
 #include <iostream>
+#include <limits>
+#include <map>
+
+// lockstep traversal kernels use gather instructions, selected at run time if CPU supports them;
+// not used on Windows because some compilers there don't align stack for 256-bit vectors
+#if defined __GNUC__ && defined __x86_64__ && !(defined _WIN32 || defined _WIN64)
+#define LOCKSTEP_X86 1
+#include <immintrin.h>
+#else
+#define LOCKSTEP_X86 0
+#endif
 
 using namespace std;
 
+// ========== Local Types ==========================================================================
+
+// flattened copy of CompactTree for traversing several rows in lockstep; all fields are 64 bits so
+// they can be loaded with gather instructions; rows stop at leaves and at splits on sets of
+// categories, which kernels can't test, so that those rows can be finished one by one
+struct LockstepTree {
+    std::vector<long long> address;         // address of first Value of split column
+    std::vector<long long> lessOrEqual;     // NO_INDEX if leaf or split on set of categories
+    std::vector<long long> greaterOrNot;    // NO_INDEX if leaf
+    std::vector<long long> flags;           // kLockstepCategorical, kLockstepNaToLessOrEqual
+    std::vector<Number> value;
+};
+typedef struct LockstepTree LockstepTree;
+
+// comparison operator for finding identical nodes in Predictor, so that they are stored once;
+// nodes have value from numberForType() and child indexes into Predictor node list
+struct PredictorNodeLess {
+    bool operator ()(const PredictorNode& node1, const PredictorNode& node2) const {
+        bool result;
+        
+        if (node1.col != node2.col) {
+            result = node1.col < node2.col;
+            
+        } else if (node1.lessOrEqualIndex != node2.lessOrEqualIndex) {
+            result = node1.lessOrEqualIndex < node2.lessOrEqualIndex;
+            
+        } else if (node1.greaterOrNotIndex != node2.greaterOrNotIndex) {
+            result = node1.greaterOrNotIndex < node2.greaterOrNotIndex;
+            
+        } else if (node1.categorical != node2.categorical) {
+            result = node1.categorical < node2.categorical;
+            
+        } else if (node1.toLessOrEqualIfNA != node2.toLessOrEqualIfNA) {
+            result = node1.toLessOrEqualIfNA < node2.toLessOrEqualIfNA;
+            
+        } else if (node1.categorySet != node2.categorySet) {
+            result = node1.categorySet < node2.categorySet;
+            
+        } else {
+            result = memcmp(&node1.value, &node2.value, sizeof(Number)) < 0;
+        }
+        
+        return result;
+    }
+};
+typedef struct PredictorNodeLess PredictorNodeLess;
+
+const long long kLockstepCategorical = 1;
+const long long kLockstepNaToLessOrEqual = 2;
+
 // ========== Local Headers ========================================================================
 
 // predict response from one decision tree
@@ -35,6 +100,307 @@ void predictOne(const vector< vector<Value> >& values,
                 vector<Value>& predictVector,
                 const std::vector<std::string>& colNames);
 
+// return true if compareValue goes to lessOrEqual branch of split node of tree; valueType is type
+// of split column
+bool isLessOrEqualBranch(const CompactTree& tree,
+                         size_t nodeIndex,
+                         const Value& compareValue,
+                         ValueType valueType);
+
+// for selectTrees; return category predicted for row after adding vote, given category predicted
+// before (NO_INDEX if none) and count of votes so far for each category; ties go to category with
+// name that sorts earlier, as in predict()
+index_t categoryAfterVote(index_t vote,
+                          index_t category,
+                          const index_t *rowVotes,
+                          index_t beginCategoryIndex,
+                          const vector<size_t>& categoryRanks);
+
+// for early exit from voting; update leading category and count of votes for runner-up after vote
+// for category at countsIndex has been added to counts; leader is categoryRanks.size() before first
+// vote; ties go to category with name that sorts earlier, as in predict()
+void updateVoteLeader(size_t countsIndex,
+                      const index_t *counts,
+                      const vector<size_t>& categoryRanks,
+                      size_t& leader,
+                      index_t& runnerUpCount);
+
+// return average count of split nodes visited in predicting selected rows from one decision tree
+double averageSplitsVisited(const vector< vector<Value> >& values,
+                            const std::vector<ValueType>& valueTypes,
+                            const SelectIndexes& selectRows,
+                            const SelectIndexes& selectColumns,
+                            const CompactTree& tree);
+
+// return count of split nodes visited in predicting one row from one decision tree
+size_t countSplitsVisited(const vector< vector<Value> >& values,
+                          const std::vector<ValueType>& valueTypes,
+                          const vector<size_t>& selectColumnIndexes,
+                          const CompactTree& tree,
+                          size_t row);
+
+// return index of leaf reached by row of values from nodeIndex of decision tree; add count of
+// split nodes visited to splitCount
+size_t walkToLeaf(const vector< vector<Value> >& values,
+                  const std::vector<ValueType>& valueTypes,
+                  const vector<size_t>& selectColumnIndexes,
+                  const CompactTree& tree,
+                  size_t row,
+                  size_t nodeIndex,
+                  size_t& splitCount);
+
+// number of rows per block for lockstep traversal on this CPU, or zero if not supported
+size_t lockstepBlockSize();
+
+// make flattened copy of tree for lockstep traversal
+void makeLockstepTree(const vector< vector<Value> >& values,
+                      const std::vector<ValueType>& valueTypes,
+                      const SelectIndexes& selectColumns,
+                      const CompactTree& tree,
+                      LockstepTree& lockstepTree);
+
+#if LOCKSTEP_X86
+// traverse one decision tree for 8 rows in lockstep, using AVX2; write index of node at which
+// each row stopped to nodes
+void traverseLockstepAvx2(const LockstepTree& lockstepTree,
+                          const size_t* rows,
+                          long long *nodes);
+
+// traverse one decision tree for 16 rows in lockstep, using AVX-512; write index of node at which
+// each row stopped to nodes
+void traverseLockstepAvx512(const LockstepTree& lockstepTree,
+                            const size_t* rows,
+                            long long *nodes);
+#endif
+
+// ========== Classes ==============================================================================
+
+// predicts response for single rows or small batches of rows given as arrays of doubles; prepared
+// once from ensemble of decision trees so that each call makes no heap allocations; not
+// thread-safe, so use one Predictor per thread
+
+// construct from trained model
+Predictor::Predictor(const std::vector<ValueType>& valueTypes,
+                     const std::vector<CategoryMaps>& categoryMaps,
+                     size_t targetColumn,
+                     const SelectIndexes& selectColumns,
+                     const std::vector<CompactTree>& trees) :
+numColumns(valueTypes.size()),
+targetType(valueTypes.at(targetColumn)),
+beginCategoryIndex(0),
+treesEvaluated(0)
+{
+    LOGIC_ERROR_IF(categoryMaps.size() != numColumns, "categoryMaps vs. valueTypes size mismatch");
+    LOGIC_ERROR_IF(selectColumns.boolVector().size() != numColumns,
+                   "selectColumns vs. valueTypes size mismatch");
+    
+    const vector<size_t>& selectColumnIndexes = selectColumns.indexVector();
+    
+    // copy trees into single node list; identical subtrees, in same tree or different trees, are
+    // stored once, and splits whose two branches are identical are left out
+    
+    map<PredictorNode, size_t, PredictorNodeLess> nodeIndexes;
+    map<vector<unsigned int>, index_t> categorySetIndexes;
+    
+    for (size_t treeIndex = 0; treeIndex < trees.size(); treeIndex++) {
+        const CompactTree& tree = trees[treeIndex];
+        
+        // visit nodes from last to first, so that branches are visited before the node that splits
+        // into them; newIndex has index in node list for each node of tree
+        vector<size_t> newIndex(tree.value.size(), 0);
+        
+        for (size_t count = tree.value.size(); count > 0; count--) {
+            size_t nodeIndex = count - 1;
+            
+            PredictorNode node;
+            node.col = 0;
+            node.lessOrEqualIndex = NO_INDEX;
+            node.greaterOrNotIndex = NO_INDEX;
+            node.categorical = false;
+            node.toLessOrEqualIfNA = false;
+            node.value = numberForType(tree.value[nodeIndex], targetType);
+            node.categorySet = NO_INDEX;
+            
+            if (tree.lessOrEqualIndex[nodeIndex] != NO_INDEX) {
+                index_t splitColIndex = tree.splitColIndex[nodeIndex];
+                LOGIC_ERROR_IF(splitColIndex < 0 ||
+                               (size_t)splitColIndex >= selectColumnIndexes.size(), "out of range");
+                
+                node.col = selectColumnIndexes[(size_t)splitColIndex];
+                node.lessOrEqualIndex =
+                    (index_t)newIndex.at((size_t)tree.lessOrEqualIndex[nodeIndex]);
+                node.greaterOrNotIndex =
+                    (index_t)newIndex.at((size_t)tree.greaterOrNotIndex[nodeIndex]);
+                node.categorical = valueTypes.at(node.col) == kCategorical;
+                node.toLessOrEqualIfNA = tree.toLessOrEqualIfNA[nodeIndex];
+                node.value = numberForType(tree.value[nodeIndex], valueTypes.at(node.col));
+                
+                index_t setIndex = tree.categorySetIndex[nodeIndex];
+                if (setIndex != NO_INDEX) {
+                    // store each distinct set once
+                    const unsigned int *setP = &tree.categorySets.at((size_t)setIndex);
+                    vector<unsigned int> categorySet(setP, setP + 1 + setP[0]);
+                    
+                    map<vector<unsigned int>, index_t>::iterator iter =
+                        categorySetIndexes.find(categorySet);
+                    
+                    if (iter == categorySetIndexes.end()) {
+                        node.categorySet = (index_t)categorySets.size();
+                        categorySetIndexes[categorySet] = node.categorySet;
+                        categorySets.insert(categorySets.end(), categorySet.begin(),
+                                            categorySet.end());
+                        
+                    } else {
+                        node.categorySet = iter->second;
+                    }
+                }
+            }
+            
+            if (node.lessOrEqualIndex != NO_INDEX &&
+                node.lessOrEqualIndex == node.greaterOrNotIndex) {
+                // both branches give same result, so split is not needed
+                newIndex[nodeIndex] = (size_t)node.lessOrEqualIndex;
+                
+            } else {
+                map<PredictorNode, size_t, PredictorNodeLess>::iterator iter =
+                    nodeIndexes.find(node);
+                
+                if (iter == nodeIndexes.end()) {
+                    newIndex[nodeIndex] = nodes.size();
+                    nodeIndexes[node] = nodes.size();
+                    nodes.push_back(node);
+                    
+                } else {
+                    newIndex[nodeIndex] = iter->second;
+                }
+            }
+        }
+        
+        roots.push_back(newIndex.at(0));
+    }
+    
+    if (targetType == kCategorical) {
+        // rank categories by name, to enforce deterministic result w/o regard to order of categories
+        
+        beginCategoryIndex = categoryMaps[targetColumn].beginIndex();
+        categoryMaps[targetColumn].rankCategories(categoryRanks);
+        counts.assign(categoryRanks.size(), 0);
+    }
+}
+
+Predictor::~Predictor()
+{
+}
+
+// predict response for one row; row has entry for each column, containing numeric value or
+// category index, or NaN for NA; return numeric value or category index, or NaN if no trees
+double Predictor::predictRow(const double* row)
+{
+    double result = 0.0;
+    
+    if (targetType == kCategorical) {
+        fill(counts.begin(), counts.end(), 0);
+    }
+    
+    // for categorical target, stop when votes of remaining trees cannot change leader
+    size_t leader = categoryRanks.size();
+    index_t runnerUpCount = 0;
+    bool decided = false;
+    
+    for (size_t treeIndex = 0; treeIndex < roots.size() && !decided; treeIndex++) {
+        size_t nodeIndex = roots[treeIndex];
+        treesEvaluated++;
+        
+        while (nodes[nodeIndex].lessOrEqualIndex != NO_INDEX) {
+            // keep looping until reach leaf
+            
+            const PredictorNode& node = nodes[nodeIndex];
+            double compareValue = row[node.col];
+            
+            bool useLessOrEqual;
+            
+            if (isnan(compareValue)) {
+                useLessOrEqual = node.toLessOrEqualIfNA;
+                
+            } else if (node.categorical && node.categorySet != NO_INDEX) {
+                useLessOrEqual = isInCategorySet((index_t)compareValue,
+                                                 &categorySets[(size_t)node.categorySet]);
+                
+            } else if (node.categorical) {
+                useLessOrEqual = (index_t)compareValue == node.value.i;
+                
+            } else {
+                useLessOrEqual = compareValue <= node.value.d;
+            }
+            
+            nodeIndex = useLessOrEqual ?
+                (size_t)node.lessOrEqualIndex :
+                (size_t)node.greaterOrNotIndex;
+        }
+        
+        switch (targetType) {
+            case kCategorical:
+            {
+                size_t countsIndex = (size_t)(nodes[nodeIndex].value.i - beginCategoryIndex);
+                counts[countsIndex]++;
+                
+                updateVoteLeader(countsIndex, &counts[0], categoryRanks, leader, runnerUpCount);
+                
+                index_t remaining = (index_t)(roots.size() - treeIndex - 1);
+                decided = counts[leader] > runnerUpCount + remaining;
+            }
+                break;
+                
+            case kNumeric:
+                result += nodes[nodeIndex].value.d;
+                break;
+        }
+    }
+    
+    switch (targetType) {
+        case kCategorical:
+        {
+            // find most frequently predicted category; same counts use name as tie breaker
+            
+            size_t best = 0;
+            index_t maxCount = 0;
+            for (size_t countsIndex = 0; countsIndex < counts.size(); countsIndex++) {
+                index_t nextCount = counts[countsIndex];
+                
+                if (maxCount < nextCount ||
+                    (nextCount > 0 && maxCount == nextCount &&
+                     categoryRanks[countsIndex] < categoryRanks[best])) {
+                    
+                    best = countsIndex;
+                    maxCount = nextCount;
+                }
+            }
+            
+            if (maxCount > 0) {
+                result = (double)((index_t)best + beginCategoryIndex);
+                
+            } else {
+                result = numeric_limits<double>::quiet_NaN();
+            }
+        }
+            break;
+            
+        case kNumeric:
+            result /= roots.size();
+            break;
+    }
+    
+    return result;
+}
+
+// predict responses for rows stored one after another; write response for each row to results
+void Predictor::predictRows(const double* rows, size_t numRows, double* results)
+{
+    for (size_t row = 0; row < numRows; row++) {
+        results[row] = predictRow(rows + row * numColumns);
+    }
+}
+
 // ========== Functions ============================================================================
 
 // predict response from ensemble of decision trees and array of Values
@@ -56,9 +422,6 @@ void predict(std::vector< std::vector<Value> >& values,
     LOGIC_ERROR_IF(values.size() != selectColumns.boolVector().size(),
                    "values vs. selectColumns size mismatch");
     
-    vector< vector<size_t> > sortedIndexes;
-    makeSortedIndexes(values, valueTypes, selectColumns, sortedIndexes);
-    
     const vector<size_t>& selectRowIndexes = selectRows.indexVector();
 
     switch (valueTypes.at(targetColumn)) {
@@ -71,6 +434,10 @@ void predict(std::vector< std::vector<Value> >& values,
             index_t beginCategoryIndex = categoryMaps.at(targetColumn).beginIndex();
             index_t endCategoryIndex = categoryMaps.at(targetColumn).endIndex();
             
+            // rank of each category name, for breaking ties
+            vector<size_t> categoryRanks;
+            categoryMaps.at(targetColumn).rankCategories(categoryRanks);
+            
             // count number of times each category is predicted for each row
             
             vector< vector<index_t> > counts(numRows);
@@ -78,18 +445,41 @@ void predict(std::vector< std::vector<Value> >& values,
                 counts[k].assign(numTargetCategories, 0);
             }
             
-            for (size_t k = 0; k < numTrees; k++) {
+            // leading category and count of votes for runner-up for each row; a row drops out of
+            // activeRows once votes of remaining trees cannot change its leader
+            
+            vector<size_t> leaders(numRows, numTargetCategories);
+            vector<index_t> runnerUpCounts(numRows, 0);
+            
+            SelectIndexes activeRows(selectRows);
+            SelectIndexes stillActiveRows;
+            
+            for (size_t k = 0; k < numTrees && activeRows.countSelected() > 0; k++) {
                 vector<Value> onePredictVector;
                 
-                predictOne(values, valueTypes, selectRows, targetColumn, categoryMaps,
+                predictOne(values, valueTypes, activeRows, targetColumn, categoryMaps,
                            selectColumns, trees[k], onePredictVector, colNames);
                 
-                for (size_t rowIndex = 0; rowIndex < selectRowIndexes.size(); rowIndex++) {
-                    size_t row = selectRowIndexes[rowIndex];
+                const vector<size_t>& activeRowIndexes = activeRows.indexVector();
+                index_t remaining = (index_t)(numTrees - k - 1);
+                
+                stillActiveRows.clear(numRows);
+                
+                for (size_t rowIndex = 0; rowIndex < activeRowIndexes.size(); rowIndex++) {
+                    size_t row = activeRowIndexes[rowIndex];
                     index_t categoryIndex = onePredictVector[row].number.i;
                     size_t countsIndex = (size_t)(categoryIndex - beginCategoryIndex);
                     counts[row][countsIndex]++;
+                    
+                    updateVoteLeader(countsIndex, &counts[row][0], categoryRanks,
+                                     leaders[row], runnerUpCounts[row]);
+                    
+                    if (counts[row][leaders[row]] <= runnerUpCounts[row] + remaining) {
+                        stillActiveRows.select(row);
+                    }
                 }
+                
+                activeRows.swap(stillActiveRows);
             }
             
             // find most frequently predicted category for each row over trees
@@ -115,9 +505,10 @@ void predict(std::vector< std::vector<Value> >& values,
                         // same counts; use name as tie breaker, to enforce deterministic result w/o
                         // regard to order of categories
                         
-                        index_t currentIndex = predictVector[row].number.i;
-                        if (categoryMaps[targetColumn].getCategoryForIndex(categoryIndex) <
-                            categoryMaps[targetColumn].getCategoryForIndex(currentIndex)) {
+                        size_t currentCountsIndex =
+                            (size_t)(predictVector[row].number.i - beginCategoryIndex);
+                        
+                        if (categoryRanks[countsIndex] < categoryRanks[currentCountsIndex]) {
                             
                             predictVector[row].number.i = categoryIndex;
                             predictVector[row].na = false;
@@ -168,6 +559,179 @@ void predict(std::vector< std::vector<Value> >& values,
     
 }
 
+// choose trees of ensemble to keep so that predicting a row visits at most maxSplitsPerRow split
+// nodes, on average over selected rows of values, which must include target column; trees are
+// added one at a time, each time the tree that most improves prediction of selected rows among
+// those that fit in rest of budget, using predictions from each tree made once beforehand; the
+// count of trees that predicts best is kept; return indexes of kept trees in ascending order
+void selectTrees(std::vector<size_t>& keptTrees,
+                 double maxSplitsPerRow,
+                 const std::vector< std::vector<Value> >& values,
+                 const std::vector<ValueType>& valueTypes,
+                 const std::vector<CategoryMaps>& categoryMaps,
+                 size_t targetColumn,
+                 const SelectIndexes& selectRows,
+                 const SelectIndexes& selectColumns,
+                 const std::vector<CompactTree>& trees,
+                 const std::vector<std::string>& colNames)
+{
+    LOGIC_ERROR_IF(values.size() != valueTypes.size(), "values vs. valueTypes size mismatch");
+    
+    size_t numTrees = trees.size();
+    size_t numRows = values.at(targetColumn).size();
+    const vector<Value>& targetVector = values[targetColumn];
+    ValueType targetType = valueTypes.at(targetColumn);
+    
+    // rows with NA response cannot be scored
+    SelectIndexes scoreRows = selectRows;
+    for (size_t row = 0; row < numRows; row++) {
+        if (targetVector[row].na) {
+            scoreRows.unselect(row);
+        }
+    }
+    
+    const vector<size_t>& rowIndexes = scoreRows.indexVector();
+    size_t numScoreRows = rowIndexes.size();
+    
+    // predictions of each tree, one per scored row, and average cost of each tree
+    
+    vector< vector<Value> > treePredictions(numTrees);
+    vector<double> treeCosts(numTrees);
+    
+    for (size_t treeIndex = 0; treeIndex < numTrees; treeIndex++) {
+        vector<Value> predictVector;
+        predictOne(values, valueTypes, scoreRows, targetColumn, categoryMaps, selectColumns,
+                   trees[treeIndex], predictVector, colNames);
+        
+        treePredictions[treeIndex].resize(numScoreRows);
+        for (size_t rowIndex = 0; rowIndex < numScoreRows; rowIndex++) {
+            treePredictions[treeIndex][rowIndex] = predictVector[rowIndexes[rowIndex]];
+        }
+        
+        treeCosts[treeIndex] = averageSplitsVisited(values, valueTypes, scoreRows, selectColumns,
+                                                    trees[treeIndex]);
+    }
+    
+    // state of ensemble of trees added so far; for categorical target, votes for each category of
+    // each row, and category predicted for each row (with ties going to name that sorts earlier,
+    // as in predict()); for numeric target, sum of predictions for each row
+    
+    index_t beginCategoryIndex = 0;
+    size_t numCategories = 0;
+    vector<size_t> categoryRanks;
+    vector<index_t> votes;
+    vector<index_t> predictedCategory(numScoreRows, NO_INDEX);
+    vector<double> sums(numScoreRows, 0.0);
+    
+    if (targetType == kCategorical) {
+        beginCategoryIndex = categoryMaps.at(targetColumn).beginIndex();
+        numCategories = categoryMaps[targetColumn].countAllCategories();
+        categoryMaps[targetColumn].rankCategories(categoryRanks);
+        votes.assign(numScoreRows * numCategories, 0);
+    }
+    
+    vector<bool> added(numTrees, false);
+    vector<size_t> addedTrees;
+    vector<double> addedScores;     // score after each tree is added; higher is better
+    double cost = 0.0;
+    bool more = true;
+    
+    while (more) {
+        size_t bestTree = numTrees;
+        double bestScore = 0.0;
+        
+        for (size_t treeIndex = 0; treeIndex < numTrees; treeIndex++) {
+            if (!added[treeIndex] && cost + treeCosts[treeIndex] <= maxSplitsPerRow) {
+                const vector<Value>& prediction = treePredictions[treeIndex];
+                double score = 0.0;
+                
+                switch (targetType) {
+                    case kCategorical:
+                        // count of rows predicted correctly
+                        for (size_t rowIndex = 0; rowIndex < numScoreRows; rowIndex++) {
+                            index_t category =
+                                categoryAfterVote(prediction[rowIndex].number.i,
+                                                  predictedCategory[rowIndex],
+                                                  &votes[rowIndex * numCategories],
+                                                  beginCategoryIndex, categoryRanks);
+                            
+                            if (category == targetVector[rowIndexes[rowIndex]].number.i) {
+                                score += 1.0;
+                            }
+                        }
+                        break;
+                        
+                    case kNumeric:
+                    {
+                        // negative sum of squared errors
+                        double count = (double)addedTrees.size() + 1.0;
+                        
+                        for (size_t rowIndex = 0; rowIndex < numScoreRows; rowIndex++) {
+                            double error = (sums[rowIndex] + prediction[rowIndex].number.d) /
+                                count - targetVector[rowIndexes[rowIndex]].number.d;
+                            
+                            score -= error * error;
+                        }
+                    }
+                        break;
+                }
+                
+                if (bestTree == numTrees || score > bestScore) {
+                    bestTree = treeIndex;
+                    bestScore = score;
+                }
+            }
+        }
+        
+        if (bestTree == numTrees) {
+            // no more trees fit in budget
+            more = false;
+            
+        } else {
+            // add best tree to ensemble
+            const vector<Value>& prediction = treePredictions[bestTree];
+            
+            for (size_t rowIndex = 0; rowIndex < numScoreRows; rowIndex++) {
+                switch (targetType) {
+                    case kCategorical:
+                    {
+                        index_t vote = prediction[rowIndex].number.i;
+                        index_t *rowVotes = &votes[rowIndex * numCategories];
+                        
+                        predictedCategory[rowIndex] =
+                            categoryAfterVote(vote, predictedCategory[rowIndex], rowVotes,
+                                              beginCategoryIndex, categoryRanks);
+                        
+                        rowVotes[vote - beginCategoryIndex]++;
+                    }
+                        break;
+                        
+                    case kNumeric:
+                        sums[rowIndex] += prediction[rowIndex].number.d;
+                        break;
+                }
+            }
+            
+            added[bestTree] = true;
+            addedTrees.push_back(bestTree);
+            addedScores.push_back(bestScore);
+            cost += treeCosts[bestTree];
+        }
+    }
+    
+    // keep fewest trees that give best score
+    
+    size_t keepCount = 0;
+    for (size_t k = 0; k < addedScores.size(); k++) {
+        if (keepCount == 0 || addedScores[k] > addedScores[keepCount - 1]) {
+            keepCount = k + 1;
+        }
+    }
+    
+    keptTrees.assign(addedTrees.begin(), addedTrees.begin() + (ptrdiff_t)keepCount);
+    sort(keptTrees.begin(), keptTrees.end());
+}
+
 // ========== Local Functions ======================================================================
 
 // predict response from one decision tree
@@ -191,7 +755,57 @@ void predictOne(const vector< vector<Value> >& values,
     const vector<size_t>& selectColumnIndexes = selectColumns.indexVector();
 
     const vector<size_t>& rowIndexes = selectRows.indexVector();
-    for (size_t rowIndex = 0; rowIndex < rowIndexes.size(); rowIndex++) {
+    size_t rowIndex = 0;
+    
+#if LOCKSTEP_X86
+    // traverse tree for blocks of rows in lockstep if possible; remaining rows are done one by one;
+    // kernels compare categories for equality only, so rows that stop at a split on a set of
+    // categories are finished one by one from there
+    
+    size_t blockSize = trace ? 0 : lockstepBlockSize();
+    if (blockSize > 0 && rowIndexes.size() >= blockSize) {
+        LockstepTree lockstepTree;
+        makeLockstepTree(values, valueTypes, selectColumns, tree, lockstepTree);
+        
+        for (size_t k = 0; k < rowIndexes.size(); k++) {
+            LOGIC_ERROR_IF(rowIndexes[k] >= numRows, "out of range");
+        }
+        
+        long long nodes[16];
+        size_t setSplitsVisited = 0;
+        
+        for (; rowIndex + blockSize <= rowIndexes.size(); rowIndex += blockSize) {
+            if (blockSize == 16) {
+                traverseLockstepAvx512(lockstepTree, &rowIndexes[rowIndex], nodes);
+                
+            } else {
+                traverseLockstepAvx2(lockstepTree, &rowIndexes[rowIndex], nodes);
+            }
+            
+            for (size_t k = 0; k < blockSize; k++) {
+                size_t row = rowIndexes[rowIndex + k];
+                size_t nodeIndex = walkToLeaf(values, valueTypes, selectColumnIndexes, tree, row,
+                                              (size_t)nodes[k], setSplitsVisited);
+                
+                predictVector[row].number = tree.value[nodeIndex];
+                predictVector[row].na = false;
+            }
+        }
+    }
+#endif
+    
+    // for profiling; rows done in lockstep are walked again one by one to count their depth
+    size_t lockstepRows = rowIndex;
+    size_t splitsVisited = 0;
+    
+#ifdef INSTRUMENT
+    for (size_t k = 0; k < lockstepRows; k++) {
+        splitsVisited += countSplitsVisited(values, valueTypes, selectColumnIndexes, tree,
+                                            rowIndexes[k]);
+    }
+#endif
+    
+    for (; rowIndex < rowIndexes.size(); rowIndex++) {
         size_t row = rowIndexes[rowIndex];
         LOGIC_ERROR_IF(row >= numRows, "out of range");
 
@@ -227,7 +841,11 @@ void predictOne(const vector< vector<Value> >& values,
                     case kCategorical:
                     {
                         index_t index = tree.value[nodeIndex].i;
-                        string category = categoryMaps.at(col).getCategoryForIndex(index);
+                        index_t setIndex = tree.categorySetIndex[nodeIndex];
+                        string category = setIndex == NO_INDEX ?
+                            categoryMaps.at(col).getCategoryForIndex(index) :
+                            categorySetToString(&tree.categorySets[(size_t)setIndex],
+                                                categoryMaps.at(col));
 
                         if (compareValue.na) {
                             CERR << nodeIndex << "]\t" << colNames.at(col) <<
@@ -257,32 +875,14 @@ void predictOne(const vector< vector<Value> >& values,
                 }
             }
             
-            bool useLessOrEqual;
-
-            if (compareValue.na) {
-                useLessOrEqual = tree.toLessOrEqualIfNA[nodeIndex];
-                
-            } else {
-                switch (valueTypes[col]) {
-                    case kCategorical:
-                        useLessOrEqual = compareValue.number.i == tree.value[nodeIndex].i;
-                        break;
-                        
-                    case kNumeric:
-                        useLessOrEqual = compareValue.number.d <= tree.value[nodeIndex].d;
-                        break;
-                        
-                    default:
-                        // suppress compiler warning
-                        useLessOrEqual = false;
-                        RUNTIME_ERROR_IF(true, "unrecognized value type");
-                        break;
-                }
-            }
+            bool useLessOrEqual = isLessOrEqualBranch(tree, nodeIndex, compareValue,
+                                                      valueTypes[col]);
             
             nodeIndex = useLessOrEqual ?
                 (size_t)tree.lessOrEqualIndex[nodeIndex] :
                 (size_t)tree.greaterOrNotIndex[nodeIndex];
+            
+            splitsVisited++;
         }
 
         if (trace) {
@@ -321,24 +921,882 @@ void predictOne(const vector< vector<Value> >& values,
         predictVector[row].number = tree.value[nodeIndex];
         predictVector[row].na = false;
     }
+    
+    INSTRUMENT_ADD(kPredictOneRows, rowIndexes.size())
+    INSTRUMENT_ADD(kPredictOneLockstepRows, lockstepRows)
+    INSTRUMENT_ADD(kPredictOneSplitsVisited, splitsVisited)
 }
 
-// ========== Tests ================================================================================
+// return true if compareValue goes to lessOrEqual branch of split node of tree; valueType is type
+// of split column
+bool isLessOrEqualBranch(const CompactTree& tree,
+                         size_t nodeIndex,
+                         const Value& compareValue,
+                         ValueType valueType)
+{
+    bool useLessOrEqual;
 
-#include "csv.h"
-#include "train.h"
+    if (compareValue.na) {
+        useLessOrEqual = tree.toLessOrEqualIfNA[nodeIndex];
+        
+    } else {
+        switch (valueType) {
+            case kCategorical:
+                if (tree.categorySetIndex[nodeIndex] == NO_INDEX) {
+                    useLessOrEqual = compareValue.number.i == tree.value[nodeIndex].i;
+                    
+                } else {
+                    size_t setIndex = (size_t)tree.categorySetIndex[nodeIndex];
+                    useLessOrEqual = isInCategorySet(compareValue.number.i,
+                                                     &tree.categorySets[setIndex]);
+                }
+                break;
+                
+            case kNumeric:
+                useLessOrEqual = compareValue.number.d <= tree.value[nodeIndex].d;
+                break;
+                
+            default:
+                // suppress compiler warning
+                useLessOrEqual = false;
+                RUNTIME_ERROR_IF(true, "unrecognized value type");
+                break;
+        }
+    }
+    
+    return useLessOrEqual;
+}
 
-// component tests
-void ctest_predict(int& totalPassed, int& totalFailed, bool verbose)
+// for selectTrees; return category predicted for row after adding vote, given category predicted
+// before (NO_INDEX if none) and count of votes so far for each category; ties go to category with
+// name that sorts earlier, as in predict()
+index_t categoryAfterVote(index_t vote,
+                          index_t category,
+                          const index_t *rowVotes,
+                          index_t beginCategoryIndex,
+                          const vector<size_t>& categoryRanks)
 {
-    int passed = 0;
-    int failed = 0;
+    index_t result = vote;
     
-    // ~~~~~~~~~~~~~~~~~~~~~~
-    // predict
+    if (category != NO_INDEX && category != vote) {
+        size_t voteIndex = (size_t)(vote - beginCategoryIndex);
+        size_t categoryIndex = (size_t)(category - beginCategoryIndex);
+        index_t voteCount = rowVotes[voteIndex] + 1;
+        index_t categoryCount = rowVotes[categoryIndex];
+        
+        if (categoryCount > voteCount ||
+            (categoryCount == voteCount &&
+             categoryRanks[categoryIndex] < categoryRanks[voteIndex])) {
+            
+            result = category;
+        }
+    }
     
-    // ~~~~~~~~~~~~~~~~~~~~~~
-    // predictOne
+    return result;
+}
+
+// for early exit from voting; update leading category and count of votes for runner-up after vote
+// for category at countsIndex has been added to counts; leader is categoryRanks.size() before first
+// vote; ties go to category with name that sorts earlier, as in predict()
+void updateVoteLeader(size_t countsIndex,
+                      const index_t *counts,
+                      const vector<size_t>& categoryRanks,
+                      size_t& leader,
+                      index_t& runnerUpCount)
+{
+    if (leader == countsIndex) {
+        SKIP
+        
+    } else if (leader == categoryRanks.size() || counts[countsIndex] > counts[leader] ||
+               (counts[countsIndex] == counts[leader] &&
+                categoryRanks[countsIndex] < categoryRanks[leader])) {
+        
+        // previous leader, if any, had most votes of other categories
+        runnerUpCount = leader == categoryRanks.size() ? 0 : counts[leader];
+        leader = countsIndex;
+        
+    } else {
+        runnerUpCount = max(runnerUpCount, counts[countsIndex]);
+    }
+}
+
+// return average count of split nodes visited in predicting selected rows from one decision tree
+double averageSplitsVisited(const vector< vector<Value> >& values,
+                            const std::vector<ValueType>& valueTypes,
+                            const SelectIndexes& selectRows,
+                            const SelectIndexes& selectColumns,
+                            const CompactTree& tree)
+{
+    const vector<size_t>& selectColumnIndexes = selectColumns.indexVector();
+    const vector<size_t>& rowIndexes = selectRows.indexVector();
+    
+    size_t splitCount = 0;
+    
+    for (size_t rowIndex = 0; rowIndex < rowIndexes.size(); rowIndex++) {
+        splitCount += countSplitsVisited(values, valueTypes, selectColumnIndexes, tree,
+                                         rowIndexes[rowIndex]);
+    }
+    
+    return rowIndexes.empty() ? 0.0 : (double)splitCount / rowIndexes.size();
+}
+
+// return count of split nodes visited in predicting one row from one decision tree
+size_t countSplitsVisited(const vector< vector<Value> >& values,
+                          const std::vector<ValueType>& valueTypes,
+                          const vector<size_t>& selectColumnIndexes,
+                          const CompactTree& tree,
+                          size_t row)
+{
+    size_t splitCount = 0;
+    walkToLeaf(values, valueTypes, selectColumnIndexes, tree, row, 0, splitCount);
+    
+    return splitCount;
+}
+
+// return index of leaf reached by row of values from nodeIndex of decision tree; add count of
+// split nodes visited to splitCount
+size_t walkToLeaf(const vector< vector<Value> >& values,
+                  const std::vector<ValueType>& valueTypes,
+                  const vector<size_t>& selectColumnIndexes,
+                  const CompactTree& tree,
+                  size_t row,
+                  size_t nodeIndex,
+                  size_t& splitCount)
+{
+    while (tree.lessOrEqualIndex[nodeIndex] != NO_INDEX) {
+        size_t col = selectColumnIndexes.at((size_t)tree.splitColIndex[nodeIndex]);
+        
+        nodeIndex = isLessOrEqualBranch(tree, nodeIndex, values[col].at(row), valueTypes[col]) ?
+            (size_t)tree.lessOrEqualIndex[nodeIndex] :
+            (size_t)tree.greaterOrNotIndex[nodeIndex];
+        
+        splitCount++;
+    }
+    
+    return nodeIndex;
+}
+
+// number of rows per block for lockstep traversal on this CPU, or zero if not supported
+size_t lockstepBlockSize()
+{
+    size_t blockSize = 0;
+    
+#if LOCKSTEP_X86
+    // kernels load category indexes and NA flags as 64-bit words
+    if (sizeof(index_t) == 8 && sizeof(Value) == 16 && offsetof(Value, na) == 8) {
+        if (__builtin_cpu_supports("avx512f")) {
+            blockSize = 16;
+            
+        } else if (__builtin_cpu_supports("avx2")) {
+            blockSize = 8;
+        }
+    }
+#endif
+    
+    return blockSize;
+}
+
+// make flattened copy of tree for lockstep traversal
+void makeLockstepTree(const vector< vector<Value> >& values,
+                      const std::vector<ValueType>& valueTypes,
+                      const SelectIndexes& selectColumns,
+                      const CompactTree& tree,
+                      LockstepTree& lockstepTree)
+{
+    size_t numCols = values.size();
+    size_t numNodes = tree.value.size();
+    
+    const vector<size_t>& selectColumnIndexes = selectColumns.indexVector();
+    
+    // addresses are absolute, so that kernels do no pointer arithmetic across columns
+    lockstepTree.address.assign(numNodes, (long long)(size_t)&values[0][0]);
+    lockstepTree.lessOrEqual.assign(numNodes, NO_INDEX);
+    lockstepTree.greaterOrNot.assign(numNodes, NO_INDEX);
+    lockstepTree.flags.assign(numNodes, 0);
+    lockstepTree.value = tree.value;
+    
+    for (size_t nodeIndex = 0; nodeIndex < numNodes; nodeIndex++) {
+        if (tree.lessOrEqualIndex[nodeIndex] == NO_INDEX ||
+            tree.categorySetIndex[nodeIndex] != NO_INDEX) {
+            // leaf, or split on set of categories, at which rows stop; first column is a valid
+            // address for any row, so loads for stopped rows are safe
+            SKIP
+            
+        } else {
+            index_t splitColIndex = tree.splitColIndex[nodeIndex];
+            LOGIC_ERROR_IF(splitColIndex < 0, "out of range");
+            
+            size_t col = selectColumnIndexes[(size_t)splitColIndex];
+            LOGIC_ERROR_IF(col >= numCols, "out of range");
+            
+            lockstepTree.address[nodeIndex] = (long long)(size_t)&values[col][0];
+            lockstepTree.lessOrEqual[nodeIndex] = tree.lessOrEqualIndex[nodeIndex];
+            lockstepTree.greaterOrNot[nodeIndex] = tree.greaterOrNotIndex[nodeIndex];
+            
+            if (valueTypes[col] == kCategorical) {
+                lockstepTree.flags[nodeIndex] |= kLockstepCategorical;
+            }
+            
+            if (tree.toLessOrEqualIfNA[nodeIndex]) {
+                lockstepTree.flags[nodeIndex] |= kLockstepNaToLessOrEqual;
+            }
+        }
+    }
+}
+
+#if LOCKSTEP_X86
+
+// advance 4 rows one level down tree; stopped rows stay at their node
+__attribute__((target("avx2")))
+static inline __m256i stepLockstepAvx2(const LockstepTree& lockstepTree,
+                                       __m256i rowOffset,
+                                       __m256i node,
+                                       __m256i& stop)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i categorical = _mm256_set1_epi64x(kLockstepCategorical);
+    const __m256i naToLessOrEqual = _mm256_set1_epi64x(kLockstepNaToLessOrEqual);
+    
+    __m256i lessOrEqual = _mm256_i64gather_epi64(&lockstepTree.lessOrEqual[0], node, 8);
+    __m256i greaterOrNot = _mm256_i64gather_epi64(&lockstepTree.greaterOrNot[0], node, 8);
+    __m256i columnAddress = _mm256_i64gather_epi64(&lockstepTree.address[0], node, 8);
+    __m256i flags = _mm256_i64gather_epi64(&lockstepTree.flags[0], node, 8);
+    __m256i split = _mm256_i64gather_epi64((const long long *)&lockstepTree.value[0], node, 8);
+    
+    stop = _mm256_cmpeq_epi64(lessOrEqual, _mm256_set1_epi64x(NO_INDEX));
+    
+    // addresses are absolute, so gathers are from base address 0
+    __m256i address = _mm256_add_epi64(columnAddress, rowOffset);
+    __m256i naAddress = _mm256_add_epi64(address, _mm256_set1_epi64x(offsetof(Value, na)));
+    __m256i number = _mm256_i64gather_epi64((const long long *)0, address, 1);
+    __m256i na = _mm256_i64gather_epi64((const long long *)0, naAddress, 1);
+    __m256i notNa = _mm256_cmpeq_epi64(_mm256_and_si256(na, _mm256_set1_epi64x(0xFF)), zero);
+    
+    __m256i numericTest = _mm256_castpd_si256(_mm256_cmp_pd(_mm256_castsi256_pd(number),
+                                                            _mm256_castsi256_pd(split),
+                                                            _CMP_LE_OQ));
+    __m256i categoricalTest = _mm256_cmpeq_epi64(number, split);
+    __m256i isCategorical = _mm256_cmpeq_epi64(_mm256_and_si256(flags, categorical), categorical);
+    __m256i useLessOrEqual = _mm256_blendv_epi8(numericTest, categoricalTest, isCategorical);
+    
+    __m256i naTest = _mm256_cmpeq_epi64(_mm256_and_si256(flags, naToLessOrEqual), naToLessOrEqual);
+    useLessOrEqual = _mm256_blendv_epi8(naTest, useLessOrEqual, notNa);
+    
+    __m256i next = _mm256_blendv_epi8(greaterOrNot, lessOrEqual, useLessOrEqual);
+    
+    return _mm256_blendv_epi8(next, node, stop);
+}
+
+// traverse one decision tree for 8 rows in lockstep, using AVX2; write index of node at which
+// each row stopped to nodes
+__attribute__((target("avx2")))
+void traverseLockstepAvx2(const LockstepTree& lockstepTree,
+                          const size_t* rows,
+                          long long *nodes)
+{
+    // two groups of 4 rows are interleaved to hide latency of gathers
+    
+    long long offsets[8];
+    for (size_t k = 0; k < 8; k++) {
+        offsets[k] = (long long)(rows[k] * sizeof(Value));
+    }
+    
+    __m256i rowOffset0 = _mm256_loadu_si256((const __m256i *)&offsets[0]);
+    __m256i rowOffset1 = _mm256_loadu_si256((const __m256i *)&offsets[4]);
+    
+    __m256i node0 = _mm256_setzero_si256();
+    __m256i node1 = _mm256_setzero_si256();
+    __m256i stop0;
+    __m256i stop1;
+    
+    while (true) {
+        node0 = stepLockstepAvx2(lockstepTree, rowOffset0, node0, stop0);
+        node1 = stepLockstepAvx2(lockstepTree, rowOffset1, node1, stop1);
+        
+        if (_mm256_movemask_epi8(_mm256_and_si256(stop0, stop1)) == -1) {
+            // all rows stopped
+            break;
+        }
+    }
+    
+    _mm256_storeu_si256((__m256i *)&nodes[0], node0);
+    _mm256_storeu_si256((__m256i *)&nodes[4], node1);
+}
+
+// gather 8 64-bit words at base + index * scale into vector; masked form is used with zeroed
+// source, as unmasked form starts from undefined vector
+#define GATHER_AVX512(index, base, scale) \
+    _mm512_mask_i64gather_epi64(_mm512_setzero_si512(), 0xFF, index, base, scale)
+
+// advance 8 rows one level down tree; stopped rows stay at their node
+__attribute__((target("avx512f")))
+static inline __m512i stepLockstepAvx512(const LockstepTree& lockstepTree,
+                                         __m512i rowOffset,
+                                         __m512i node,
+                                         __mmask8& stop)
+{
+    __m512i lessOrEqual = GATHER_AVX512(node, &lockstepTree.lessOrEqual[0], 8);
+    __m512i greaterOrNot = GATHER_AVX512(node, &lockstepTree.greaterOrNot[0], 8);
+    __m512i columnAddress = GATHER_AVX512(node, &lockstepTree.address[0], 8);
+    __m512i flags = GATHER_AVX512(node, &lockstepTree.flags[0], 8);
+    __m512i split = GATHER_AVX512(node, &lockstepTree.value[0], 8);
+    
+    stop = _mm512_cmpeq_epi64_mask(lessOrEqual, _mm512_set1_epi64(NO_INDEX));
+    
+    // addresses are absolute, so gathers are from base address 0
+    __m512i address = _mm512_add_epi64(columnAddress, rowOffset);
+    __m512i naAddress = _mm512_add_epi64(address, _mm512_set1_epi64(offsetof(Value, na)));
+    __m512i number = GATHER_AVX512(address, (const void *)0, 1);
+    __m512i na = GATHER_AVX512(naAddress, (const void *)0, 1);
+    __mmask8 isNa = _mm512_test_epi64_mask(na, _mm512_set1_epi64(0xFF));
+    
+    __mmask8 numericTest = _mm512_cmp_pd_mask(_mm512_castsi512_pd(number),
+                                              _mm512_castsi512_pd(split),
+                                              _CMP_LE_OQ);
+    __mmask8 categoricalTest = _mm512_cmpeq_epi64_mask(number, split);
+    __mmask8 isCategorical = _mm512_test_epi64_mask(flags,
+                                                    _mm512_set1_epi64(kLockstepCategorical));
+    __mmask8 naTest = _mm512_test_epi64_mask(flags, _mm512_set1_epi64(kLockstepNaToLessOrEqual));
+    
+    __mmask8 useLessOrEqual = (isCategorical & categoricalTest) | (~isCategorical & numericTest);
+    useLessOrEqual = (isNa & naTest) | (~isNa & useLessOrEqual);
+    
+    __m512i next = _mm512_mask_blend_epi64(useLessOrEqual, greaterOrNot, lessOrEqual);
+    
+    return _mm512_mask_blend_epi64(stop, next, node);
+}
+
+// traverse one decision tree for 16 rows in lockstep, using AVX-512; write index of node at which
+// each row stopped to nodes
+__attribute__((target("avx512f")))
+void traverseLockstepAvx512(const LockstepTree& lockstepTree,
+                            const size_t* rows,
+                            long long *nodes)
+{
+    // two groups of 8 rows are interleaved to hide latency of gathers
+    
+    long long offsets[16];
+    for (size_t k = 0; k < 16; k++) {
+        offsets[k] = (long long)(rows[k] * sizeof(Value));
+    }
+    
+    __m512i rowOffset0 = _mm512_loadu_si512(&offsets[0]);
+    __m512i rowOffset1 = _mm512_loadu_si512(&offsets[8]);
+    
+    __m512i node0 = _mm512_setzero_si512();
+    __m512i node1 = _mm512_setzero_si512();
+    __mmask8 stop0;
+    __mmask8 stop1;
+    
+    while (true) {
+        node0 = stepLockstepAvx512(lockstepTree, rowOffset0, node0, stop0);
+        node1 = stepLockstepAvx512(lockstepTree, rowOffset1, node1, stop1);
+        
+        if ((stop0 & stop1) == 0xFF) {
+            // all rows stopped
+            break;
+        }
+    }
+    
+    _mm512_storeu_si512(&nodes[0], node0);
+    _mm512_storeu_si512(&nodes[8], node1);
+}
+
+#endif
+
+// ========== Tests ================================================================================
+
+#include "csv.h"
+#include "train.h"
+
+#include <sstream>
+
+// for tests; read csv string into values, with default value types and "NA" for NA
+static void readTestValues(const string& csv,
+                           vector< vector<Value> >& values,
+                           vector<ValueType>& valueTypes,
+                           vector<CategoryMaps>& categoryMaps,
+                           vector<string>& colNames)
+{
+    vector< vector<string> > cells;
+    vector< vector<bool> > quoted;
+    
+    readCsvString(csv, cells, quoted, colNames);
+    getDefaultValueTypes(cells, quoted, true, "NA", valueTypes);
+    cellsToValues(cells, quoted, valueTypes, true, "NA", values, false, categoryMaps);
+}
+
+// for tests; return csv string of numRows rows with numeric and categorical attributes C0 to C2,
+// some NA, and numeric target Y and categorical target Z
+static string makeMixedTestCsv(int numRows)
+{
+    ostringstream data;
+    data << "C0,C1,C2,Y,Z\n";
+    for (int row = 0; row < numRows; row++) {
+        if (row % 7 == 0) data << "NA,"; else data << (row * 5) % 11 << ",";
+        if (row % 10 == 0) data << "NA,"; else data << (char)('A' + row % 3) << ",";
+        data << (row * 0.29) - (row % 4) << ",";
+        data << (row * 13) % 17 << ",";
+        data << (char)('Z' - (row * 7) % 5) << "\n";
+    }
+    
+    return data.str();
+}
+
+// component tests
+void ctest_predict(int& totalPassed, int& totalFailed, bool verbose)
+{
+    int passed = 0;
+    int failed = 0;
+    
+    // ~~~~~~~~~~~~~~~~~~~~~~
+    // Predictor
+    
+    {
+        // results for rows given as doubles should match results of predict()
+        
+        vector< vector<Value> > values;
+        vector<ValueType> valueTypes;
+        vector<CategoryMaps> categoryMaps;
+        vector<string> colNames;
+        
+        readTestValues(makeMixedTestCsv(60), values, valueTypes, categoryMaps, colNames);
+        
+        size_t numCols = values.size();
+        size_t numRows = values[0].size();
+        
+        vector<double> rows(numRows * numCols);
+        for (size_t row = 0; row < numRows; row++) {
+            for (size_t col = 0; col < numCols; col++) {
+                const Value& value = values[col][row];
+                double& cell = rows[row * numCols + col];
+                
+                if (value.na) {
+                    cell = numeric_limits<double>::quiet_NaN();
+                    
+                } else if (valueTypes[col] == kCategorical) {
+                    cell = (double)value.number.i;
+                    
+                } else {
+                    cell = value.number.d;
+                }
+            }
+        }
+        
+        for (size_t targetColumn = numCols - 2; targetColumn < numCols; targetColumn++) {
+            SelectIndexes selectRows(numRows, true);
+            SelectIndexes availableColumns(numCols, true);
+            availableColumns.unselect(numCols - 2);
+            availableColumns.unselect(numCols - 1);
+            SelectIndexes selectColumns;
+            vector<ImputeOption> imputeOptions(numCols, kToDefault);
+            vector<CompactTree> trees;
+            
+            vector< vector<Value> > trainValues = values;
+            train(trees, 2, 4, 0, false, 0.0, 1, -1, 25, -1, selectRows, availableColumns,
+                  selectColumns, trainValues, valueTypes, categoryMaps, targetColumn, colNames,
+                  imputeOptions, 1);
+            
+            vector< vector<Value> > predictValues = values;
+            predict(predictValues, valueTypes, categoryMaps, targetColumn, selectRows,
+                    selectColumns, trees, colNames);
+            
+            Predictor predictor(valueTypes, categoryMaps, targetColumn, selectColumns, trees);
+            
+            vector<double> results(numRows);
+            predictor.predictRows(&rows[0], numRows, &results[0]);
+            
+            bool same = predictor.countColumns() == numCols;
+            for (size_t row = 0; row < numRows; row++) {
+                const Value& expected = predictValues[targetColumn][row];
+                
+                if (valueTypes[targetColumn] == kCategorical) {
+                    same = same && results[row] == (double)expected.number.i;
+                    
+                } else {
+                    same = same && fabs(results[row] - expected.number.d) < 1.0e-9;
+                }
+            }
+            
+            if (same) passed++; else failed++;
+        }
+    }
+    
+    // ~~~~~~~~~~~~~~~~~~~~~~
+    // predict
+    
+    {
+        // for categorical target, stopping vote early for decided rows should give same result as
+        // counting votes of all trees; Predictor should evaluate fewer trees than full count
+        
+        ostringstream data;
+        data << "C0,C1,C2,C3,C4,C5,Z\n";
+        for (int row = 0; row < 100; row++) {
+            int c0 = (row * 7) % 10;
+            if (row % 9 == 0) data << "NA,"; else data << c0 << ",";
+            data << (char)('A' + row % 3) << ",";
+            data << (row * 0.37) - (row % 5) << ",";
+            data << c0 + (row % 3) << ",";
+            data << (char)('A' + (c0 + row % 2) / 3) << ",";
+            data << (row * 11) % 23 << ",";
+            data << ((c0 < 5) != (row % 13 == 0) ? 'P' : (row % 4 == 0 ? 'R' : 'Q')) << "\n";
+        }
+        
+        vector< vector<Value> > values;
+        vector<ValueType> valueTypes;
+        vector<CategoryMaps> categoryMaps;
+        vector<string> colNames;
+        
+        readTestValues(data.str(), values, valueTypes, categoryMaps, colNames);
+        
+        size_t numCols = values.size();
+        size_t numRows = values[0].size();
+        size_t targetColumn = numCols - 1;
+        
+        SelectIndexes selectRows(numRows, true);
+        SelectIndexes availableColumns(numCols, true);
+        availableColumns.unselect(targetColumn);
+        SelectIndexes selectColumns;
+        vector<ImputeOption> imputeOptions(numCols, kToDefault);
+        vector<CompactTree> trees;
+        
+        vector< vector<Value> > trainValues = values;
+        train(trees, 2, 4, 0, false, 0.0, 1, -1, 30, -1, selectRows, availableColumns,
+              selectColumns, trainValues, valueTypes, categoryMaps, targetColumn, colNames,
+              imputeOptions, 1);
+        
+        vector< vector<Value> > predictValues = values;
+        predict(predictValues, valueTypes, categoryMaps, targetColumn, selectRows, selectColumns,
+                trees, colNames);
+        
+        // count votes of all trees
+        
+        index_t beginCategoryIndex = categoryMaps[targetColumn].beginIndex();
+        size_t numCategories = categoryMaps[targetColumn].countAllCategories();
+        vector<size_t> categoryRanks;
+        categoryMaps[targetColumn].rankCategories(categoryRanks);
+        
+        vector< vector<index_t> > counts(numRows, vector<index_t>(numCategories, 0));
+        for (size_t k = 0; k < trees.size(); k++) {
+            vector<Value> onePredictVector;
+            predictOne(values, valueTypes, selectRows, targetColumn, categoryMaps, selectColumns,
+                       trees[k], onePredictVector, colNames);
+            
+            for (size_t row = 0; row < numRows; row++) {
+                counts[row][(size_t)(onePredictVector[row].number.i - beginCategoryIndex)]++;
+            }
+        }
+        
+        bool same = trees.size() > 1;
+        for (size_t row = 0; row < numRows; row++) {
+            size_t best = 0;
+            for (size_t countsIndex = 1; countsIndex < numCategories; countsIndex++) {
+                if (counts[row][countsIndex] > counts[row][best] ||
+                    (counts[row][countsIndex] == counts[row][best] &&
+                     categoryRanks[countsIndex] < categoryRanks[best])) {
+                    
+                    best = countsIndex;
+                }
+            }
+            
+            same = same && !predictValues[targetColumn][row].na &&
+                   predictValues[targetColumn][row].number.i == (index_t)best + beginCategoryIndex;
+        }
+        
+        // Predictor should match and stop early for some rows
+        
+        Predictor predictor(valueTypes, categoryMaps, targetColumn, selectColumns, trees);
+        
+        vector<double> row(numCols);
+        for (size_t rowIndex = 0; rowIndex < numRows; rowIndex++) {
+            for (size_t col = 0; col < numCols; col++) {
+                const Value& value = values[col][rowIndex];
+                
+                if (value.na) {
+                    row[col] = numeric_limits<double>::quiet_NaN();
+                    
+                } else if (valueTypes[col] == kCategorical) {
+                    row[col] = (double)value.number.i;
+                    
+                } else {
+                    row[col] = value.number.d;
+                }
+            }
+            
+            same = same && predictor.predictRow(&row[0]) ==
+                           (double)predictValues[targetColumn][rowIndex].number.i;
+        }
+        
+        same = same && predictor.countTreesEvaluated() < numRows * trees.size();
+        
+        if (same) passed++; else failed++;
+    }
+    
+    // ~~~~~~~~~~~~~~~~~~~~~~
+    // predictOne
+    
+    {
+        // rows traversed in lockstep blocks should match rows traversed one at a time
+        
+        ostringstream data;
+        data << "C0,C1,C2,Y\n";
+        for (int row = 0; row < 100; row++) {
+            if (row % 9 == 0) data << "NA,"; else data << (row * 7) % 13 << ",";
+            if (row % 11 == 0) data << "NA,"; else data << (char)('A' + row % 4) << ",";
+            data << (row * 0.37) - (row % 5) << ",";
+            data << (row * 13) % 17 + (row % 4) << "\n";
+        }
+        
+        vector< vector<Value> > values;
+        vector<ValueType> valueTypes;
+        vector<CategoryMaps> categoryMaps;
+        vector<string> colNames;
+        
+        readTestValues(data.str(), values, valueTypes, categoryMaps, colNames);
+        
+        size_t numCols = values.size();
+        size_t numRows = values[0].size();
+        size_t targetColumn = numCols - 1;
+        
+        SelectIndexes selectRows(numRows, true);
+        SelectIndexes availableColumns(numCols, true);
+        availableColumns.unselect(targetColumn);
+        SelectIndexes selectColumns;
+        vector<ImputeOption> imputeOptions(numCols, kToDefault);
+        vector<CompactTree> trees;
+        
+        vector< vector<Value> > trainValues = values;
+        train(trees, 2, 100, 0, false, 0.0, 1, -1, 10, -1, selectRows, availableColumns,
+              selectColumns, trainValues, valueTypes, categoryMaps, targetColumn, colNames,
+              imputeOptions, 1);
+        
+        bool same = trees.size() > 0;
+        for (size_t k = 0; k < trees.size(); k++) {
+            vector<Value> blockPredict;
+            predictOne(values, valueTypes, selectRows, targetColumn, categoryMaps, selectColumns,
+                       trees[k], blockPredict, colNames);
+            
+            for (size_t row = 0; row < numRows; row++) {
+                SelectIndexes oneRow(numRows, false);
+                oneRow.select(row);
+                
+                vector<Value> rowPredict;
+                predictOne(values, valueTypes, oneRow, targetColumn, categoryMaps, selectColumns,
+                           trees[k], rowPredict, colNames);
+                
+                if (blockPredict[row].na || rowPredict[row].na ||
+                    blockPredict[row].number.d != rowPredict[row].number.d) {
+                    same = false;
+                }
+            }
+        }
+        
+#if LOCKSTEP_X86
+        // call each kernel this CPU supports directly, so that a kernel not chosen by predictOne
+        // is still checked against predictOne, itself checked above against rows done one at a
+        // time; rows stopped by kernels at splits on sets of categories are finished one by one,
+        // and some trees must have such splits
+        
+        size_t blockSize = lockstepBlockSize();
+        size_t setTreeCount = 0;
+        
+        vector<size_t> rowIndexes(numRows / 16 * 16);
+        for (size_t row = 0; row < rowIndexes.size(); row++) {
+            rowIndexes[row] = numRows - 1 - row;
+        }
+        
+        const vector<size_t>& selectColumnIndexes = selectColumns.indexVector();
+        long long avx2Nodes[16];
+        long long avx512Nodes[16];
+        size_t splitCount = 0;
+        
+        for (size_t k = 0; k < trees.size() && blockSize > 0; k++) {
+            if (!trees[k].categorySets.empty()) {
+                setTreeCount++;
+            }
+            
+            vector<Value> rowPredict;
+            predictOne(values, valueTypes, selectRows, targetColumn, categoryMaps,
+                       selectColumns, trees[k], rowPredict, colNames);
+            
+            LockstepTree lockstepTree;
+            makeLockstepTree(values, valueTypes, selectColumns, trees[k], lockstepTree);
+            
+            for (size_t row = 0; row < rowIndexes.size(); row += 16) {
+                traverseLockstepAvx2(lockstepTree, &rowIndexes[row], &avx2Nodes[0]);
+                traverseLockstepAvx2(lockstepTree, &rowIndexes[row + 8], &avx2Nodes[8]);
+                
+                if (blockSize == 16) {
+                    traverseLockstepAvx512(lockstepTree, &rowIndexes[row], avx512Nodes);
+                }
+                
+                for (size_t j = 0; j < 16; j++) {
+                    size_t rowIndex = rowIndexes[row + j];
+                    double expected = rowPredict[rowIndex].number.d;
+                    
+                    size_t avx2Leaf = walkToLeaf(values, valueTypes, selectColumnIndexes,
+                                                 trees[k], rowIndex, (size_t)avx2Nodes[j],
+                                                 splitCount);
+                    same = same && trees[k].value[avx2Leaf].d == expected;
+                    
+                    if (blockSize == 16) {
+                        size_t avx512Leaf = walkToLeaf(values, valueTypes, selectColumnIndexes,
+                                                       trees[k], rowIndex,
+                                                       (size_t)avx512Nodes[j], splitCount);
+                        same = same && trees[k].value[avx512Leaf].d == expected;
+                    }
+                }
+            }
+        }
+        
+        same = same && (blockSize == 0 || setTreeCount > 0);
+#endif
+        
+        if (same) passed++; else failed++;
+    }
+    
+    {
+        // trees with splits on sets of categories give same results from predict() and Predictor,
+        // and fit target that depends on a set of categories
+        
+        ostringstream data;
+        data << "C0,Y\n";
+        for (int row = 0; row < 48; row++) {
+            data << (char)('A' + (row * 5) % 8) << ",";
+            data << ((row * 5) % 8 % 3 == 1 ? 10 : 0) << "\n";
+        }
+        
+        vector< vector<Value> > values;
+        vector<ValueType> valueTypes;
+        vector<CategoryMaps> categoryMaps;
+        vector<string> colNames;
+        
+        readTestValues(data.str(), values, valueTypes, categoryMaps, colNames);
+        
+        size_t numCols = values.size();
+        size_t numRows = values[0].size();
+        size_t targetColumn = numCols - 1;
+        
+        SelectIndexes selectRows(numRows, true);
+        SelectIndexes availableColumns(numCols, true);
+        availableColumns.unselect(targetColumn);
+        SelectIndexes selectColumns;
+        vector<ImputeOption> imputeOptions(numCols, kToDefault);
+        vector<CompactTree> trees;
+        
+        vector< vector<Value> > trainValues = values;
+        train(trees, 1, 2, 0, false, 0.0, 1, -1, 1, -1, selectRows, availableColumns,
+              selectColumns, trainValues, valueTypes, categoryMaps, targetColumn, colNames,
+              imputeOptions, 1);
+        
+        bool same = trees.size() == 1 && trees[0].categorySetIndex.size() == 3 &&
+            trees[0].categorySetIndex[0] != NO_INDEX;
+        
+        vector< vector<Value> > predictValues = values;
+        predict(predictValues, valueTypes, categoryMaps, targetColumn, selectRows,
+                selectColumns, trees, colNames);
+        
+        Predictor predictor(valueTypes, categoryMaps, targetColumn, selectColumns, trees);
+        
+        for (size_t row = 0; row < numRows; row++) {
+            double rowCells[2] = { (double)values[0][row].number.i, 0.0 };
+            
+            same = same && predictValues[targetColumn][row].number.d == values[1][row].number.d;
+            same = same && predictor.predictRow(rowCells) == values[1][row].number.d;
+        }
+        
+        if (same) passed++; else failed++;
+    }
+    
+    // ~~~~~~~~~~~~~~~~~~~~~~
+    // selectTrees
+    
+    {
+        // kept trees fit in budget; with budget for all trees, kept trees predict at least as well
+        // as all trees
+        
+        vector< vector<Value> > values;
+        vector<ValueType> valueTypes;
+        vector<CategoryMaps> categoryMaps;
+        vector<string> colNames;
+        
+        readTestValues(makeMixedTestCsv(80), values, valueTypes, categoryMaps, colNames);
+        
+        size_t numCols = values.size();
+        size_t numRows = values[0].size();
+        bool ok = true;
+        
+        for (size_t targetColumn = numCols - 2; targetColumn < numCols; targetColumn++) {
+            // train on even rows, select on odd rows
+            SelectIndexes trainRows(numRows, false);
+            SelectIndexes validateRows(numRows, false);
+            for (size_t row = 0; row < numRows; row++) {
+                if (row % 2 == 0) trainRows.select(row); else validateRows.select(row);
+            }
+            
+            SelectIndexes availableColumns(numCols, true);
+            availableColumns.unselect(numCols - 2);
+            availableColumns.unselect(numCols - 1);
+            SelectIndexes selectColumns;
+            vector<ImputeOption> imputeOptions(numCols, kToDefault);
+            vector<CompactTree> trees;
+            
+            vector< vector<Value> > trainValues = values;
+            train(trees, 2, 6, 0, false, 0.0, 1, -1, 25, -1, trainRows, availableColumns,
+                  selectColumns, trainValues, valueTypes, categoryMaps, targetColumn, colNames,
+                  imputeOptions, 1);
+            
+            double totalCost = 0.0;
+            for (size_t k = 0; k < trees.size(); k++) {
+                totalCost += averageSplitsVisited(values, valueTypes, validateRows, selectColumns,
+                                                  trees[k]);
+            }
+            
+            vector<size_t> keptTrees;
+            selectTrees(keptTrees, totalCost / 2, values, valueTypes, categoryMaps, targetColumn,
+                        validateRows, selectColumns, trees, colNames);
+            
+            double keptCost = 0.0;
+            for (size_t k = 0; k < keptTrees.size(); k++) {
+                ok = ok && (k == 0 || keptTrees[k - 1] < keptTrees[k]);
+                keptCost += averageSplitsVisited(values, valueTypes, validateRows, selectColumns,
+                                                 trees.at(keptTrees[k]));
+            }
+            
+            ok = ok && !keptTrees.empty() && keptCost <= totalCost / 2 + 1.0e-9;
+            
+            selectTrees(keptTrees, totalCost + 1.0, values, valueTypes, categoryMaps,
+                        targetColumn, validateRows, selectColumns, trees, colNames);
+            
+            vector<CompactTree> keptEnsemble;
+            for (size_t k = 0; k < keptTrees.size(); k++) {
+                keptEnsemble.push_back(trees.at(keptTrees[k]));
+            }
+            
+            vector< vector<Value> > allValues = values;
+            predict(allValues, valueTypes, categoryMaps, targetColumn, validateRows,
+                    selectColumns, trees, colNames);
+            
+            vector< vector<Value> > keptValues = values;
+            predict(keptValues, valueTypes, categoryMaps, targetColumn, validateRows,
+                    selectColumns, keptEnsemble, colNames);
+            
+            if (valueTypes[targetColumn] == kCategorical) {
+                ok = ok && compareMatch(keptValues[targetColumn], values[targetColumn],
+                                        validateRows) >=
+                           compareMatch(allValues[targetColumn], values[targetColumn],
+                                        validateRows);
+                
+            } else {
+                ok = ok && compareRms(keptValues[targetColumn], values[targetColumn],
+                                      validateRows) <=
+                           compareRms(allValues[targetColumn], values[targetColumn],
+                                      validateRows) + 1.0e-9;
+            }
+        }
+        
+        if (ok) passed++; else failed++;
+    }
     
     // ~~~~~~~~~~~~~~~~~~~~~~
     
@@ -407,7 +1865,7 @@ void cover_predict(bool verbose)
         train(trees, columnsPerTree, maxDepth, minDepth, doPrune, minImprovement, minLeafCount,
               maxSplitsPerNumericAttribute, maxTrees, maxNodes, selectRows, availableColumns,
               selectColumns, trainValues, valueTypes, categoryMaps, targetColumn, colNames,
-              imputeOptions);
+              imputeOptions, 1);
         
         vector< vector<Value> > predictValues = values;
         
@@ -433,7 +1891,7 @@ void cover_predict(bool verbose)
         train(trees, columnsPerTree, maxDepth, minDepth, doPrune, minImprovement, minLeafCount,
               maxSplitsPerNumericAttribute, maxTrees, maxNodes, selectRows, availableColumns,
               selectColumns, trainValues, valueTypes, categoryMaps, targetColumn, colNames,
-              imputeOptions);
+              imputeOptions, 1);
         
         vector< vector<Value> > predictValues = values;
         
@@ -491,12 +1949,14 @@ void cover_predict(bool verbose)
         trees[0].greaterOrNotIndex.assign(1, NO_INDEX);
         trees[0].toLessOrEqualIfNA.assign(1, true);
         trees[0].value.assign(1, v0.number);
+        trees[0].categorySetIndex.assign(1, NO_INDEX);
         
         trees[1].splitColIndex.assign(1, NO_INDEX);
         trees[1].lessOrEqualIndex.assign(1, NO_INDEX);
         trees[1].greaterOrNotIndex.assign(1, NO_INDEX);
         trees[1].toLessOrEqualIfNA.assign(1, true);
         trees[1].value.assign(1, v1.number);
+        trees[1].categorySetIndex.assign(1, NO_INDEX);
         
         predict(predictValues, valueTypes2, categoryMaps2, targetColumn, selectRows2, selectColumns,
                 trees, colNames2);
@@ -19,6 +19,74 @@
 #include "format.h"
 #include "train.h"
 
+#include <vector>
+
+// ========== Types ================================================================================
+
+// one node of a decision tree in a Predictor; child indexes refer to the combined node list of all
+// trees
+struct PredictorNode {
+    size_t col;                 // column of split attribute in row; unused if leaf
+    index_t lessOrEqualIndex;   // NO_INDEX if leaf
+    index_t greaterOrNotIndex;  // NO_INDEX if leaf
+    bool categorical;           // true if split attribute is categorical
+    bool toLessOrEqualIfNA;     // when have NA to compare with value, choose lessOrEqualIndex
+    Number value;               // value for leaf or split
+    index_t categorySet;        // index of split set in Predictor::categorySets, else NO_INDEX
+};
+typedef struct PredictorNode PredictorNode;
+
+// ========== Class Declarations ===================================================================
+
+// predicts response for single rows or small batches of rows given as arrays of doubles; prepared
+// once from ensemble of decision trees so that each call makes no heap allocations; not
+// thread-safe, so use one Predictor per thread
+class Predictor {
+public:
+    // construct from trained model
+    Predictor(const std::vector<ValueType>& valueTypes,
+              const std::vector<CategoryMaps>& categoryMaps,
+              size_t targetColumn,
+              const SelectIndexes& selectColumns,
+              const std::vector<CompactTree>& trees);
+    
+    virtual ~Predictor();
+    
+    // return count of entries expected in each row; includes entry for target column, which is
+    // ignored
+    size_t countColumns() const { return numColumns; };
+    
+    // predict response for one row; row has entry for each column, containing numeric value or
+    // category index, or NaN for NA; return numeric value or category index, or NaN if no trees
+    double predictRow(const double* row);
+    
+    // predict responses for rows stored one after another; write response for each row to results
+    void predictRows(const double* rows, size_t numRows, double* results);
+    
+    // return count of trees evaluated by all calls so far; for categorical target, evaluation of a
+    // row stops once votes of remaining trees cannot change result
+    size_t countTreesEvaluated() const { return treesEvaluated; };
+    
+private:
+    size_t numColumns;
+    ValueType targetType;
+    
+    // nodes of all trees, and index of root node of each tree
+    std::vector<PredictorNode> nodes;
+    std::vector<size_t> roots;
+    
+    // sets of categories for categorical splits on sets, as stored by appendCategorySet()
+    std::vector<unsigned int> categorySets;
+    
+    // for categorical target; index of first category, rank of each category name in alphabetical
+    // order for breaking ties, and vote counts reused by each call
+    index_t beginCategoryIndex;
+    std::vector<size_t> categoryRanks;
+    std::vector<index_t> counts;
+    
+    size_t treesEvaluated;
+};
+
 // ========== Function Headers =====================================================================
 
 // predict response from ensemble of decision trees and array of Values
@@ -31,6 +99,22 @@ void predict(std::vector< std::vector<Value> >& values,
              const std::vector<CompactTree>& trees,
              const std::vector<std::string>& colNames);
 
+// choose trees of ensemble to keep so that predicting a row visits at most maxSplitsPerRow split
+// nodes, on average over selected rows of values, which must include target column; trees are
+// added one at a time, each time the tree that most improves prediction of selected rows among
+// those that fit in rest of budget, using predictions from each tree made once beforehand; the
+// count of trees that predicts best is kept; return indexes of kept trees in ascending order
+void selectTrees(std::vector<size_t>& keptTrees,
+                 double maxSplitsPerRow,
+                 const std::vector< std::vector<Value> >& values,
+                 const std::vector<ValueType>& valueTypes,
+                 const std::vector<CategoryMaps>& categoryMaps,
+                 size_t targetColumn,
+                 const SelectIndexes& selectRows,
+                 const SelectIndexes& selectColumns,
+                 const std::vector<CompactTree>& trees,
+                 const std::vector<std::string>& colNames);
+
 // component tests
 void ctest_predict(int& totalPassed, int& totalFailed, bool verbose);
 
@@ -76,7 +76,7 @@ void pruneTree(TreeNode& root,
                const vector< vector<Value> >& values,
                const vector<ValueType>& valueTypes,
                size_t targetColumn,
-               const vector<CategoryMaps>& categoryMaps,
+               const vector<const CategoryMaps *>& categoryMaps,
                const vector< vector<size_t> >& sortedIndexes,
                const vector<string>& colNames)
 {
@@ -137,6 +137,41 @@ void pruneTree(TreeNode& root,
     }
 }
 
+// for pruning while growing tree; call when subtree beginning at branch node is complete, after
+// same call for each branch node in subtree; result is same as from pruneTree on whole tree
+void pruneCompletedSubtree(TreeNode *nodeP, ValueType targetValueType)
+{
+    // as in pruneTree, branch statistics are those of the subtree before any pruning, and tests
+    // are made deepest first
+    
+    TreeNode *lessOrEqualNode = nodeP->lessOrEqualNode;
+    TreeNode *greaterOrNotNode = nodeP->greaterOrNotNode;
+    
+    if (lessOrEqualNode != NULL) {
+        bool replace = false;
+        
+        switch (targetValueType) {
+            case kCategorical:
+                nodeP->branchCorrectCount = lessOrEqualNode->branchCorrectCount +
+                    greaterOrNotNode->branchCorrectCount;
+                
+                replace = testReplaceSubtreeCategorical(nodeP);
+                break;
+                
+            case kNumeric:
+                nodeP->branchSum2 = lessOrEqualNode->branchSum2 + greaterOrNotNode->branchSum2;
+                
+                replace = testReplaceSubtreeNumeric(nodeP);
+                break;
+        }
+        
+        if (replace) {
+            deleteSubtrees(nodeP);
+            nodeP->splitColIndex = NO_INDEX;
+        }
+    }
+}
+
 // ========== Local Functions ======================================================================
 
 void printLeaves(const set<TreeNode *> leafSet)
@@ -26,10 +26,14 @@ void pruneTree(TreeNode& root,
                const std::vector< std::vector<Value> >& values,
                const std::vector<ValueType>& valueTypes,
                size_t targetColumn,
-               const std::vector<CategoryMaps>& categoryMaps,
+               const std::vector<const CategoryMaps *>& categoryMaps,
                const std::vector< std::vector<size_t> >& sortedIndexes,
                const std::vector<std::string>& colNames);
 
+// for pruning while growing tree; call when subtree beginning at branch node is complete, after
+// same call for each branch node in subtree; result is same as from pruneTree on whole tree
+void pruneCompletedSubtree(TreeNode *nodeP, ValueType targetValueType);
+
 // component tests
 void ctest_prune(int& totalPassed, int& totalFailed, bool verbose);
 
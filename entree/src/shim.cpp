@@ -18,6 +18,13 @@
 #if RPACKAGE
 
 #include <sstream>
+#include <stdexcept>
+
+#if defined _WIN32 || defined _WIN64
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
 
 using namespace std;
 
@@ -36,6 +43,18 @@ RStreambuf gRStreambuf;
 
 std::ostream gRerr(&gRStreambuf);
 
+// true while threads of runParallel are working; set and cleared on R main thread only
+bool gRParallel = false;
+
+// output sent to gRerr while gRParallel, to be printed by endRParallel()
+string gRHeldOutput;
+
+#if defined _WIN32 || defined _WIN64
+CRITICAL_SECTION gRHeldOutputMutex;
+#else
+pthread_mutex_t gRHeldOutputMutex;
+#endif
+
 // ========== Local Classes ========================================================================
 
 // custom streambuf that sends text to R function Rprintf()
@@ -43,7 +62,8 @@ std::ostream gRerr(&gRStreambuf);
 RStreambuf::int_type RStreambuf::overflow(RStreambuf::int_type c)
 {
     if (c != EOF) {
-        Rprintf("%c", c);
+        char_type ch = traits_type::to_char_type(c);
+        xsputn(&ch, 1);
     }
             
     return c;
@@ -51,8 +71,19 @@ RStreambuf::int_type RStreambuf::overflow(RStreambuf::int_type c)
 
 std::streamsize RStreambuf::xsputn(const RStreambuf::char_type* s, std::streamsize n)
 {
-    if (n > 0) {
-        Rprintf("%.*s", n, s);
+    if (n > 0 && gRParallel) {
+#if defined _WIN32 || defined _WIN64
+        EnterCriticalSection(&gRHeldOutputMutex);
+        gRHeldOutput.append(s, (size_t)n);
+        LeaveCriticalSection(&gRHeldOutputMutex);
+#else
+        pthread_mutex_lock(&gRHeldOutputMutex);
+        gRHeldOutput.append(s, (size_t)n);
+        pthread_mutex_unlock(&gRHeldOutputMutex);
+#endif
+        
+    } else if (n > 0) {
+        Rprintf("%.*s", (int)n, s);
     }
     
     return n;
@@ -81,7 +112,13 @@ void r_logic_error(const std::string& path, int line, const std::string& msg)
     ostringstream oss;
     oss << msg << " at " << file << " line " << line << endl;
     
-    error(oss.str().c_str());
+    if (gRParallel) {
+        // caught by runParallel
+        throw logic_error(oss.str());
+        
+    } else {
+        error(oss.str().c_str());
+    }
 }
 
 // call R error function with custom message; include source file name and line number if DEBUG
@@ -107,7 +144,46 @@ void r_runtime_error(const std::string& path, int line, const std::string& msg)
     cerr << msg << " at " << file << " line " << line << endl;
 #endif
     
-    error(msg.c_str());
+    if (gRParallel) {
+        // caught by runParallel
+        throw runtime_error(msg);
+        
+    } else {
+        error(msg.c_str());
+    }
+}
+
+// while threads of runParallel are working, R must not be called: errors are thrown as
+// C++ exceptions instead of calling R error function, and output to gRerr is held; call on R
+// main thread
+void beginRParallel()
+{
+#if defined _WIN32 || defined _WIN64
+    InitializeCriticalSection(&gRHeldOutputMutex);
+#else
+    pthread_mutex_init(&gRHeldOutputMutex, NULL);
+#endif
+    
+    gRHeldOutput.clear();
+    gRParallel = true;
+}
+
+// after threads of runParallel are done, print output held since beginRParallel(); call on R main
+// thread
+void endRParallel()
+{
+    gRParallel = false;
+    
+#if defined _WIN32 || defined _WIN64
+    DeleteCriticalSection(&gRHeldOutputMutex);
+#else
+    pthread_mutex_destroy(&gRHeldOutputMutex);
+#endif
+    
+    if (!gRHeldOutput.empty()) {
+        Rprintf("%s", gRHeldOutput.c_str());
+        gRHeldOutput.clear();
+    }
 }
 
 
@@ -60,6 +60,15 @@ void r_logic_error(const std::string& path, int line, const std::string& msg);
 // is defined
 void r_runtime_error(const std::string& path, int line, const std::string& msg);
 
+// while threads of runParallel are working, R must not be called: errors are thrown as
+// C++ exceptions instead of calling R error function, and output to gRerr is held; call on R
+// main thread
+void beginRParallel();
+
+// after threads of runParallel are done, print output held since beginRParallel(); call on R main
+// thread
+void endRParallel();
+
 // ========== Globals ==============================================================================
 
 extern std::ostream gRerr;
@@ -18,9 +18,11 @@
 #include "utils.h"
 
 #include <algorithm>
+#include <cmath>
 #include <iomanip>
 #include <iostream>
 #include <set>
+#include <sstream>
 
 using namespace std;
 
@@ -29,17 +31,6 @@ using namespace std;
 // for debugging; print list of subsets
 void printSubsets(size_t columnCount, vector< vector<size_t> >& subsets);
 
-// recursively list all combinations of k items chosen from n items
-void iterateCombinations(size_t n,
-                         size_t k,
-                         index_t append,
-                         vector< vector<size_t> >& combinations,
-                         size_t& count,
-                         index_t limit);
-
-// for debugging; print list of combination
-void printCombinations(const vector< vector<size_t> >& combinations);
-
 // number of possible combinations of k items chosen from n items
 double nChooseK(size_t n, size_t k);
 
@@ -60,23 +51,29 @@ namespace ns_train {
 
 using namespace ns_train;
 
-// ========== Functions ============================================================================
+// ========== Classes ==============================================================================
 
-// make up to maxSubsets of columns, with column numbers in the range (0 to columnCount - 1),
-// where each subset contains columnsPerSubset columns; subsets are generated by ordered
-// deterministic permutations of small sets of column indexes
-void makeSelectColSubsets(size_t columnsCount,
-                          size_t columnsPerSubset,
-                          index_t maxSubsets,
-                          vector< vector<size_t> >& subsets)
+// generates the same subsets as makeSelectColSubsets, in the same order, one at a time, so that
+// subsets need not all be stored; combinations of column groups are stepped through in colex order
+// (the order of increasing bitmasks, as in Gosper's hack) without recursion
+
+// prepare to make up to maxSubsets subsets (no limit if NO_INDEX) of columnsPerSubset columns,
+// with column numbers in the range (0 to columnCount - 1)
+ColSubsetGenerator::ColSubsetGenerator(size_t columnCount,
+                                       size_t columnsPerSubset,
+                                       index_t maxSubsets) :
+columnCount(columnCount),
+columnsPerSubset(columnsPerSubset),
+maxSubsets(maxSubsets),
+pass(0),
+started(false),
+generated(0)
 {
-    subsets.clear();
-    
-    LOGIC_ERROR_IF(columnsPerSubset > columnsCount,
-                   "makeSelectColSubsets: columnsPerSubset > columnsCount")
+    LOGIC_ERROR_IF(columnsPerSubset > columnCount,
+                   "ColSubsetGenerator: columnsPerSubset > columnCount")
     
     if (gVerbose3) {
-        CERR << "makeSelectColSubsets(columnsCount = " << columnsCount <<
+        CERR << "ColSubsetGenerator(columnCount = " << columnCount <<
         ", columnsPerSubset = " << columnsPerSubset <<
         ", maxSubsets = " << maxSubsets << ")" << endl;
     }
@@ -84,7 +81,7 @@ void makeSelectColSubsets(size_t columnsCount,
     // the full set of columns is divided into groups, then to generate the subsets, combinations
     // of these groups are chosen
     
-    // if the columnsCount is not evenly divisible by the group size, there will be a number of
+    // if the columnCount is not evenly divisible by the group size, there will be a number of
     // full-sized groups, plus one additional short group
     
     // first step is to figure out the correct number of columns per group; we want smallest
@@ -96,17 +93,17 @@ void makeSelectColSubsets(size_t columnsCount,
     
     // values for next trial
     size_t columnsPerFullGroupNext = columnsPerSubset;
-    size_t nFullGroupsNext = columnsCount / columnsPerFullGroupNext;
-    size_t columnsPerShortGroupNext = columnsCount - nFullGroupsNext * columnsPerFullGroupNext;
+    size_t nFullGroupsNext = columnCount / columnsPerFullGroupNext;
+    size_t columnsPerShortGroupNext = columnCount - nFullGroupsNext * columnsPerFullGroupNext;
     size_t kChooseNext = 1;
     bool specialCaseShortGroupNext = columnsPerShortGroupNext != 0;
     
     // values for most-recent sucessful trial
     size_t nFullGroups = nFullGroupsNext;
-    size_t columnsPerFullGroup = columnsPerFullGroupNext;
+    columnsPerFullGroup = columnsPerFullGroupNext;
     size_t columnsPerShortGroup = columnsPerShortGroupNext;
-    size_t kChoose = kChooseNext;
-    bool specialCaseShortGroup = specialCaseShortGroupNext;
+    kChoose = kChooseNext;
+    specialCaseShortGroup = specialCaseShortGroupNext;
     
     if (gVerbose3) {
         if (specialCaseShortGroup) {
@@ -137,8 +134,8 @@ void makeSelectColSubsets(size_t columnsCount,
         // next trial; reduce group size by 1, see if number of combinations is <= maxSubsets
         
         columnsPerFullGroupNext--;
-        nFullGroupsNext = columnsCount / columnsPerFullGroupNext;
-        columnsPerShortGroupNext = columnsCount - nFullGroupsNext * columnsPerFullGroupNext;
+        nFullGroupsNext = columnCount / columnsPerFullGroupNext;
+        columnsPerShortGroupNext = columnCount - nFullGroupsNext * columnsPerFullGroupNext;
         kChooseNext = (columnsPerSubset + columnsPerFullGroupNext - 1) / columnsPerFullGroupNext;
         
         // special case is when there is a short group and (kChooseNext - 1) full groups plus the
@@ -212,75 +209,98 @@ void makeSelectColSubsets(size_t columnsCount,
         CERR << "done first loop" << endl;
     }
     
-    size_t count = 0;
-    vector< vector<size_t> > combinations;
-    
-    // next step, collect iterations
+    // combinations are of full groups, with short group added on second pass in special case;
+    // else short group (if any) is treated same as full group
     
     if (specialCaseShortGroup) {
         if (gVerbose3) {
-            CERR << "columnsCount = " << columnsCount << ", nFullGroups = " << nFullGroups <<
+            CERR << "columnCount = " << columnCount << ", nFullGroups = " << nFullGroups <<
             "[+1], columnsPerFullGroup = " << columnsPerFullGroup <<
             " [" << columnsPerShortGroup << "]" << endl;
         }
         
-        iterateCombinations(nFullGroups, kChoose, NO_INDEX, combinations, count, maxSubsets);
-        iterateCombinations(nFullGroups, kChoose, (index_t)nFullGroups, combinations, count,
-                            maxSubsets);
+        groupCount = nFullGroups;
         
     } else if (columnsPerShortGroup != 0) {
         if (gVerbose3) {
-            CERR << "columnsCount = " << columnsCount << ", nFullGroups = " << nFullGroups <<
+            CERR << "columnCount = " << columnCount << ", nFullGroups = " << nFullGroups <<
             " + 1, columnsPerFullGroup = " << columnsPerFullGroup <<
             " [" << columnsPerShortGroup << "]" << endl;
         }
         
-        iterateCombinations(nFullGroups + 1, kChoose, NO_INDEX, combinations, count, maxSubsets);
+        groupCount = nFullGroups + 1;
         
     } else {
         if (gVerbose3) {
-            CERR << "columnsCount = " << columnsCount << ", nFullGroups = " << nFullGroups <<
+            CERR << "columnCount = " << columnCount << ", nFullGroups = " << nFullGroups <<
             ", columnsPerFullGroup = " << columnsPerFullGroup << endl;
         }
         
-        iterateCombinations(nFullGroups, kChoose, NO_INDEX, combinations, count, maxSubsets);
-    }
-    
-    if (gVerbose2) {
-        CERR << "printCombinations:" << endl;
-        printCombinations(combinations);
+        groupCount = nFullGroups;
     }
     
-    // the combinations may contain more columns than columnsPerSubset, since columnsPerSubset may
-    // not be evenly divisable by the group size(s); if so, then need to select columns to use -
-    // this is done by iterating through combinations, and for each one, select the columnsPerSubset
-    // least-used columns available in the combination 
-    
     // construct vector of usage-pairs: each pair has column number as first value and accumulated
     // use count as second value (initialized to zero)
-    vector< pair<size_t, size_t> > usagePairs(columnsCount);
-    for (size_t k = 0; k < columnsCount; k++) {
+    usagePairs.resize(columnCount);
+    for (size_t k = 0; k < columnCount; k++) {
         usagePairs[k] = make_pair(k, 0);
     }
+}
+
+ColSubsetGenerator::~ColSubsetGenerator()
+{
+}
+
+// write next subset into param and return true, or return false if no more subsets
+bool ColSubsetGenerator::next(std::vector<size_t>& subset)
+{
+    bool available = maxSubsets == NO_INDEX || (index_t)generated < maxSubsets;
+    
+    if (!available) {
+        SKIP
+        
+    } else if (!started) {
+        started = true;
+        available = firstCombination();
+        
+    } else {
+        available = nextCombination();
+    }
+    
+    if (!available && started && pass == 0 && specialCaseShortGroup &&
+        (maxSubsets == NO_INDEX || (index_t)generated < maxSubsets)) {
+        // repeat iteration with the columns from the short group added
+        pass = 1;
+        available = firstCombination();
+    }
+    
+    subset.clear();
     
-    for (size_t k = 0; k < combinations.size(); k++) {
-        // for each combination...
+    if (available) {
+        // the combination may contain more columns than columnsPerSubset, since columnsPerSubset
+        // may not be evenly divisable by the group size(s); if so, select the columnsPerSubset
+        // least-used columns available in the combination
         
-        if (gVerbose2) CERR << k << "] ";
+        if (gVerbose2) CERR << generated << "] ";
         
         // build vector of the usage pairs for all columns available in this combination
         vector< pair<size_t, size_t> > nextUsagePairs;
         
-        for (size_t j = 0; j < combinations[k].size(); j++) {
-            size_t groupIndex = combinations[k][j];
-            if (gVerbose2) CERR << "(" << groupIndex << ") ";
+        for (size_t j = 0; j <= combination.size(); j++) {
+            // on second pass, short group follows groups in combination
+            bool inCombination = j < combination.size();
             
-            for (size_t colIndex = groupIndex * columnsPerFullGroup;
-                 colIndex < (groupIndex + 1) * columnsPerFullGroup && colIndex < columnsCount;
-                 colIndex++) {
+            if (inCombination || pass == 1) {
+                size_t groupIndex = inCombination ? combination[j] : groupCount;
+                if (gVerbose2) CERR << "(" << groupIndex << ") ";
                 
-                nextUsagePairs.push_back(usagePairs[colIndex]);
-                if (gVerbose2) CERR << colIndex % columnsCount << " ";
+                for (size_t colIndex = groupIndex * columnsPerFullGroup;
+                     colIndex < (groupIndex + 1) * columnsPerFullGroup && colIndex < columnCount;
+                     colIndex++) {
+                    
+                    nextUsagePairs.push_back(usagePairs[colIndex]);
+                    if (gVerbose2) CERR << colIndex % columnCount << " ";
+                }
             }
         }
         
@@ -293,20 +313,103 @@ void makeSelectColSubsets(size_t columnsCount,
         
         // pick the top columnsPerSubset entries to use in this subset; increment usage counts for
         // the columns that were picked
-        vector<size_t> nextSubset;
         for (size_t j = 0; j < columnsPerSubset; j++) {
             size_t index = nextUsagePairs[j].first;
-            nextSubset.push_back(index);
+            subset.push_back(index);
             usagePairs[index].second++;
         }
         
-        // save subset
-        subsets.push_back(nextSubset);
+        generated++;
     }
     
-    //    if (count < maxSubsets && nGroups < nGroupsNext) {
-    //        CERR << "try for " << maxSubsets - count << " more" << endl;
-    //    }
+    return available;
+}
+
+// return count of subsets that will be generated in all, found from count of combinations
+// without generating them
+size_t ColSubsetGenerator::total() const
+{
+    // each pass visits every combination of kChoose from groupCount, if there are any
+    double subsets = 0.0;
+    
+    if (groupCount > 0 && kChoose <= groupCount) {
+        subsets = floor(nChooseK(groupCount, kChoose) + 0.5) * (specialCaseShortGroup ? 2 : 1);
+    }
+    
+    if (maxSubsets != NO_INDEX && subsets > (double)maxSubsets) {
+        subsets = (double)maxSubsets;
+    }
+    
+    return (size_t)subsets;
+}
+
+// set combination to first of kChoose from groupCount; return false if there is none
+bool ColSubsetGenerator::firstCombination()
+{
+    combination.clear();
+    
+    // choosing no groups gives one empty combination, unless there are no groups
+    bool found = groupCount > 0 && kChoose <= groupCount;
+    
+    if (found) {
+        for (size_t k = 0; k < kChoose; k++) {
+            combination.push_back(k);
+        }
+    }
+    
+    return found;
+}
+
+// step combination to next in colex order; return false if there is none
+bool ColSubsetGenerator::nextCombination()
+{
+    // find lowest position that can be incremented without reaching the next position's value,
+    // increment it, and reset all lower positions to their lowest values
+    
+    bool found = false;
+    size_t position = 0;
+    
+    while (!found && position < combination.size()) {
+        size_t limit = position + 1 < combination.size() ? combination[position + 1] : groupCount;
+        
+        if (combination[position] + 1 < limit) {
+            found = true;
+            
+        } else {
+            position++;
+        }
+    }
+    
+    if (found) {
+        combination[position]++;
+        
+        for (size_t k = 0; k < position; k++) {
+            combination[k] = k;
+        }
+    }
+    
+    return found;
+}
+
+// ========== Functions ============================================================================
+
+// make up to maxSubsets of columns, with column numbers in the range (0 to columnCount - 1),
+// where each subset contains columnsPerSubset columns; subsets are generated by ordered
+// deterministic permutations of clusters of column indexes; to get subsets one at a time instead,
+// use ColSubsetGenerator
+void makeSelectColSubsets(size_t columnCount,
+                          size_t columnsPerSubset,
+                          index_t maxSubsets,
+                          vector< vector<size_t> >& subsets)
+{
+    subsets.clear();
+    
+    ColSubsetGenerator generator(columnCount, columnsPerSubset, maxSubsets);
+    
+    vector<size_t> subset;
+    while (generator.next(subset)) {
+        subsets.push_back(subset);
+    }
 }
 
 // ========== Local Functions ======================================================================
@@ -351,27 +454,6 @@ bool compareUsagePair(const pair<size_t, size_t>& i, const pair<size_t, size_t>&
     return result;
 }
 
-// for debugging; print list of combination
-void printCombinations(const vector< vector<size_t> >& combinations)
-{
-    for (size_t k = 0; k < combinations.size(); k++) {
-        bool first = true;
-        for (vector<size_t>::const_iterator iter = combinations[k].begin();
-             iter != combinations[k].end();
-             iter++) {
-            
-            if (!first) {
-                CERR << ", ";
-            } else {
-                first = false;
-            }
-            
-            CERR << *iter;
-        }
-        CERR << endl;
-    }
-}
-
 // number of possible combinations of k items chosen from n items
 double nChooseK(size_t n, size_t k)
 {
@@ -395,74 +477,6 @@ double nChooseK(size_t n, size_t k)
     return result;
 }
 
-// recursively list all combinations of k items chosen from n items
-// call initially:
-//      size_t count = 0;       // initialize to zero
-//      index_t limit = 10000;  // big number to prevent runaway
-//
-//      vector< vector<size_t> > combinations; // empty vector, to be filled in
-//
-//      iterateCombinations(n, k, NO_INDEX, combinations, count, limit);
-//
-void iterateCombinations(size_t n,
-                         size_t k,
-                         index_t append,
-                         vector< vector<size_t> >& combinations,
-                         size_t& count,
-                         index_t limit)
-{
-    vector< vector<size_t> > nextCombinations;
-    
-    if (n == 0) {
-        // done
-        
-    } else if (k == 0) {
-        // choose no items
-        vector<size_t> combination;
-        
-        if (limit == NO_INDEX || (index_t)count < limit) {
-            nextCombinations.push_back(combination);
-            count++;
-        }
-        
-    } else if (n == k) {
-        // choose all items
-        vector<size_t> combination;
-        for (size_t i = 0; i < k; i++) {
-            combination.push_back(i);
-        }
-        
-        if (limit == NO_INDEX || (index_t)count < limit) {
-            nextCombinations.push_back(combination);
-            count++;
-        }
-        
-    } else {
-        // recursion happens here
-        
-        // add all combinations of size k that don't contain last index
-        if (limit == NO_INDEX || (index_t)count < limit) {
-            iterateCombinations(n - 1, k, NO_INDEX, nextCombinations, count, limit); 
-        }
-        
-        // add all combinations of size k that do contain last index, by adding all combinations
-        // of size k - 1 that don't contain last index, then appending last index to them
-        if (limit == NO_INDEX || (index_t)count < limit) {
-            iterateCombinations(n - 1, k - 1, (index_t)n - 1, nextCombinations, count, limit); 
-        }
-    }
-    
-    if (append != NO_INDEX) {
-        // append specified index to each combination generated in this pass
-        for (size_t i = 0; i < nextCombinations.size(); i++) {
-            nextCombinations[i].push_back((size_t)append);
-        }
-    }
-    
-    // add all combinations generated in this pass
-    combinations.insert(combinations.end(), nextCombinations.begin(), nextCombinations.end());
-}
-
 // ========== Tests ================================================================================
 
 // component tests
@@ -478,10 +492,116 @@ void ctest_subsets(int& totalPassed, int& totalFailed, bool verbose)
     // printSubsets
     
     // ~~~~~~~~~~~~~~~~~~~~~~
-    // iterateCombinations
+    // ColSubsetGenerator
+    
+    {
+        // same subsets, in same order, as previous recursive enumeration of all combinations
+        
+        size_t expected[6][4] = {
+            { 0, 1, 2, 3 },
+            { 6, 7, 8, 0 },
+            { 4, 5, 3, 6 },
+            { 9, 1, 2, 0 },
+            { 4, 5, 9, 3 },
+            { 7, 8, 6, 9 }
+        };
+        
+        ColSubsetGenerator generator(10, 4, 6);
+        
+        bool same = true;
+        vector<size_t> subset;
+        for (size_t k = 0; k < 6; k++) {
+            same = same && generator.next(subset) &&
+                   subset == vector<size_t>(expected[k], expected[k] + 4);
+        }
+        
+        // stops at limit, and stays stopped
+        same = same && !generator.next(subset) && !generator.next(subset);
+        same = same && generator.count() == 6 && subset.empty();
+        
+        if (same) passed++; else failed++;
+    }
     
-    // ~~~~~~~~~~~~~~~~~~~~~~
-    // printCombinations
+    {
+        // same subsets, in same order, as previous recursive enumeration, for several shapes and
+        // limits; each subset is written as its column numbers, subsets separated by spaces
+        
+        struct {
+            size_t columnCount;
+            size_t columnsPerSubset;
+            index_t maxSubsets;
+            const char *expected;
+        } cases[] = {
+            { 5, 2, 10, "01 20 12 30 31 23 40 41 42 34" },
+            { 6, 3, 5, "012 450 324" },
+            { 6, 3, 20, "012 301 230 123 401 420 412 340 341 234 501 520 512 530 531 523 450 451 "
+                        "452 345" },
+            { 4, 1, 4, "0 1 2 3" },
+            { 7, 4, 8, "0123 4501 2345 6012 6450 3624" },
+            { 9, 2, 12, "01 23 45 67 80 23 45 67" },
+            { 5, 2, NO_INDEX, "01 23 40 23" }
+        };
+        
+        bool same = true;
+        for (size_t caseIndex = 0; caseIndex < sizeof(cases) / sizeof(cases[0]); caseIndex++) {
+            ColSubsetGenerator generator(cases[caseIndex].columnCount,
+                                         cases[caseIndex].columnsPerSubset,
+                                         cases[caseIndex].maxSubsets);
+            
+            ostringstream oss;
+            vector<size_t> subset;
+            size_t count = 0;
+            while (generator.next(subset)) {
+                oss << (count == 0 ? "" : " ");
+                for (size_t k = 0; k < subset.size(); k++) {
+                    oss << subset[k];
+                }
+                
+                count++;
+            }
+            
+            vector< vector<size_t> > subsets;
+            makeSelectColSubsets(cases[caseIndex].columnCount, cases[caseIndex].columnsPerSubset,
+                                 cases[caseIndex].maxSubsets, subsets);
+            
+            same = same && oss.str() == cases[caseIndex].expected && count == generator.count() &&
+                   count == generator.total() && count == subsets.size();
+        }
+        
+        if (same) passed++; else failed++;
+    }
+    
+    {
+        // with or without limit, each subset has distinct columns in range, and total() counts
+        // subsets without generating them
+        
+        index_t limits[] = { NO_INDEX, 1, 7, 40 };
+        
+        bool same = true;
+        for (size_t columnCount = 1; columnCount <= 12; columnCount++) {
+            for (size_t columnsPerSubset = 1; columnsPerSubset <= columnCount; columnsPerSubset++) {
+                for (size_t limitIndex = 0; limitIndex < 4; limitIndex++) {
+                    ColSubsetGenerator generator(columnCount, columnsPerSubset,
+                                                 limits[limitIndex]);
+                    size_t total = generator.total();
+                    
+                    vector<size_t> subset;
+                    size_t count = 0;
+                    while (generator.next(subset)) {
+                        set<size_t> distinct(subset.begin(), subset.end());
+                        
+                        same = same && distinct.size() == columnsPerSubset &&
+                               *distinct.rbegin() < columnCount;
+                        count++;
+                    }
+                    
+                    same = same && count == generator.count() && count == total && count > 0;
+                }
+            }
+        }
+        
+        if (same) passed++; else failed++;
+    }
     
     // ~~~~~~~~~~~~~~~~~~~~~~
     // nChooseK
@@ -504,7 +624,6 @@ void cover_subsets(bool verbose)
 {
     // ~~~~~~~~~~~~~~~~~~~~~~
     // makeSelectColSubsets
-    // iterateCombinations
     // nChooseK
     
     vector< vector<size_t> > subsets;
@@ -521,14 +640,18 @@ void cover_subsets(bool verbose)
     }
     
     // ~~~~~~~~~~~~~~~~~~~~~~
-    // printCombinations
+    // ColSubsetGenerator
     
-    if (verbose) {
-        size_t count = 0;
-        vector< vector<size_t> > combinations;
-        iterateCombinations(5, 3, NO_INDEX, combinations, count, 100);
+    {
+        ColSubsetGenerator generator(8, 3, NO_INDEX);
+        
+        vector<size_t> subset;
+        while (generator.next(subset)) {
+            SKIP
+        }
         
-        printCombinations(combinations);
+        generator.next(subset);
+        generator.count();
     }
     
     // ~~~~~~~~~~~~~~~~~~~~~~
@@ -19,13 +19,68 @@
 #include "format.h"
 
 #include <string>
+#include <utility>
 #include <vector>
 
+// ========== Class Declarations ===================================================================
+
+// generates the same subsets as makeSelectColSubsets, in the same order, one at a time, so that
+// subsets need not all be stored; combinations of column groups are stepped through in colex order
+// (the order of increasing bitmasks, as in Gosper's hack) without recursion
+class ColSubsetGenerator {
+public:
+    // prepare to make up to maxSubsets subsets (no limit if NO_INDEX) of columnsPerSubset columns,
+    // with column numbers in the range (0 to columnCount - 1)
+    ColSubsetGenerator(size_t columnCount, size_t columnsPerSubset, index_t maxSubsets);
+    virtual ~ColSubsetGenerator();
+    
+    // write next subset into param and return true, or return false if no more subsets
+    bool next(std::vector<size_t>& subset);
+    
+    // return count of subsets generated so far
+    size_t count() const { return generated; };
+    
+    // return count of subsets that will be generated in all, found from count of combinations
+    // without generating them
+    size_t total() const;
+    
+private:
+    size_t columnCount;
+    size_t columnsPerSubset;
+    index_t maxSubsets;
+    
+    // columns are divided into groups of columnsPerFullGroup columns (last group may be short);
+    // each subset is drawn from kChoose groups chosen from the first groupCount groups, plus the
+    // short group on second pass if specialCaseShortGroup
+    size_t columnsPerFullGroup;
+    size_t groupCount;
+    size_t kChoose;
+    bool specialCaseShortGroup;
+    
+    // current combination of group indexes, in ascending order
+    std::vector<size_t> combination;
+    
+    // 0 for first pass through combinations, 1 for second pass with short group added
+    int pass;
+    bool started;
+    size_t generated;
+    
+    // usage pairs (column index, usage count), indexed by column index
+    std::vector< std::pair<size_t, size_t> > usagePairs;
+    
+    // set combination to first of kChoose from groupCount; return false if there is none
+    bool firstCombination();
+    
+    // step combination to next in colex order; return false if there is none
+    bool nextCombination();
+};
+
 // ========== Function Headers =====================================================================
 
 // make up to maxSubsets of columns, with column numbers in the range (0 to columnCount - 1),
 // where each subset contains columnsPerSubset columns; subsets are generated by ordered
-// deterministic permutations of clusters of column indexes
+// deterministic permutations of clusters of column indexes; to get subsets one at a time instead,
+// use ColSubsetGenerator
 void makeSelectColSubsets(size_t columnCount,
                           size_t columnsPerSubset,
                           index_t maxSubsets,
@@ -19,10 +19,13 @@
 #include "prune.h"
 #include "subsets.h"
 
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <iomanip>
 #include <iostream>
 #include <limits>
+#include <map>
 #include <set>
 #include <sstream>
 
@@ -36,30 +39,167 @@ using namespace std;
 struct ValueAndMeasure {
     Value value;
     double measure;
+    Value naValue;  // value imputed for NA at this node if imputing per branch, else NA
+    
+    // for categorical split on set of categories, set of categories that go to less-or-equal
+    // branch, as stored by appendCategorySet(), and value is first category in set; else empty
+    vector<unsigned int> categorySet;
 };
 typedef struct ValueAndMeasure ValueAndMeasure;
 
+// comparison operator for sorting slots of categories in ascending order of keys, using category
+// name as tiebreaker, so that names are compared only for equal keys
+struct CategoryKeyLess {
+    const vector<double> *keys;
+    const vector<index_t> *categories;
+    const CategoryMaps *categoryMaps;
+    
+    bool operator ()(size_t i, size_t j) const {
+        return (*keys)[i] < (*keys)[j] ||
+            ((*keys)[i] == (*keys)[j] &&
+             categoryMaps->getCategoryForIndex((*categories)[i]) <
+             categoryMaps->getCategoryForIndex((*categories)[j]));
+    }
+};
+typedef struct CategoryKeyLess CategoryKeyLess;
+
+// for train; copies of the columns used by one tree, packed together so that growing the tree
+// touches only the tree's own columns; block column k holds selected column subsetIndexes[k] of
+// the tree's subset, and last block column holds target column; category maps are not copied but
+// point to those of train
+struct TreeBlock {
+    vector< vector<Value> > values;
+    vector<ValueType> valueTypes;
+    vector<const CategoryMaps *> categoryMaps;
+    vector< vector<size_t> > sortedIndexes;
+    vector<string> colNames;
+    vector<Value> imputedValues;
+    vector<ImputeOption> imputeOptions;
+    SelectIndexes selectColumns;    // all block columns except target column
+    vector<size_t> subsetIndexes;   // 0 to count of subset columns - 1
+    size_t targetColumn;
+};
+typedef struct TreeBlock TreeBlock;
+
+// for train; trees grown together on threads of runParallel, one per column subset of batch, each
+// in its own block; other members point to arguments of train shared by all threads
+struct TrainTreesWork {
+    vector< vector<size_t> > subsets;
+    vector<TreeBlock> blocks;
+    vector<CompactTree> trees;
+    vector<int> maxDepthUsed;
+    vector<size_t> nodesSplit;
+    vector<size_t> rowsScanned;
+    
+    const SelectIndexes *selectRows;
+    const SelectIndexes *selectColumns;
+    size_t targetColumn;
+    const vector< vector<Value> > *values;
+    const vector<ValueType> *valueTypes;
+    const vector<CategoryMaps> *categoryMaps;
+    const vector< vector<size_t> > *sortedIndexes;
+    const vector<string> *colNames;
+    const vector<Value> *imputedValues;
+    const vector<ImputeOption> *imputeOptions;
+    
+    int maxDepth;
+    int minDepth;
+    int maxNodes;
+    bool doPrune;
+    double minImprovement;
+    index_t minLeafCount;
+    index_t maxSplitsPerNumericAttribute;
+};
+typedef struct TrainTreesWork TrainTreesWork;
+
+// for compressTree; one node of CompactTree, with indexes of branches and category set referring
+// to compressed tree, and value from numberForType(), so that identical subtrees have equal keys
+struct CompactNodeKey {
+    index_t splitColIndex;
+    index_t lessOrEqualIndex;
+    index_t greaterOrNotIndex;
+    bool toLessOrEqualIfNA;
+    Number value;
+    index_t categorySetIndex;
+    
+    bool operator <(const CompactNodeKey& other) const {
+        bool result;
+        
+        if (splitColIndex != other.splitColIndex) {
+            result = splitColIndex < other.splitColIndex;
+            
+        } else if (lessOrEqualIndex != other.lessOrEqualIndex) {
+            result = lessOrEqualIndex < other.lessOrEqualIndex;
+            
+        } else if (greaterOrNotIndex != other.greaterOrNotIndex) {
+            result = greaterOrNotIndex < other.greaterOrNotIndex;
+            
+        } else if (toLessOrEqualIfNA != other.toLessOrEqualIfNA) {
+            result = toLessOrEqualIfNA < other.toLessOrEqualIfNA;
+            
+        } else if (categorySetIndex != other.categorySetIndex) {
+            result = categorySetIndex < other.categorySetIndex;
+            
+        } else {
+            result = memcmp(&value, &other.value, sizeof(Number)) < 0;
+        }
+        
+        return result;
+    }
+};
+typedef struct CompactNodeKey CompactNodeKey;
+
 // ========== Local Headers ========================================================================
 
+// for train; grow tree for one column subset of batch, called on training thread; must not call R
+void trainTreeWork(size_t item, void *context);
+
+// for train; fill in rates and estimate of progress, and pass it to gTrainProgressFunction
+void reportTrainProgress(TrainProgress& progress, double elapsedSeconds);
+
+// for ctest_train; TrainProgressFunction that appends progress to vector<TrainProgress> at context
+void collectTrainProgress(const TrainProgress& progress, void *context);
+
+// for train; copy the subset columns (subsetIndexes are indexes into selectColumns) and target
+// column into block, reusing storage already in block; category maps are pointed to, not copied
+void fillTreeBlock(const vector<size_t>& subsetIndexes,
+                   const SelectIndexes& selectColumns,
+                   size_t targetColumn,
+                   const vector< vector<Value> >& values,
+                   const vector<ValueType>& valueTypes,
+                   const vector<CategoryMaps>& categoryMaps,
+                   const vector< vector<size_t> >& sortedIndexes,
+                   const vector<string>& colNames,
+                   const vector<Value>& imputedValues,
+                   const vector<ImputeOption>& imputeOptions,
+                   TreeBlock& block);
+
+// for train; change split columns of tree grown from TreeBlock, which are indexes into block
+// columns, into indexes into selectColumns
+void unpackTreeColumns(CompactTree& compactTree, const vector<size_t>& subsetIndexes);
+
 // create one decision tree using the specified subset of columns of the Values array
 void evaluateTree(CompactTree& compactTree,
                   int maxDepth,
                   int maxNodes,
                   int& maxDepthUsed,
+                  size_t& rowsScanned,
                   bool doPrune,
+                  bool pruneAfterGrowing,     // for testing; prune with pruneTree() when tree done
                   double minImprovement,
                   index_t minLeafCount,
                   index_t maxSplitsPerNumericAttribute,
                   const vector< vector<Value> >& values,
                   const vector<ValueType>& valueTypes, 
-                  const vector<CategoryMaps>& categoryMaps,
+                  const vector<const CategoryMaps *>& categoryMaps,
                   const vector<size_t>& subsetIndexes,
                   const SelectIndexes& selectRows,
                   const SelectIndexes& selectColumns,
                   size_t targetColumn,
                   const vector< vector<size_t> >& sortedIndexes,
                   const vector<string>& colNames,
-                  const vector<Value>& imputedValues);
+                  const vector<Value>& imputedValues,
+                  const vector<ImputeOption>& imputeOptions);
 
 // try improving the decision tree by splitting the specified leaf node; if success, return true;
 // if not, return false and leave leaf unsplit
@@ -67,7 +207,7 @@ bool improveLeaf(TreeNode *nodeP,
                  const vector<size_t>& subsetIndexes,
                  const vector< vector<Value> >& values,
                  const vector<ValueType>& valueTypes,
-                 const vector<CategoryMaps>& categoryMaps,
+                 const vector<const CategoryMaps *>& categoryMaps,
                  const SelectIndexes& selectColumns,
                  size_t targetColumn,
                  const vector< vector<size_t> >& sortedIndexes,
@@ -75,18 +215,22 @@ bool improveLeaf(TreeNode *nodeP,
                  double minImprovement,
                  index_t minLeafCount,
                  index_t maxSplitsPerNumericAttribute,
-                 const vector<Value>& imputedValues);
+                 const vector<Value>& imputedValues,
+                 const vector<ImputeOption>& imputeOptions,
+                 size_t& nextIndex);
 
 // recursively improve subtree from specified leaf node (called initially on the root node)
+// and, if doPrune, prune each subtree as soon as it is complete
 void improveSubtree(TreeNode *nodeP,
                     int depth,
                     int maxDepth,
                     int maxNodes,
                     int& maxDepthUsed,
+                    bool doPrune,
                     const vector<size_t>& subsetIndexes,
                     const vector< vector<Value> >& values,
                     const vector<ValueType>& valueTypes,
-                    const vector<CategoryMaps>& categoryMaps,
+                    const vector<const CategoryMaps *>& categoryMaps,
                     const SelectIndexes& selectColumns,
                     size_t targetColumn,
                     const vector< vector<size_t> >& sortedIndexes,
@@ -95,14 +239,17 @@ void improveSubtree(TreeNode *nodeP,
                     index_t minLeafCount,
                     index_t maxSplitsPerNumericAttribute,
                     index_t& finalLeafCount,
-                    const vector<Value>& imputedValues);
+                    size_t& rowsScanned,
+                    const vector<Value>& imputedValues,
+                    const vector<ImputeOption>& imputeOptions,
+                    size_t& nextIndex);
 
 // try to improve leaf that has potential for improvement (i.e., not already perfect)
 bool improveImperfectLeaf(TreeNode *nodeP,
                           const vector<size_t>& subsetIndexes,
                           const vector< vector<Value> >& values,
                           const vector<ValueType>& valueTypes,
-                          const vector<CategoryMaps>& categoryMaps,
+                          const vector<const CategoryMaps *>& categoryMaps,
                           const SelectIndexes& selectColumns,
                           size_t targetColumn,
                           const vector< vector<size_t> >& sortedIndexes,
@@ -110,14 +257,16 @@ bool improveImperfectLeaf(TreeNode *nodeP,
                           double minImprovement,
                           index_t minLeafCount,
                           index_t maxSplitsPerNumericAttribute,
-                          const vector<Value>& imputedValues);
+                          const vector<Value>& imputedValues,
+                          const vector<ImputeOption>& imputeOptions,
+                          size_t& nextIndex);
 
 // recursively count all nodes in the subtree beginning at specified node
 // (if leaf node then count = 1)
 size_t countNodes(const TreeNode *nodeP);
 
 // recursively assign a serial number to all nodes in the subtree beginning at specified node 
-void indexNodes(TreeNode *nodeP);
+void indexNodes(TreeNode *nodeP, size_t& nextIndex);
 
 // create a CompactTree from the decision tree beginning at the specified root node
 void makeCompactTree(CompactTree& compactTree, TreeNode& root);
@@ -131,7 +280,7 @@ void printTree(const TreeNode *nodeP,
                const vector<ValueType>& valueTypes,
                size_t targetColumn,
                const SelectIndexes& selectColumns,
-               const vector<CategoryMaps>& categoryMaps,
+               const vector<const CategoryMaps *>& categoryMaps,
                const vector<string>& colNames,
                int indent, index_t count);
 
@@ -139,7 +288,7 @@ void printTree(const TreeNode *nodeP,
 double selectRowsEntropy(const SelectIndexes& selectRows,
                          const vector< vector<Value> >& values,
                          size_t targetColumn,
-                         const vector<CategoryMaps>& categoryMaps,
+                         const vector<const CategoryMaps *>& categoryMaps,
                          vector<int>& targetCategoryCounts);
 
 // calculate entropy for set of category counts
@@ -164,25 +313,104 @@ double sdForSplit(double lessThanOrEqualSum,
                   double totalSum2,
                   int totalCount);
 
-// get the best split for the specified numeric column
+// get the best split for the specified numeric column; if imputeOption is a branch option, NA rows
+// are handled as one group with the mean or median of the other selected rows, returned in naValue
 ValueAndMeasure getBestNumericalSplit(size_t col,
                                       size_t targetColumn,
                                       const SelectIndexes& selectRows,
                                       const vector< vector<Value> >& values,
                                       const vector<ValueType>& valueTypes,
-                                      const vector<CategoryMaps>& categoryMaps,
+                                      const vector<const CategoryMaps *>& categoryMaps,
                                       const vector< vector<size_t> >& sortedIndexes,
-                                      const vector<string>& colNames);
+                                      ImputeOption imputeOption);
 
-// get the best split for the specified categorical column
+// get the best split for the specified categorical column; if imputeOption is a branch option, NA
+// rows are counted with the modal category of the other selected rows, returned in naValue; takes
+// time and space in proportion to count of selected rows, not count of categories in column
 ValueAndMeasure getBestCategoricalSplit(size_t col,
                                         size_t targetColumn,
                                         const SelectIndexes& selectRows,
                                         const vector< vector<Value> >& values,
                                         const vector<ValueType>& valueTypes,
-                                        const vector<CategoryMaps>& categoryMaps,
-                                        const vector< vector<size_t> >& sortedIndexes,
-                                        const vector<string>& colNames);
+                                        const vector<const CategoryMaps *>& categoryMaps,
+                                        ImputeOption imputeOption);
+
+// return category with biggest count, or NA if all counts are zero; categoryCounts has count for
+// each category in categories; in case of tie, choose category with name that sorts earlier
+// alphabetically, as modeValue() does
+Value modalCategory(const vector<int>& categoryCounts,
+                    const vector<index_t>& categories,
+                    const CategoryMaps& categoryMaps);
+
+// calculate weighted standard deviation for a binary split of values plus a group of NA rows,
+// putting NA rows in the branch that gives the smaller result, or if equal then in the branch with
+// more other rows; set naToLessOrEqual for the branch chosen
+double sdForSplitWithNa(double lessThanOrEqualSum,
+                        double lessThanOrEqualSum2,
+                        int lessThanOrEqualCount,
+                        double naSum,
+                        double naSum2,
+                        int naCount,
+                        double totalSum,
+                        double totalSum2,
+                        int totalCount,
+                        bool& naToLessOrEqual);
+
+// calculate entropy for a binary split of counts plus counts for NA rows, putting NA rows in the
+// branch that gives the smaller result, or if equal then in the branch with more other rows; set
+// naToLessOrEqual for the branch chosen; naLessOrEqualCounts is for temporary use
+double entropyForSplitWithNa(const vector<int>& lessThanOrEqualCounts,
+                             const vector<int>& naCounts,
+                             const vector<int>& totalCounts,
+                             vector<int>& naLessOrEqualCounts,
+                             bool& naToLessOrEqual);
+
+// return Value to stand for NA rows of numeric split column: less than or equal to any split value
+// if naToLessOrEqual, else greater
+Value learnedNumericalNaValue(bool naToLessOrEqual);
+
+// return Value to stand for NA rows of categorical split column: equal to splitCategory if
+// naToLessOrEqual, else not equal to any category
+Value learnedCategoricalNaValue(bool naToLessOrEqual, index_t splitCategory);
+
+// for categorical split column and numeric target column; sort categories present at node by mean
+// of target, then try each division of sorted list into two sets, which finds best division in one
+// pass (Breiman et al. 1984); if a set of more than one category beats single-category bestSplit,
+// replace bestSplit and naValue; statistics are indexed by slot, and categories gives category in
+// each slot
+void getBestCategorySetForSd(const vector<double>& categorySum,
+                             const vector<double>& categorySum2,
+                             const vector<int>& categoryCount,
+                             const vector<index_t>& categories,
+                             double naSum,
+                             double naSum2,
+                             int naCount,
+                             double totalSum,
+                             double totalSum2,
+                             int totalCount,
+                             bool learnBranch,
+                             const CategoryMaps& categoryMaps,
+                             ValueAndMeasure& bestSplit,
+                             Value& naValue);
+
+// for categorical split column and categorical target column; as getBestCategorySetForSd(), but
+// sort categories by fraction of rows in most common target category of node, which finds best
+// division for two target categories, and a good one for more; slotTargetCounts has count for each
+// target category for each slot in turn, and categories gives category in each slot
+void getBestCategorySetForEntropy(const vector<int>& slotTargetCounts,
+                                  const vector<index_t>& categories,
+                                  const vector<int>& naTargetCategoryCounts,
+                                  const vector<int>& totalTargetCategoryCounts,
+                                  bool learnBranch,
+                                  const CategoryMaps& categoryMaps,
+                                  ValueAndMeasure& bestSplit,
+                                  Value& naValue);
+
+// return true if rows with category go to less-or-equal branch of split on splitValue, or on
+// splitCategorySet if not empty
+bool isLessOrEqualCategory(index_t category,
+                           const Value& splitValue,
+                           const vector<unsigned int>& splitCategorySet);
 
 // ========== Globals ========================================================================
 
@@ -205,11 +433,15 @@ namespace ns_train {
 
 using namespace ns_train;
 
-size_t gNextIndex = 0;  // TODO fix for thread-safety
+// set by setTrainProgress; no progress is reported if function is NULL
+TrainProgressFunction gTrainProgressFunction = NULL;
+void *gTrainProgressContext = NULL;
+double gTrainProgressInterval = 0.0;
 
 // ========== Functions ============================================================================
 
-// train ensemble of decision trees
+// train ensemble of decision trees; trees are grown on up to numThreads threads, or one per
+// processor if numThreads is 0, with same result for any numThreads
 void train(std::vector<CompactTree>& trees, 
            index_t columnsPerTree,
            int maxDepth,
@@ -228,7 +460,8 @@ void train(std::vector<CompactTree>& trees,
            std::vector<CategoryMaps>& categoryMaps,
            size_t targetColumn,
            const std::vector<std::string>& colNames,
-           std::vector<ImputeOption>& imputeOptions)
+           std::vector<ImputeOption>& imputeOptions,
+           size_t numThreads)
 {
     if (gVerbose) {
         CERR << "train(maxDepth = " << maxDepth << ", minDepth = " << minDepth <<
@@ -377,12 +610,16 @@ void train(std::vector<CompactTree>& trees,
     // make sortedIndexes and impute values
     
     vector< vector<size_t> > sortedIndexes;
-    makeSortedIndexes(values, valueTypes, selectColumns, sortedIndexes);
+    INSTRUMENT_TIME_BEGIN(sortStart)
+    makeSortedIndexes(values, valueTypes, selectColumns, sortedIndexes, numThreads);
+    INSTRUMENT_TIME_END(kSortMicroseconds, sortStart)
 
     vector<Value> imputedValues;
     
+    INSTRUMENT_TIME_BEGIN(imputeStart)
     imputeValues(imputeOptions, valueTypes, values, selectRows, selectColumns, categoryMaps,
                  sortedIndexes, imputedValues);
+    INSTRUMENT_TIME_END(kImputeMicroseconds, imputeStart)
 
     if (gVerbose4) {
         for (size_t k = 0; k < categoryMaps.size(); k++) {
@@ -392,37 +629,105 @@ void train(std::vector<CompactTree>& trees,
     }
 
     // ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~
-    // get column subsets
-    
-    vector< vector<size_t> > subsets;
-    
-    makeSelectColSubsets((size_t)numSelectedCols, (size_t)columnsPerTree, maxTrees, subsets);
+    // make decision tree for each column subset; subsets are generated one batch at a time, so
+    // that they are not all stored at once; trees of batch are grown on separate threads, each
+    // from copies of its own columns, packed into its own block, and are kept in order of subsets
     
-    if (gVerbose) CERR << localTimeString(t) << " done makeSelectColSubsets" << endl;
+    if (numThreads == 0) {
+        numThreads = countProcessors();
+    }
     
-    // ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~
-    // make decision tree for each subset
+    ColSubsetGenerator subsetGenerator((size_t)numSelectedCols, (size_t)columnsPerTree, maxTrees);
+    
+    TrainTreesWork work;
+    work.subsets.resize(numThreads);
+    work.blocks.resize(numThreads);
+    work.trees.resize(numThreads);
+    work.maxDepthUsed.resize(numThreads);
+    work.nodesSplit.resize(numThreads);
+    work.rowsScanned.resize(numThreads);
+    
+    work.selectRows = &selectRows;
+    work.selectColumns = &selectColumns;
+    work.targetColumn = targetColumn;
+    work.values = &values;
+    work.valueTypes = &valueTypes;
+    work.categoryMaps = &categoryMaps;
+    work.sortedIndexes = &sortedIndexes;
+    work.colNames = &colNames;
+    work.imputedValues = &imputedValues;
+    work.imputeOptions = &imputeOptions;
+    
+    work.maxDepth = maxDepth;
+    work.minDepth = minDepth;
+    work.maxNodes = (int)maxNodes;
+    work.doPrune = doPrune;
+    work.minImprovement = minImprovement;
+    work.minLeafCount = minLeafCount;
+    work.maxSplitsPerNumericAttribute = maxSplitsPerNumericAttribute;
 
+    // progress is reported between batches, on calling thread, when at least
+    // gTrainProgressInterval seconds have passed since last report, and once when all are done
+    TrainProgress progress;
+    double startSeconds = 0.0;
+    double reportSeconds = 0.0;
+    
+    if (gTrainProgressFunction != NULL) {
+        progress.treesCompleted = 0;
+        progress.treesKept = 0;
+        progress.nodesSplit = 0;
+        progress.rowsScanned = 0;
+        progress.elapsedSeconds = 0.0;
+        progress.rowsPerSecond = 0.0;
+        progress.secondsRemaining = -1.0;
+        
+        progress.treesTotal = subsetGenerator.total();
+        
+        startSeconds = wallSeconds();
+        reportSeconds = startSeconds;
+    }
+    
     trees.clear();
-    for (size_t subsetIndex = 0; subsetIndex < subsets.size(); subsetIndex++) {
-        if (gVerbose3) CERR << "(" << subsetIndex << ") ";
-
-        CompactTree compactTree;
-        size_t treeIndex = trees.size();
-        trees.push_back(compactTree);
+    bool moreSubsets = true;
+    while (moreSubsets) {
+        size_t batchSize = 0;
+        while (batchSize < numThreads && subsetGenerator.next(work.subsets[batchSize])) {
+            if (gVerbose3) CERR << "(" << subsetGenerator.count() - 1 << ") ";
+            batchSize++;
+        }
+        
+        moreSubsets = batchSize == numThreads;
         
-        int maxDepthUsed;
-        evaluateTree(trees[treeIndex], maxDepth, (int)maxNodes, maxDepthUsed, doPrune,
-                     minImprovement, minLeafCount, maxSplitsPerNumericAttribute, values, valueTypes,
-                     categoryMaps, subsets[subsetIndex], selectRows, selectColumns, targetColumn,
-                     sortedIndexes, colNames, imputedValues);
+        // threads do not call R; in R package, their output is held until all are done
+        string message;
+        bool success = runParallel(batchSize, numThreads, trainTreeWork, &work, message);
+        
+        RUNTIME_ERROR_IF(!success, message);
+        
+        for (size_t k = 0; k < batchSize; k++) {
+            if (work.maxDepthUsed[k] >= minDepth) {
+                trees.push_back(work.trees[k]);
+            }
+        }
         
-        if (maxDepthUsed < minDepth) {
-            trees.resize(trees.size() - 1);
+        if (gTrainProgressFunction != NULL) {
+            for (size_t k = 0; k < batchSize; k++) {
+                progress.nodesSplit += work.nodesSplit[k];
+                progress.rowsScanned += work.rowsScanned[k];
+            }
+            
+            progress.treesCompleted += batchSize;
+            progress.treesKept = trees.size();
+            
+            double nowSeconds = wallSeconds();
+            if (!moreSubsets || nowSeconds - reportSeconds >= gTrainProgressInterval) {
+                reportTrainProgress(progress, nowSeconds - startSeconds);
+                reportSeconds = nowSeconds;
+            }
         }
 
 #if RPACKAGE
-        R_CheckUserInterrupt();     // Allowing interrupt
+        R_CheckUserInterrupt();     // Allowing interrupt, on main thread between batches
 #endif
     }
 
@@ -433,6 +738,157 @@ void train(std::vector<CompactTree>& trees,
     
 }
 
+// report progress of train by calling progressFunction(progress, context) on thread that called
+// train, at most once per minInterval seconds while trees are grown, and once when all are done;
+// no progress is reported if progressFunction is NULL
+void setTrainProgress(TrainProgressFunction progressFunction, void *context, double minInterval)
+{
+    gTrainProgressFunction = progressFunction;
+    gTrainProgressContext = context;
+    gTrainProgressInterval = minInterval;
+}
+
+// TrainProgressFunction that prints progress to CERR as one line of name=value pairs; context is
+// not used
+void printTrainProgress(const TrainProgress& progress, void * /* context */)
+{
+    ostringstream oss;
+    oss << "train progress: treesCompleted=" << progress.treesCompleted <<
+    " treesTotal=" << progress.treesTotal << " treesKept=" << progress.treesKept <<
+    " nodesSplit=" << progress.nodesSplit << " rowsScanned=" << progress.rowsScanned <<
+    fixed << setprecision(0) << " rowsPerSecond=" << progress.rowsPerSecond <<
+    setprecision(1) << " elapsedSeconds=" << progress.elapsedSeconds <<
+    " secondsRemaining=" << progress.secondsRemaining;
+    
+    CERR << oss.str() << endl;
+}
+
+// for train; fill in rates and estimate of progress, and pass it to gTrainProgressFunction
+void reportTrainProgress(TrainProgress& progress, double elapsedSeconds)
+{
+    progress.elapsedSeconds = elapsedSeconds;
+    
+    if (elapsedSeconds > 0.0) {
+        progress.rowsPerSecond = progress.rowsScanned / elapsedSeconds;
+        
+    } else {
+        progress.rowsPerSecond = 0.0;
+    }
+    
+    if (progress.treesCompleted > 0) {
+        // assume remaining trees take as long on average as completed trees
+        size_t treesRemaining = progress.treesTotal - progress.treesCompleted;
+        progress.secondsRemaining = elapsedSeconds * treesRemaining / progress.treesCompleted;
+        
+    } else {
+        progress.secondsRemaining = -1.0;
+    }
+    
+    gTrainProgressFunction(progress, gTrainProgressContext);
+}
+
+// for train; grow tree for one column subset of batch, called on training thread; must not call R
+void trainTreeWork(size_t item, void *context)
+{
+    TrainTreesWork& work = *(TrainTreesWork *)context;
+    
+    const vector<size_t>& subset = work.subsets[item];
+    TreeBlock& block = work.blocks[item];
+    CompactTree& tree = work.trees[item];
+    int& maxDepthUsed = work.maxDepthUsed[item];
+    size_t& nodesSplit = work.nodesSplit[item];
+    
+    fillTreeBlock(subset, *work.selectColumns, work.targetColumn, *work.values, *work.valueTypes,
+                  *work.categoryMaps, *work.sortedIndexes, *work.colNames, *work.imputedValues,
+                  *work.imputeOptions, block);
+    
+    tree = CompactTree();
+    
+    evaluateTree(tree, work.maxDepth, work.maxNodes, maxDepthUsed, work.rowsScanned[item],
+                 work.doPrune, false, work.minImprovement, work.minLeafCount,
+                 work.maxSplitsPerNumericAttribute, block.values, block.valueTypes,
+                 block.categoryMaps, block.subsetIndexes, *work.selectRows, block.selectColumns,
+                 block.targetColumn, block.sortedIndexes, block.colNames, block.imputedValues,
+                 block.imputeOptions);
+    
+    nodesSplit = 0;
+    for (size_t nodeIndex = 0; nodeIndex < tree.splitColIndex.size(); nodeIndex++) {
+        if (tree.splitColIndex[nodeIndex] != NO_INDEX) {
+            nodesSplit++;
+        }
+    }
+    
+    if (maxDepthUsed >= work.minDepth) {
+        unpackTreeColumns(tree, subset);
+        compressTree(tree, *work.valueTypes, work.targetColumn, *work.selectColumns);
+    }
+}
+
+// for train; copy the subset columns (subsetIndexes are indexes into selectColumns) and target
+// column into block, reusing storage already in block; category maps are pointed to, not copied
+void fillTreeBlock(const vector<size_t>& subsetIndexes,
+                   const SelectIndexes& selectColumns,
+                   size_t targetColumn,
+                   const vector< vector<Value> >& values,
+                   const vector<ValueType>& valueTypes,
+                   const vector<CategoryMaps>& categoryMaps,
+                   const vector< vector<size_t> >& sortedIndexes,
+                   const vector<string>& colNames,
+                   const vector<Value>& imputedValues,
+                   const vector<ImputeOption>& imputeOptions,
+                   TreeBlock& block)
+{
+    const vector<size_t>& selectColumnIndexes = selectColumns.indexVector();
+    
+    size_t numSubsetCols = subsetIndexes.size();
+    size_t numBlockCols = numSubsetCols + 1;
+    
+    block.values.resize(numBlockCols);
+    block.valueTypes.resize(numBlockCols);
+    block.categoryMaps.resize(numBlockCols);
+    block.sortedIndexes.resize(numBlockCols);
+    block.colNames.resize(numBlockCols);
+    block.imputedValues.resize(numBlockCols);
+    block.imputeOptions.resize(numBlockCols);
+    block.subsetIndexes.resize(numSubsetCols);
+    
+    for (size_t k = 0; k < numBlockCols; k++) {
+        size_t col = k < numSubsetCols ? selectColumnIndexes.at(subsetIndexes[k]) : targetColumn;
+        
+        // assign reuses storage left from previous tree
+        block.values[k].assign(values.at(col).begin(), values.at(col).end());
+        block.sortedIndexes[k].assign(sortedIndexes.at(col).begin(), sortedIndexes.at(col).end());
+        
+        block.valueTypes[k] = valueTypes.at(col);
+        block.categoryMaps[k] = &categoryMaps.at(col);
+        block.colNames[k] = col < colNames.size() ? colNames[col] : "";
+        block.imputedValues[k] = imputedValues.at(col);
+        block.imputeOptions[k] = imputeOptions.at(col);
+        
+        if (k < numSubsetCols) {
+            block.subsetIndexes[k] = k;
+        }
+    }
+    
+    block.selectColumns.selectAll(numBlockCols);
+    block.selectColumns.unselect(numSubsetCols);
+    
+    block.targetColumn = numSubsetCols;
+}
+
+// for train; change split columns of tree grown from TreeBlock, which are indexes into block
+// columns, into indexes into selectColumns
+void unpackTreeColumns(CompactTree& compactTree, const vector<size_t>& subsetIndexes)
+{
+    for (size_t nodeIndex = 0; nodeIndex < compactTree.splitColIndex.size(); nodeIndex++) {
+        index_t colIndex = compactTree.splitColIndex[nodeIndex];
+        
+        if (colIndex != NO_INDEX) {
+            compactTree.splitColIndex[nodeIndex] = (index_t)subsetIndexes.at((size_t)colIndex);
+        }
+    }
+}
+
 // recursively delete all nodes for which specified node is ancestor
 void deleteSubtrees(TreeNode *nodeP)
 {
@@ -451,6 +907,118 @@ void deleteSubtrees(TreeNode *nodeP)
     }
 }
 
+// merge structurally identical subtrees of tree so that they share nodes, and replace each split
+// whose two branches are identical with one branch; predictions from tree are unchanged; root stays
+// first, and each node stays before its branches
+void compressTree(CompactTree& tree,
+                  const vector<ValueType>& valueTypes,
+                  size_t targetColumn,
+                  const SelectIndexes& selectColumns)
+{
+    const vector<size_t>& selectColumnIndexes = selectColumns.indexVector();
+    size_t numNodes = tree.value.size();
+    
+    // visit nodes from last to first, so that branches are visited before the node that splits into
+    // them; keys are collected in same order, and newIndex has index into keys for each node
+    vector<index_t> newIndex(numNodes, NO_INDEX);
+    vector<CompactNodeKey> keys;
+    map<CompactNodeKey, index_t> keyIndexes;
+    
+    vector<unsigned int> categorySets;
+    map<vector<unsigned int>, index_t> categorySetIndexes;
+    
+    for (size_t count = numNodes; count > 0; count--) {
+        size_t nodeIndex = count - 1;
+        
+        CompactNodeKey key;
+        key.splitColIndex = tree.splitColIndex[nodeIndex];
+        key.lessOrEqualIndex = NO_INDEX;
+        key.greaterOrNotIndex = NO_INDEX;
+        key.toLessOrEqualIfNA = false;
+        key.categorySetIndex = NO_INDEX;
+        
+        if (key.splitColIndex == NO_INDEX) {
+            key.value = numberForType(tree.value[nodeIndex], valueTypes.at(targetColumn));
+            
+        } else {
+            size_t col = selectColumnIndexes.at((size_t)key.splitColIndex);
+            
+            key.lessOrEqualIndex = newIndex.at((size_t)tree.lessOrEqualIndex[nodeIndex]);
+            key.greaterOrNotIndex = newIndex.at((size_t)tree.greaterOrNotIndex[nodeIndex]);
+            key.toLessOrEqualIfNA = tree.toLessOrEqualIfNA[nodeIndex];
+            key.value = numberForType(tree.value[nodeIndex], valueTypes.at(col));
+        }
+        
+        if (key.splitColIndex != NO_INDEX && key.lessOrEqualIndex == key.greaterOrNotIndex) {
+            // both branches give same result, so split is not needed
+            newIndex[nodeIndex] = key.lessOrEqualIndex;
+            
+        } else {
+            index_t setIndex = tree.categorySetIndex[nodeIndex];
+            
+            if (setIndex != NO_INDEX) {
+                // store each distinct set once
+                const unsigned int *setP = &tree.categorySets.at((size_t)setIndex);
+                vector<unsigned int> categorySet(setP, setP + 1 + setP[0]);
+                
+                map<vector<unsigned int>, index_t>::iterator iter =
+                    categorySetIndexes.find(categorySet);
+                
+                if (iter == categorySetIndexes.end()) {
+                    key.categorySetIndex = (index_t)categorySets.size();
+                    categorySetIndexes[categorySet] = key.categorySetIndex;
+                    categorySets.insert(categorySets.end(), categorySet.begin(),
+                                        categorySet.end());
+                    
+                } else {
+                    key.categorySetIndex = iter->second;
+                }
+            }
+            
+            map<CompactNodeKey, index_t>::iterator iter = keyIndexes.find(key);
+            
+            if (iter == keyIndexes.end()) {
+                newIndex[nodeIndex] = (index_t)keys.size();
+                keyIndexes[key] = newIndex[nodeIndex];
+                keys.push_back(key);
+                
+            } else {
+                newIndex[nodeIndex] = iter->second;
+            }
+        }
+    }
+    
+    // keys are in reverse order, with root last
+    size_t count = keys.size();
+    
+    tree.splitColIndex.resize(count);
+    tree.lessOrEqualIndex.resize(count);
+    tree.greaterOrNotIndex.resize(count);
+    tree.toLessOrEqualIfNA.resize(count);
+    tree.value.resize(count);
+    tree.categorySetIndex.resize(count);
+    
+    for (size_t nodeIndex = 0; nodeIndex < count; nodeIndex++) {
+        const CompactNodeKey& key = keys[count - 1 - nodeIndex];
+        
+        tree.splitColIndex[nodeIndex] = key.splitColIndex;
+        tree.toLessOrEqualIfNA[nodeIndex] = key.toLessOrEqualIfNA;
+        tree.value[nodeIndex] = key.value;
+        tree.categorySetIndex[nodeIndex] = key.categorySetIndex;
+        
+        if (key.splitColIndex == NO_INDEX) {
+            tree.lessOrEqualIndex[nodeIndex] = NO_INDEX;
+            tree.greaterOrNotIndex[nodeIndex] = NO_INDEX;
+            
+        } else {
+            tree.lessOrEqualIndex[nodeIndex] = (index_t)count - 1 - key.lessOrEqualIndex;
+            tree.greaterOrNotIndex[nodeIndex] = (index_t)count - 1 - key.greaterOrNotIndex;
+        }
+    }
+    
+    tree.categorySets.swap(categorySets);
+}
+
 // for debugging; print list of decision trees
 void printCompactTrees(const std::vector<CompactTree>& trees,
                        const std::vector<ValueType>& valueTypes,
@@ -470,6 +1038,7 @@ void printCompactTrees(const std::vector<CompactTree>& trees,
         LOGIC_ERROR_IF(numNodes != trees[tree].greaterOrNotIndex.size(), "broken CompactTree");
         LOGIC_ERROR_IF(numNodes != trees[tree].toLessOrEqualIfNA.size(), "broken CompactTree");
         LOGIC_ERROR_IF(numNodes != trees[tree].value.size(), "broken CompactTree");
+        LOGIC_ERROR_IF(numNodes != trees[tree].categorySetIndex.size(), "broken CompactTree");
         
         for (size_t nodeIndex = 0; nodeIndex < numNodes; nodeIndex++) {
             index_t colIndex = trees[tree].splitColIndex[nodeIndex];
@@ -502,7 +1071,15 @@ void printCompactTrees(const std::vector<CompactTree>& trees,
                 case kCategorical:
                 {
                     index_t index = trees[tree].value[nodeIndex].i;
-                    string category = categoryMaps.at(col).getCategoryForIndex(index);
+                    index_t setIndex = trees[tree].categorySetIndex[nodeIndex];
+                    string category;
+                    if (setIndex == NO_INDEX) {
+                        category = categoryMaps.at(col).getCategoryForIndex(index);
+                        
+                    } else {
+                        category = categorySetToString(&trees[tree].categorySets[(size_t)setIndex],
+                                                       categoryMaps.at(col));
+                    }
                     
                     CERR << nodeIndex << "]\t" << colNames.at(col) <<
                     "\t" << lessOrEqualNodeString <<
@@ -639,16 +1216,16 @@ size_t countNodes(const TreeNode *nodeP)
 }
 
 // recursively assign a serial number to all nodes in the subtree beginning at specified node 
-void indexNodes(TreeNode *nodeP)
+void indexNodes(TreeNode *nodeP, size_t& nextIndex)
 {
-    nodeP->index = gNextIndex++;;
+    nodeP->index = nextIndex++;
     
     if (nodeP->lessOrEqualNode != NULL) {
-        indexNodes(nodeP->lessOrEqualNode);
+        indexNodes(nodeP->lessOrEqualNode, nextIndex);
     }
     
     if (nodeP->greaterOrNotNode != NULL) {
-        indexNodes(nodeP->greaterOrNotNode);
+        indexNodes(nodeP->greaterOrNotNode, nextIndex);
     }
 }
 
@@ -665,6 +1242,16 @@ void copyToCompact(CompactTree& compactTree, TreeNode *nodeP)
         compactTree.toLessOrEqualIfNA[nodeIndex] = nodeP->toLessOrEqualIfNA;
         compactTree.value[nodeIndex] = nodeP->splitValue.number;
         
+        if (nodeP->splitCategorySet.empty()) {
+            compactTree.categorySetIndex[nodeIndex] = NO_INDEX;
+            
+        } else {
+            compactTree.categorySetIndex[nodeIndex] = (index_t)compactTree.categorySets.size();
+            compactTree.categorySets.insert(compactTree.categorySets.end(),
+                                            nodeP->splitCategorySet.begin(),
+                                            nodeP->splitCategorySet.end());
+        }
+        
         copyToCompact(compactTree, nodeP->lessOrEqualNode);
         copyToCompact(compactTree, nodeP->greaterOrNotNode);
         
@@ -674,6 +1261,7 @@ void copyToCompact(CompactTree& compactTree, TreeNode *nodeP)
         compactTree.greaterOrNotIndex[nodeIndex] = NO_INDEX;
         compactTree.toLessOrEqualIfNA[nodeIndex] = false;
         compactTree.value[nodeIndex] = nodeP->leafValue.number;
+        compactTree.categorySetIndex[nodeIndex] = NO_INDEX;
     }
 }
 
@@ -681,8 +1269,8 @@ void copyToCompact(CompactTree& compactTree, TreeNode *nodeP)
 void makeCompactTree(CompactTree& compactTree, TreeNode& root)
 {
     // reindex nodes (may have been pruning)
-    gNextIndex = 0;
-    indexNodes(&root);
+    size_t nextIndex = 0;
+    indexNodes(&root, nextIndex);
     
     // allocate space
     size_t count = countNodes(&root);
@@ -692,20 +1280,24 @@ void makeCompactTree(CompactTree& compactTree, TreeNode& root)
     compactTree.greaterOrNotIndex.resize(count);
     compactTree.toLessOrEqualIfNA.resize(count);
     compactTree.value.resize(count);
+    compactTree.categorySetIndex.resize(count);
+    compactTree.categorySets.clear();
     
     copyToCompact(compactTree, &root);
 }
 
 // recursively improve subtree from specified leaf node (called initially on the root node)
+// and, if doPrune, prune each subtree as soon as it is complete
 void improveSubtree(TreeNode *nodeP,
                     int depth,
                     int maxDepth,
                     int maxNodes,
                     int& maxDepthUsed,          // updated during recursion
+                    bool doPrune,
                     const vector<size_t>& subsetIndexes,
                     const vector< vector<Value> >& values,
                     const vector<ValueType>& valueTypes,
-                    const vector<CategoryMaps>& categoryMaps,
+                    const vector<const CategoryMaps *>& categoryMaps,
                     const SelectIndexes& selectColumns,
                     size_t targetColumn,
                     const vector< vector<size_t> >& sortedIndexes,
@@ -714,13 +1306,19 @@ void improveSubtree(TreeNode *nodeP,
                     index_t minLeafCount,
                     index_t maxSplitsPerNumericAttribute,
                     index_t& finalLeafCount,    // updated for each leaf found
-                    const vector<Value>& imputedValues)
+                    size_t& rowsScanned,        // updated for each leaf offered for splitting
+                    const vector<Value>& imputedValues,
+                    const vector<ImputeOption>& imputeOptions,
+                    size_t& nextIndex)          // updated for each node created
 {
-    if (depth < maxDepth && (maxNodes <= 0 || gNextIndex < (size_t)maxNodes)) {
+    if (depth < maxDepth && (maxNodes <= 0 || nextIndex < (size_t)maxNodes)) {
+        // each column of subset is searched for split over rows of leaf
+        rowsScanned += nodeP->selectRows.countSelected() * subsetIndexes.size();
+        
         bool improved = improveLeaf(nodeP, subsetIndexes, values, valueTypes, categoryMaps,
                                     selectColumns, targetColumn, sortedIndexes, colNames,
                                     minImprovement, minLeafCount, maxSplitsPerNumericAttribute,
-                                    imputedValues);
+                                    imputedValues, imputeOptions, nextIndex);
         
         if (improved) {
             if (maxDepthUsed < depth + 1) {
@@ -731,17 +1329,26 @@ void improveSubtree(TreeNode *nodeP,
             
             TreeNode *lessOrEqualNode = nodeP->lessOrEqualNode;
             
-            improveSubtree(lessOrEqualNode, depth + 1, maxDepth, maxNodes, maxDepthUsed,
+            improveSubtree(lessOrEqualNode, depth + 1, maxDepth, maxNodes, maxDepthUsed, doPrune,
                            subsetIndexes, values, valueTypes, categoryMaps, selectColumns,
                            targetColumn, sortedIndexes, colNames, minImprovement, minLeafCount,
-                           maxSplitsPerNumericAttribute,finalLeafCount, imputedValues);
+                           maxSplitsPerNumericAttribute, finalLeafCount, rowsScanned,
+                           imputedValues, imputeOptions, nextIndex);
             
             TreeNode *greaterOrNotNode = nodeP->greaterOrNotNode;
 
-            improveSubtree(greaterOrNotNode, depth + 1, maxDepth, maxNodes, maxDepthUsed,
+            improveSubtree(greaterOrNotNode, depth + 1, maxDepth, maxNodes, maxDepthUsed, doPrune,
                            subsetIndexes, values, valueTypes, categoryMaps, selectColumns,
                            targetColumn, sortedIndexes, colNames, minImprovement, minLeafCount,
-                           maxSplitsPerNumericAttribute, finalLeafCount, imputedValues);
+                           maxSplitsPerNumericAttribute, finalLeafCount, rowsScanned,
+                           imputedValues, imputeOptions, nextIndex);
+            
+            if (doPrune) {
+                // subtree is complete, so can be pruned now instead of after whole tree is grown
+                INSTRUMENT_TIME_BEGIN(pruneStart)
+                pruneCompletedSubtree(nodeP, valueTypes.at(targetColumn));
+                INSTRUMENT_TIME_END(kPruneMicroseconds, pruneStart)
+            }
         
         } else {
             // cannot improve this leaf; update tally
@@ -756,7 +1363,7 @@ void printTree(const TreeNode *nodeP,
                const vector<ValueType>& valueTypes,
                size_t targetColumn,
                const SelectIndexes& selectColumns,
-               const vector<CategoryMaps>& categoryMaps,
+               const vector<const CategoryMaps *>& categoryMaps,
                const vector<string>& colNames,
                int indent, index_t count)
 {
@@ -800,7 +1407,7 @@ void printTree(const TreeNode *nodeP,
         switch (valueTypes.at(targetColumn)) {
             case kCategorical:
                 CERR << indentStr << "[" << nodeP->index << "] " << "leaf " <<
-                categoryMaps.at(targetColumn).getCategoryForIndex(nodeP->leafValue.number.i) <<
+                categoryMaps.at(targetColumn)->getCategoryForIndex(nodeP->leafValue.number.i) <<
                 " (" << count << ") " << suffix;
                 break;
                 
@@ -820,10 +1427,18 @@ void printTree(const TreeNode *nodeP,
         
         switch (valueTypes.at(col)) {
             case kCategorical:
-                CERR << indentStr << "[" << nodeP->index << "] " << "node " <<
-                colNames.at(col) << " == " <<
-                categoryMaps.at(col).getCategoryForIndex(nodeP->splitValue.number.i) <<
-                " (" << count << ") " << suffix;
+                if (nodeP->splitCategorySet.empty()) {
+                    CERR << indentStr << "[" << nodeP->index << "] " << "node " <<
+                    colNames.at(col) << " == " <<
+                    categoryMaps.at(col)->getCategoryForIndex(nodeP->splitValue.number.i) <<
+                    " (" << count << ") " << suffix;
+                    
+                } else {
+                    CERR << indentStr << "[" << nodeP->index << "] " << "node " <<
+                    colNames.at(col) << " in " <<
+                    categorySetToString(&nodeP->splitCategorySet[0], *categoryMaps.at(col)) <<
+                    " (" << count << ") " << suffix;
+                }
                 break;
                 
             case kNumeric:
@@ -855,12 +1470,12 @@ void printTree(const TreeNode *nodeP,
 double selectRowsEntropy(const SelectIndexes& selectRows,
                          const vector< vector<Value> >& values,
                          size_t targetColumn,
-                         const vector<CategoryMaps>& categoryMaps,
+                         const vector<const CategoryMaps *>& categoryMaps,
                          vector<int>& targetCategoryCounts)
 {
-    size_t numTargetCategories = categoryMaps.at(targetColumn).countAllCategories();
+    size_t numTargetCategories = categoryMaps.at(targetColumn)->countAllCategories();
     
-    index_t beginCategoryIndex = categoryMaps.at(targetColumn).beginIndex();
+    index_t beginCategoryIndex = categoryMaps.at(targetColumn)->beginIndex();
     
     targetCategoryCounts.assign(numTargetCategories, 0);
     
@@ -1029,20 +1644,35 @@ double sdForSplit(double lessThanOrEqualSum,
     return sd;
 }
 
-// get the best split for the specified numeric column
+// get the best split for the specified numeric column; if imputeOption is a branch option, NA rows
+// are handled as one group with the mean or median of the other selected rows, returned in naValue
 ValueAndMeasure getBestNumericalSplit(size_t col,
                                       size_t targetColumn,
                                       const SelectIndexes& selectRows,
                                       const vector< vector<Value> >& values,
                                       const vector<ValueType>& valueTypes,
-                                      const vector<CategoryMaps>& categoryMaps,
+                                      const vector<const CategoryMaps *>& categoryMaps,
                                       const vector< vector<size_t> >& sortedIndexes,
-                                      const vector<string>& colNames)
+                                      ImputeOption imputeOption)
 {
     size_t numSortedIndexes = sortedIndexes.at(col).size();
     
     ValueAndMeasure bestSplit;
     bestSplit.value = gNaValue;
+    bestSplit.naValue = gNaValue;
+    
+    // for profiling; selected rows are visited once, then all of sortedIndexes if any split
+    size_t rowsVisited = selectRows.countSelected();
+    size_t candidateCount = 0;
+    
+    bool imputeBranch = isBranchImputeOption(imputeOption);
+    bool learnBranch = imputeOption == kToLearnedBranch;
+    
+    // for handling NA at this node; gathered while gathering statistics of target column, so that
+    // it takes no extra pass over rows
+    Value naValue = gNaValue;
+    int naCount = 0;
+    double nonNaSum = 0.0;
     
     switch(valueTypes.at(targetColumn)) {
         case kNumeric:
@@ -1054,6 +1684,10 @@ ValueAndMeasure getBestNumericalSplit(size_t col,
             double totalSum2 = 0.0;
             int totalCount = 0;
             
+            // sum, sum-squared of values in rows with NA in split column
+            double naSum = 0.0;
+            double naSum2 = 0.0;
+            
             const vector<size_t>& rowIndexes = selectRows.indexVector();
             for (size_t rowIndex = 0; rowIndex < rowIndexes.size(); rowIndex++) {
                 size_t row = rowIndexes[rowIndex];
@@ -1061,34 +1695,87 @@ ValueAndMeasure getBestNumericalSplit(size_t col,
                 totalSum += value;
                 totalSum2 += value * value;
                 totalCount++;
+                
+                if (!imputeBranch) {
+                    SKIP
+                    
+                } else if (values[col][row].na) {
+                    naSum += value;
+                    naSum2 += value * value;
+                    naCount++;
+                    
+                } else {
+                    nonNaSum += values[col][row].number.d;
+                }
+            }
+            
+            int nonNaCount = totalCount - naCount;
+            
+            if (imputeOption == kToBranchMean && nonNaCount > 0) {
+                naValue.na = false;
+                naValue.number.d = nonNaSum / nonNaCount;
             }
             
             if (totalCount >= 2) {
                 // start with biggest value in split column (since split is based on less than or
                 // equal) then proceed down to find best
                 
+                rowsVisited += numSortedIndexes;
+                
                 bool first = true;
                 double previousValue = 0.0;
                 
-                // initially, all rows are less than or equal to top row
-                double lessThanOrEqualSum = totalSum;
-                double lessThanOrEqualSum2 = totalSum2;
-                int lessThanOrEqualCount = totalCount;
+                // initially, all rows are less than or equal to top row, except NA rows if
+                // learning their branch
+                double lessThanOrEqualSum = learnBranch ? totalSum - naSum : totalSum;
+                double lessThanOrEqualSum2 = learnBranch ? totalSum2 - naSum2 : totalSum2;
+                int lessThanOrEqualCount = learnBranch ? totalCount - naCount : totalCount;
                 
                 const vector<bool>& rowSelected = selectRows.boolVector();
                 
+                // if imputing, NA rows are examined as one group when reaching naValue
+                bool naPending = naCount > 0 && nonNaCount > 0 && !learnBranch;
+                int nonNaExamined = 0;
+                
                 // iterate over rows in descending order of value in split column
-                for (index_t index = (index_t)numSortedIndexes - 1; index >= 0; index--) {
-                    size_t row = sortedIndexes[col][(size_t)index];
+                index_t index = (index_t)numSortedIndexes - 1;
+                while (index >= 0 || (naPending && !naValue.na)) {
+                    size_t row = 0;
+                    bool nextIsRow = false;
+                    double rowValue = 0.0;
+                    
+                    if (index >= 0) {
+                        row = sortedIndexes[col][(size_t)index];
+                        
+                        if (!rowSelected[row]) {
+                            SKIP
+                            
+                        } else {
+                            // NA rows are left out of sortedIndexes
+                            nextIsRow = true;
+                            rowValue = values[col][row].number.d;
+                            
+                            if (imputeOption == kToBranchMedian &&
+                                nonNaExamined == nonNaCount - 1 - nonNaCount / 2) {
+                                // reached median, picked as in medianValue()
+                                naValue = values[col][row];
+                            }
+                        }
+                    }
+                    
+                    bool nextIsNaGroup = naPending && !naValue.na &&
+                        (index < 0 || (nextIsRow && naValue.number.d >= rowValue));
                     
-                    if (rowSelected[row]) {
-                        // all values should have been imputed by this point
-                        RUNTIME_ERROR_IF(values[col][row].na, "encountered unimputed value");
+                    if (nextIsRow || nextIsNaGroup) {
+                        double currentValue = nextIsNaGroup ? naValue.number.d : rowValue;
                         
-                        double currentValue = values[col][row].number.d;
-                        double currentMeasure = sdForSplit(lessThanOrEqualSum, lessThanOrEqualSum2,
-                                                           lessThanOrEqualCount, totalSum,
-                                                           totalSum2, totalCount);
+                        bool naToLessOrEqual = false;
+                        double currentMeasure = learnBranch ?
+                            sdForSplitWithNa(lessThanOrEqualSum, lessThanOrEqualSum2,
+                                             lessThanOrEqualCount, naSum, naSum2, naCount,
+                                             totalSum, totalSum2, totalCount, naToLessOrEqual) :
+                            sdForSplit(lessThanOrEqualSum, lessThanOrEqualSum2,
+                                       lessThanOrEqualCount, totalSum, totalSum2, totalCount);
                         
                         if (first) {
                             first = false;
@@ -1097,6 +1784,8 @@ ValueAndMeasure getBestNumericalSplit(size_t col,
                             // don't bother checking unless value has changed from
                             // previously-checked value
                             
+                            candidateCount++;
+                            
                             if (bestSplit.value.na || currentMeasure < bestSplit.measure) {
                                 // first candidate for split value, or improvement over previous
                                 // best
@@ -1104,21 +1793,42 @@ ValueAndMeasure getBestNumericalSplit(size_t col,
                                 bestSplit.measure = currentMeasure;
                                 bestSplit.value.number.d = 0.5 * (currentValue + previousValue);
                                 bestSplit.value.na = false;
+                                
+                                if (learnBranch) {
+                                    naValue = learnedNumericalNaValue(naToLessOrEqual);
+                                }
                             }
                             
                         } else if (currentValue == previousValue) {
                             SKIP
                         }
                         
-                        // remove from statistics the value that was just examined 
-                        double value = values[targetColumn][row].number.d;
-                        lessThanOrEqualSum -= value;
-                        lessThanOrEqualSum2 -= value * value;
-                        lessThanOrEqualCount--;
+                        // remove from statistics the values that were just examined
+                        if (nextIsNaGroup) {
+                            lessThanOrEqualSum -= naSum;
+                            lessThanOrEqualSum2 -= naSum2;
+                            lessThanOrEqualCount -= naCount;
+                            naPending = false;
+                            
+                        } else {
+                            double value = values[targetColumn][row].number.d;
+                            lessThanOrEqualSum -= value;
+                            lessThanOrEqualSum2 -= value * value;
+                            lessThanOrEqualCount--;
+                            nonNaExamined++;
+                        }
                         
                         previousValue = currentValue;
                     }
+                    
+                    // row is examined again after NA group
+                    if (!nextIsNaGroup) {
+                        index--;
+                    }
                 }
+                
+                // only branch imputation leaves NA values by this point
+                RUNTIME_ERROR_IF(nonNaExamined != nonNaCount, "encountered unimputed value");
             }
         }
             break;
@@ -1129,13 +1839,16 @@ ValueAndMeasure getBestNumericalSplit(size_t col,
 
             // count entries in each target category in selectRows (i.e., for current node)
 
-            size_t numTargetCategories = categoryMaps.at(targetColumn).countAllCategories();
+            size_t numTargetCategories = categoryMaps.at(targetColumn)->countAllCategories();
             
-            index_t beginCategoryIndex = categoryMaps.at(targetColumn).beginIndex();
+            index_t beginCategoryIndex = categoryMaps.at(targetColumn)->beginIndex();
             
             vector<int> totalTargetCategoryCounts(numTargetCategories, 0);
             int totalRows = 0;
             
+            // entries in each target category in rows with NA in split column
+            vector<int> naTargetCategoryCounts(imputeBranch ? numTargetCategories : 0, 0);
+            
             const vector<size_t>& rowIndexes = selectRows.indexVector();
             for (size_t rowIndex = 0; rowIndex < rowIndexes.size(); rowIndex++) {
                 size_t row = rowIndexes[rowIndex];
@@ -1143,38 +1856,102 @@ ValueAndMeasure getBestNumericalSplit(size_t col,
                 size_t countsIndex = (size_t)(targetCategory - beginCategoryIndex);
                 totalTargetCategoryCounts[countsIndex]++;
                 totalRows++;
+                
+                if (!imputeBranch) {
+                    SKIP
+                    
+                } else if (values[col][row].na) {
+                    naTargetCategoryCounts[countsIndex]++;
+                    naCount++;
+                    
+                } else {
+                    nonNaSum += values[col][row].number.d;
+                }
+            }
+            
+            int nonNaCount = totalRows - naCount;
+            
+            if (imputeOption == kToBranchMean && nonNaCount > 0) {
+                naValue.na = false;
+                naValue.number.d = nonNaSum / nonNaCount;
             }
             
             if (totalRows >= 2) {
                 // start with biggest value (since split is based on less than or equal)
                 // then proceed down to find best
                 
+                rowsVisited += numSortedIndexes;
+                
                 bool first = true;
                 double previousValue = 0.0;
 
-                // initially, all rows are less than or equal to top row
+                // initially, all rows are less than or equal to top row, except NA rows if
+                // learning their branch
                 vector<int> currentTargetCategoryCounts(totalTargetCategoryCounts);
+                if (learnBranch) {
+                    for (size_t k = 0; k < numTargetCategories; k++) {
+                        currentTargetCategoryCounts[k] -= naTargetCategoryCounts[k];
+                    }
+                }
+                
+                // for calculating measure with NA rows less than or equal
+                vector<int> naLessOrEqualCounts(learnBranch ? numTargetCategories : 0, 0);
                 
                 const vector<bool>& rowSelected = selectRows.boolVector();
                 
-                for (index_t index = (index_t)numSortedIndexes - 1; index >= 0; index--) {
-                    size_t row = sortedIndexes[col][(size_t)index];
+                // if imputing, NA rows are examined as one group when reaching naValue
+                bool naPending = naCount > 0 && nonNaCount > 0 && !learnBranch;
+                int nonNaExamined = 0;
+                
+                // iterate over rows in descending order of value in split column
+                index_t index = (index_t)numSortedIndexes - 1;
+                while (index >= 0 || (naPending && !naValue.na)) {
+                    size_t row = 0;
+                    bool nextIsRow = false;
+                    double rowValue = 0.0;
                     
-                    if (rowSelected[row]) {
-                        // all values should have been imputed by this point
-                        RUNTIME_ERROR_IF(values[col][row].na, "encountered unimputed value");
+                    if (index >= 0) {
+                        row = sortedIndexes[col][(size_t)index];
+                        
+                        if (!rowSelected[row]) {
+                            SKIP
+                            
+                        } else {
+                            // NA rows are left out of sortedIndexes
+                            nextIsRow = true;
+                            rowValue = values[col][row].number.d;
+                            
+                            if (imputeOption == kToBranchMedian &&
+                                nonNaExamined == nonNaCount - 1 - nonNaCount / 2) {
+                                // reached median, picked as in medianValue()
+                                naValue = values[col][row];
+                            }
+                        }
+                    }
+                    
+                    bool nextIsNaGroup = naPending && !naValue.na &&
+                        (index < 0 || (nextIsRow && naValue.number.d >= rowValue));
+                    
+                    if (nextIsRow || nextIsNaGroup) {
+                        double currentValue = nextIsNaGroup ? naValue.number.d : rowValue;
                         
-                        double currentValue = values[col][row].number.d;
-
                         if (first) {
                             first = false;
                             
                         } else if (currentValue < previousValue) {
                             // don't bother checking unless value has changed from
                             // previously-checked value
-
-                            double currentMeasure = entropyForSplit(currentTargetCategoryCounts,
-                                                                    totalTargetCategoryCounts);
+                            
+                            candidateCount++;
+                            
+                            bool naToLessOrEqual = false;
+                            double currentMeasure = learnBranch ?
+                                entropyForSplitWithNa(currentTargetCategoryCounts,
+                                                      naTargetCategoryCounts,
+                                                      totalTargetCategoryCounts,
+                                                      naLessOrEqualCounts, naToLessOrEqual) :
+                                entropyForSplit(currentTargetCategoryCounts,
+                                                totalTargetCategoryCounts);
                             
                             if (bestSplit.value.na || currentMeasure < bestSplit.measure) {
                                 // first candidate for split value, or improvement over previous
@@ -1183,52 +1960,97 @@ ValueAndMeasure getBestNumericalSplit(size_t col,
                                 bestSplit.measure = currentMeasure;
                                 bestSplit.value.number.d = 0.5 * (currentValue + previousValue);
                                 bestSplit.value.na = false;
+                                
+                                if (learnBranch) {
+                                    naValue = learnedNumericalNaValue(naToLessOrEqual);
+                                }
                             }
                             
                         } else if (currentValue == previousValue) {
                             SKIP
                         }
-
-                        // remove from currentTargetCategoryCounts the row that was just examined
-                        index_t targetCategory = values[targetColumn][row].number.i;
-                        size_t countsIndex = (size_t)(targetCategory - beginCategoryIndex);
-                        currentTargetCategoryCounts[countsIndex]--;
+                        
+                        // remove from currentTargetCategoryCounts the rows that were just
+                        // examined
+                        if (nextIsNaGroup) {
+                            for (size_t k = 0; k < numTargetCategories; k++) {
+                                currentTargetCategoryCounts[k] -= naTargetCategoryCounts[k];
+                            }
+                            
+                            naPending = false;
+                            
+                        } else {
+                            index_t targetCategory = values[targetColumn][row].number.i;
+                            size_t countsIndex = (size_t)(targetCategory - beginCategoryIndex);
+                            currentTargetCategoryCounts[countsIndex]--;
+                            nonNaExamined++;
+                        }
                         
                         previousValue = currentValue;
                     }
+                    
+                    // row is examined again after NA group
+                    if (!nextIsNaGroup) {
+                        index--;
+                    }
                 }
+                
+                // only branch imputation leaves NA values by this point
+                RUNTIME_ERROR_IF(nonNaExamined != nonNaCount, "encountered unimputed value");
             }
         }
             break;
     }
     
+    bestSplit.naValue = naValue;
+    
+    INSTRUMENT_ADD(kNumericalSplitCalls, 1)
+    INSTRUMENT_ADD(kNumericalSplitRows, rowsVisited)
+    INSTRUMENT_ADD(kSplitCandidates, candidateCount)
+    
     return bestSplit;
 }
 
-// get the best split for the specified categorical column
+// get the best split for the specified categorical column; if imputeOption is a branch option, NA
+// rows are counted with the modal category of the other selected rows, returned in naValue; takes
+// time and space in proportion to count of selected rows, not count of categories in column
 ValueAndMeasure getBestCategoricalSplit(size_t col,
                                         size_t targetColumn,
                                         const SelectIndexes& selectRows,
                                         const vector< vector<Value> >& values,
                                         const vector<ValueType>& valueTypes,
-                                        const vector<CategoryMaps>& categoryMaps,
-                                        const vector< vector<size_t> >& sortedIndexes,
-                                        const vector<string>& colNames)
+                                        const vector<const CategoryMaps *>& categoryMaps,
+                                        ImputeOption imputeOption)
 {
     ValueAndMeasure bestSplit;
     bestSplit.value = gNaValue;
+    bestSplit.naValue = gNaValue;
     string bestSplitName = "";
     
+    bool imputeBranch = isBranchImputeOption(imputeOption);
+    bool learnBranch = imputeOption == kToLearnedBranch;
+    
+    // for handling NA at this node; gathered while gathering statistics of target column, so that
+    // it takes no extra pass over rows
+    Value naValue = gNaValue;
+    int naCount = 0;
+    
+    // statistics are gathered only for categories found in rows at this node, each kept in a slot,
+    // so that space and time are proportional to count of rows at node instead of count of
+    // categories in column
+    const vector<size_t>& rowIndexes = selectRows.indexVector();
+    
+    CategorySlots slots;
+    slots.clear(rowIndexes.size());
+    
+    const vector<index_t>& categories = slots.categoryVector();
+    
     switch(valueTypes.at(targetColumn)) {
         case kNumeric:
         {
             // target column is numeric - quality measure will be based on standard deviation
             
-            size_t numCurrentCategories = categoryMaps.at(col).countAllCategories();
-            index_t beginCategoryIndex = categoryMaps.at(col).beginIndex();
-            index_t endCategoryIndex = categoryMaps.at(col).endIndex();
-            
-            if (numCurrentCategories > 1) {
+            if (categoryMaps.at(col)->countAllCategories() > 1) {
                 // calculate count, sum, sum-squared of all values in selectRows (i.e., for current
                 // node) and for rows belonging to each category in split column
                 
@@ -1236,11 +2058,14 @@ ValueAndMeasure getBestCategoricalSplit(size_t col,
                 double totalSum2 = 0.0;
                 int totalCount = 0;
                 
-                vector<double> categorySum(numCurrentCategories, 0.0);
-                vector<double> categorySum2(numCurrentCategories, 0.0);
-                vector<int> categoryCount(numCurrentCategories, 0);
+                vector<double> categorySum;
+                vector<double> categorySum2;
+                vector<int> categoryCount;
+                
+                // sum, sum-squared of values in rows with NA in split column
+                double naSum = 0.0;
+                double naSum2 = 0.0;
                 
-                const vector<size_t>& rowIndexes = selectRows.indexVector();
                 for (size_t rowIndex = 0; rowIndex < rowIndexes.size(); rowIndex++) {
                     size_t row = rowIndexes[rowIndex];
                     double value = values[targetColumn][row].number.d;
@@ -1249,60 +2074,96 @@ ValueAndMeasure getBestCategoricalSplit(size_t col,
                     totalSum2 += value * value;
                     totalCount++;
                     
-                    // all values should have been imputed by this point
-                    RUNTIME_ERROR_IF(values[col][row].na, "encountered unimputed value");
-                    
-                    index_t category = values[col][row].number.i;
-                    
-                    size_t countsIndex = (size_t)(category - beginCategoryIndex);
-                    
-                    categorySum[countsIndex] += value;
-                    categorySum2[countsIndex] += value * value;
-                    categoryCount[countsIndex]++;
-                }
-                
-                if (totalCount >= 2) {
-                    bool first = true;
-                    
-                    // try each category in split column as candidate for split
-                    for (index_t categoryIndex = beginCategoryIndex;
-                         categoryIndex < endCategoryIndex;
-                         categoryIndex++) {
+                    if (values[col][row].na) {
+                        // only branch imputation leaves NA values by this point
+                        RUNTIME_ERROR_IF(!imputeBranch, "encountered unimputed value");
                         
-                        size_t countsIndex = (size_t)(categoryIndex - beginCategoryIndex);
+                        naSum += value;
+                        naSum2 += value * value;
+                        naCount++;
                         
-                        if (categoryCount.at(countsIndex) >= 1) {
-                            double categoryMeasure =
-                            sdForSplit(categorySum[countsIndex], categorySum2[countsIndex],
-                                       categoryCount[countsIndex],
+                    } else {
+                        size_t slot = slots.findOrInsert(values[col][row].number.i);
+                        
+                        if (slot == categoryCount.size()) {
+                            // first row with this category
+                            categorySum.push_back(0.0);
+                            categorySum2.push_back(0.0);
+                            categoryCount.push_back(0);
+                        }
+                        
+                        categorySum[slot] += value;
+                        categorySum2[slot] += value * value;
+                        categoryCount[slot]++;
+                    }
+                }
+                
+                if (imputeBranch && !learnBranch) {
+                    // NA rows go with modal category of this node
+                    naValue = modalCategory(categoryCount, categories, *categoryMaps.at(col));
+                    
+                    if (naCount > 0 && !naValue.na) {
+                        size_t slot = slots.findOrInsert(naValue.number.i);
+                        
+                        categorySum[slot] += naSum;
+                        categorySum2[slot] += naSum2;
+                        categoryCount[slot] += naCount;
+                    }
+                }
+                
+                if (totalCount >= 2) {
+                    bool first = true;
+                    
+                    INSTRUMENT_ADD(kSplitCandidates, categories.size())
+                    
+                    // try each category in split column as candidate for split
+                    for (size_t slot = 0; slot < categories.size(); slot++) {
+                        index_t categoryIndex = categories[slot];
+                        
+                        bool naToLessOrEqual = false;
+                        double categoryMeasure = learnBranch ?
+                            sdForSplitWithNa(categorySum[slot], categorySum2[slot],
+                                             categoryCount[slot], naSum, naSum2, naCount,
+                                             totalSum, totalSum2, totalCount, naToLessOrEqual) :
+                            sdForSplit(categorySum[slot], categorySum2[slot], categoryCount[slot],
                                        totalSum, totalSum2, totalCount);
+                        
+                        bool pickThis = false;
+                        
+                        if (first || categoryMeasure < bestSplit.measure) {
+                            // first candidate, or better than previous categories
+                            pickThis = true;
+                            first = false;
                             
-                            if (first || categoryMeasure < bestSplit.measure) {
-                                // first candidate, or better than previous categories
-                                bestSplit.value.number.i = categoryIndex;
-                                bestSplit.value.na = false;
-                                bestSplit.measure = categoryMeasure;
-                                bestSplitName =
-                                    categoryMaps.at(col).getCategoryForIndex(categoryIndex);
-                                
-                                first = false;
-                                
-                            } else if (categoryMeasure == bestSplit.measure) {
-                                // use name as tiebreaker, to eliminate dependence on order
-                                // of categories
-                                
-                                string nextName =
-                                    categoryMaps.at(col).getCategoryForIndex(categoryIndex);
-                                
-                                if (nextName < bestSplitName) {
-                                    bestSplit.value.number.i = categoryIndex;
-                                    bestSplit.value.na = false;
-                                    bestSplit.measure = categoryMeasure;
-                                    bestSplitName = nextName;
-                                }
+                        } else if (categoryMeasure == bestSplit.measure) {
+                            // use name as tiebreaker, to eliminate dependence on order of
+                            // categories
+                            
+                            string nextName =
+                                categoryMaps.at(col)->getCategoryForIndex(categoryIndex);
+                            
+                            pickThis = nextName < bestSplitName;
+                        }
+                        
+                        if (pickThis) {
+                            bestSplit.value.number.i = categoryIndex;
+                            bestSplit.value.na = false;
+                            bestSplit.measure = categoryMeasure;
+                            bestSplitName =
+                                categoryMaps.at(col)->getCategoryForIndex(categoryIndex);
+                            
+                            if (learnBranch) {
+                                naValue = learnedCategoricalNaValue(naToLessOrEqual,
+                                                                    categoryIndex);
                             }
                         }
                     }
+                    
+                    // try sets of more than one category
+                    getBestCategorySetForSd(categorySum, categorySum2, categoryCount, categories,
+                                            naSum, naSum2, naCount, totalSum, totalSum2,
+                                            totalCount, learnBranch, *categoryMaps.at(col),
+                                            bestSplit, naValue);
                 }
             }
         }
@@ -1312,13 +2173,19 @@ ValueAndMeasure getBestCategoricalSplit(size_t col,
         {
             // target column is categorical - quality measure will be based on entropy
             
-            size_t numTargetCategories = categoryMaps.at(targetColumn).countAllCategories();
-            index_t beginCategoryIndex = categoryMaps.at(targetColumn).beginIndex();
+            size_t numTargetCategories = categoryMaps.at(targetColumn)->countAllCategories();
+            index_t beginCategoryIndex = categoryMaps.at(targetColumn)->beginIndex();
 
             vector<int> totalTargetCategoryCounts(numTargetCategories, 0);
             int totalRows = 0;
             
-            const vector<size_t>& rowIndexes = selectRows.indexVector();
+            // entries in each target category in rows with NA in split column, and for each split
+            // category, entries in each target category (numTargetCategories entries per slot)
+            // and in all
+            vector<int> naTargetCategoryCounts(numTargetCategories, 0);
+            vector<int> slotTargetCounts;
+            vector<int> categoryCount;
+            
             for (size_t rowIndex = 0; rowIndex < rowIndexes.size(); rowIndex++) {
                 size_t row = rowIndexes[rowIndex];
                 index_t targetCategoryIndex = values[targetColumn][row].number.i;
@@ -1327,117 +2194,455 @@ ValueAndMeasure getBestCategoricalSplit(size_t col,
                 
                 totalTargetCategoryCounts[countsIndex]++;
                 totalRows++;
+                
+                if (values[col][row].na) {
+                    // only branch imputation leaves NA values by this point
+                    RUNTIME_ERROR_IF(!imputeBranch, "encountered unimputed value");
+                    
+                    naTargetCategoryCounts[countsIndex]++;
+                    naCount++;
+                    
+                } else {
+                    size_t slot = slots.findOrInsert(values[col][row].number.i);
+                    
+                    if (slot == categoryCount.size()) {
+                        // first row with this category
+                        categoryCount.push_back(0);
+                        slotTargetCounts.resize(slotTargetCounts.size() + numTargetCategories, 0);
+                    }
+                    
+                    slotTargetCounts[slot * numTargetCategories + countsIndex]++;
+                    categoryCount[slot]++;
+                }
+            }
+            
+            if (imputeBranch && !learnBranch) {
+                // NA rows go with modal category of this node
+                naValue = modalCategory(categoryCount, categories, *categoryMaps.at(col));
+                
+                if (naCount > 0 && !naValue.na) {
+                    size_t slot = slots.findOrInsert(naValue.number.i);
+                    
+                    for (size_t k = 0; k < numTargetCategories; k++) {
+                        slotTargetCounts[slot * numTargetCategories + k] +=
+                            naTargetCategoryCounts[k];
+                    }
+                    
+                    categoryCount[slot] += naCount;
+                }
             }
             
             if (totalRows > 0) {
-                bool first = true;
-                index_t previousCategory = 0;
-                index_t currentCategory = 0;
-                int categoryCount = 0;
                 vector<int> currentTargetCategoryCounts(numTargetCategories, 0);
                 
-                const vector<bool>& rowSelected = selectRows.boolVector();
+                // for calculating measure with NA rows less than or equal
+                vector<int> naLessOrEqualCounts(learnBranch ? numTargetCategories : 0, 0);
                 
-                size_t numSortedIndexes = sortedIndexes.at(col).size();
-
-                // rows are sorted by split-column categories, so by iterating, each category will
-                // handled in turn; the signal to handle the last category will be when index is
-                // past the end of sortedIndexes
-                // 
-                for (size_t index = 0; index <= numSortedIndexes; index++) {
-                    bool evaluateCategory = false;
-                    double currentMeasure = 0.0;
+                INSTRUMENT_ADD(kSplitCandidates, categories.size())
+                
+                // try each category in split column as candidate for split
+                for (size_t slot = 0; slot < categories.size(); slot++) {
+                    index_t categoryIndex = categories[slot];
+                    
+                    vector<int>::const_iterator slotBegin =
+                        slotTargetCounts.begin() + (ptrdiff_t)(slot * numTargetCategories);
+                    
+                    copy(slotBegin, slotBegin + (ptrdiff_t)numTargetCategories,
+                         currentTargetCategoryCounts.begin());
+                    
+                    bool naToLessOrEqual = false;
+                    double currentMeasure = learnBranch ?
+                        entropyForSplitWithNa(currentTargetCategoryCounts, naTargetCategoryCounts,
+                                              totalTargetCategoryCounts, naLessOrEqualCounts,
+                                              naToLessOrEqual) :
+                        entropyForSplit(currentTargetCategoryCounts, totalTargetCategoryCounts);
                     
-                    if (index == numSortedIndexes) {
-                        // just finished last finished category; evaluate it
-                        currentMeasure = entropyForSplit(currentTargetCategoryCounts,
-                                                         totalTargetCategoryCounts);
+                    bool pickThis = false;
+                    
+                    if (bestSplit.value.na || currentMeasure < bestSplit.measure) {
+                        // first candidate for split value, or improvement over previous best
+                        pickThis = true;
                         
-                        evaluateCategory = categoryCount > 0;
+                    } else if (currentMeasure == bestSplit.measure) {
+                        // use name as tiebreaker, to eliminate dependence on order of categories
                         
-                    } else {
-                        size_t row = sortedIndexes[col][index];
+                        string nextName = categoryMaps.at(col)->getCategoryForIndex(categoryIndex);
                         
-                        if (rowSelected[row]) {
-                            // handle next row
-                            
-                            // all values should have been imputed by this point
-                            RUNTIME_ERROR_IF(values[col][row].na, "encountered unimputed value");
-                            
-                            currentCategory = values[col][row].number.i;
-                            
-                            if (first) {
-                                // beginning first split category
-                                first = false;
-                                
-                            } else if (currentCategory != previousCategory) {
-                                // category has changed, so evaluate accumulated statistics for
-                                // previous split category
-                                
-                                currentMeasure = entropyForSplit(currentTargetCategoryCounts,
-                                                                 totalTargetCategoryCounts);
-                                
-                                evaluateCategory = true;
-                                
-                                // after calculating measure, reset statistics for new split
-                                // category
-                                categoryCount = 0;
-                                currentTargetCategoryCounts.assign(numTargetCategories, 0);
-                            }
-                            
-                            // accumulate statistics for split category
-                            index_t targetCategory = values[targetColumn][row].number.i;
-                            size_t countsIndex = (size_t)(targetCategory - beginCategoryIndex);
-                            currentTargetCategoryCounts[countsIndex]++;
-                            categoryCount++;
-                        }
+                        pickThis = nextName < bestSplitName;
                     }
                     
-                    if (evaluateCategory) {
-                        // after accumulating statistics for category, see if it is best so far
+                    if (pickThis) {
+                        bestSplit.measure = currentMeasure;
+                        bestSplit.value.number.i = categoryIndex;
+                        bestSplit.value.na = false;
+                        bestSplitName = categoryMaps.at(col)->getCategoryForIndex(categoryIndex);
                         
-                        if (bestSplit.value.na || currentMeasure < bestSplit.measure) {
-                            // first candidate for split value, or improvement over previous
-                            // best
-
-                            bestSplit.measure = currentMeasure;
-                            bestSplit.value.number.i = previousCategory;
-                            bestSplit.value.na = false;
-                            bestSplitName =
-                                categoryMaps.at(col).getCategoryForIndex(previousCategory);
-                            
-                        } else if (currentMeasure == bestSplit.measure) {
-                            // use name as tiebreaker, to eliminate dependence on order
-                            // of categories
-                            
-                            string nextName =
-                                categoryMaps.at(col).getCategoryForIndex(previousCategory);
-                            
-                            if (nextName < bestSplitName) {
-                                bestSplit.measure = currentMeasure;
-                                bestSplit.value.number.i = previousCategory;
-                                bestSplit.value.na = false;
-                                bestSplitName = nextName;
-                            }
+                        if (learnBranch) {
+                            naValue = learnedCategoricalNaValue(naToLessOrEqual, categoryIndex);
                         }
                     }
-                    
-                    previousCategory = currentCategory;
                 }
+                
+                // try sets of more than one category
+                getBestCategorySetForEntropy(slotTargetCounts, categories, naTargetCategoryCounts,
+                                             totalTargetCategoryCounts, learnBranch,
+                                             *categoryMaps.at(col), bestSplit, naValue);
             }
         }
             break;
     }
     
+    bestSplit.naValue = naValue;
+    
+    // for profiling; selected rows are visited once
+    INSTRUMENT_ADD(kCategoricalSplitCalls, 1)
+    INSTRUMENT_ADD(kCategoricalSplitRows, rowIndexes.size())
+    
     return bestSplit;
 }
 
+// return category with biggest count, or NA if all counts are zero; categoryCounts has count for
+// each category in categories; in case of tie, choose category with name that sorts earlier
+// alphabetically, as modeValue() does
+Value modalCategory(const vector<int>& categoryCounts,
+                    const vector<index_t>& categories,
+                    const CategoryMaps& categoryMaps)
+{
+    Value value = gNaValue;
+    
+    int selectedCount = 0;
+    string selectedName;
+    
+    for (size_t slot = 0; slot < categoryCounts.size(); slot++) {
+        index_t categoryIndex = categories[slot];
+        int nextCount = categoryCounts[slot];
+        
+        bool pickThis = false;
+        
+        if (nextCount == 0) {
+            SKIP
+            
+        } else if (value.na || nextCount > selectedCount) {
+            // first (non-empty) category, or bigger than previous so far
+            pickThis = true;
+            
+        } else if (nextCount == selectedCount) {
+            // same size; use name as tie breaker, to enforce deterministic sort order
+            pickThis = categoryMaps.getCategoryForIndex(categoryIndex) < selectedName;
+        }
+        
+        if (pickThis) {
+            value.na = false;
+            value.number.i = categoryIndex;
+            selectedCount = nextCount;
+            selectedName = categoryMaps.getCategoryForIndex(categoryIndex);
+        }
+    }
+    
+    return value;
+}
+
+// calculate weighted standard deviation for a binary split of values plus a group of NA rows,
+// putting NA rows in the branch that gives the smaller result, or if equal then in the branch with
+// more other rows; set naToLessOrEqual for the branch chosen
+double sdForSplitWithNa(double lessThanOrEqualSum,
+                        double lessThanOrEqualSum2,
+                        int lessThanOrEqualCount,
+                        double naSum,
+                        double naSum2,
+                        int naCount,
+                        double totalSum,
+                        double totalSum2,
+                        int totalCount,
+                        bool& naToLessOrEqual)
+{
+    double naGreaterOrNotSd = sdForSplit(lessThanOrEqualSum, lessThanOrEqualSum2,
+                                         lessThanOrEqualCount, totalSum, totalSum2, totalCount);
+    
+    double naLessOrEqualSd = sdForSplit(lessThanOrEqualSum + naSum, lessThanOrEqualSum2 + naSum2,
+                                        lessThanOrEqualCount + naCount, totalSum, totalSum2,
+                                        totalCount);
+    
+    int greaterOrNotCount = totalCount - naCount - lessThanOrEqualCount;
+    
+    naToLessOrEqual = naLessOrEqualSd < naGreaterOrNotSd ||
+        (naLessOrEqualSd == naGreaterOrNotSd && lessThanOrEqualCount >= greaterOrNotCount);
+    
+    return naToLessOrEqual ? naLessOrEqualSd : naGreaterOrNotSd;
+}
+
+// calculate entropy for a binary split of counts plus counts for NA rows, putting NA rows in the
+// branch that gives the smaller result, or if equal then in the branch with more other rows; set
+// naToLessOrEqual for the branch chosen; naLessOrEqualCounts is for temporary use
+double entropyForSplitWithNa(const vector<int>& lessThanOrEqualCounts,
+                             const vector<int>& naCounts,
+                             const vector<int>& totalCounts,
+                             vector<int>& naLessOrEqualCounts,
+                             bool& naToLessOrEqual)
+{
+    int lessThanOrEqualTotal = 0;
+    int naTotal = 0;
+    int total = 0;
+    
+    naLessOrEqualCounts.resize(lessThanOrEqualCounts.size());
+    for (size_t k = 0; k < lessThanOrEqualCounts.size(); k++) {
+        naLessOrEqualCounts[k] = lessThanOrEqualCounts[k] + naCounts[k];
+        
+        lessThanOrEqualTotal += lessThanOrEqualCounts[k];
+        naTotal += naCounts[k];
+        total += totalCounts[k];
+    }
+    
+    double naGreaterOrNotEntropy = entropyForSplit(lessThanOrEqualCounts, totalCounts);
+    double naLessOrEqualEntropy = entropyForSplit(naLessOrEqualCounts, totalCounts);
+    
+    int greaterOrNotTotal = total - naTotal - lessThanOrEqualTotal;
+    
+    naToLessOrEqual = naLessOrEqualEntropy < naGreaterOrNotEntropy ||
+        (naLessOrEqualEntropy == naGreaterOrNotEntropy &&
+         lessThanOrEqualTotal >= greaterOrNotTotal);
+    
+    return naToLessOrEqual ? naLessOrEqualEntropy : naGreaterOrNotEntropy;
+}
+
+// return Value to stand for NA rows of numeric split column: less than or equal to any split value
+// if naToLessOrEqual, else greater
+Value learnedNumericalNaValue(bool naToLessOrEqual)
+{
+    Value value;
+    value.na = false;
+    value.number.d = naToLessOrEqual ? -numeric_limits<double>::infinity() :
+        numeric_limits<double>::infinity();
+    
+    return value;
+}
+
+// return Value to stand for NA rows of categorical split column: equal to splitCategory if
+// naToLessOrEqual, else not equal to any category
+Value learnedCategoricalNaValue(bool naToLessOrEqual, index_t splitCategory)
+{
+    Value value;
+    value.na = false;
+    
+    // NO_INDEX is used only by NA category, which is not used unless imputing to category
+    value.number.i = naToLessOrEqual ? splitCategory : NO_INDEX;
+    
+    return value;
+}
+
+// for categorical split column and numeric target column; sort categories present at node by mean
+// of target, then try each division of sorted list into two sets, which finds best division in one
+// pass (Breiman et al. 1984); if a set of more than one category beats single-category bestSplit,
+// replace bestSplit and naValue; statistics are indexed by slot, and categories gives category in
+// each slot
+void getBestCategorySetForSd(const vector<double>& categorySum,
+                             const vector<double>& categorySum2,
+                             const vector<int>& categoryCount,
+                             const vector<index_t>& categories,
+                             double naSum,
+                             double naSum2,
+                             int naCount,
+                             double totalSum,
+                             double totalSum2,
+                             int totalCount,
+                             bool learnBranch,
+                             const CategoryMaps& categoryMaps,
+                             ValueAndMeasure& bestSplit,
+                             Value& naValue)
+{
+    vector<size_t> order;
+    vector<double> means(categoryCount.size(), 0.0);
+    
+    for (size_t slot = 0; slot < categoryCount.size(); slot++) {
+        if (categoryCount[slot] >= 1) {
+            order.push_back(slot);
+            means[slot] = categorySum[slot] / categoryCount[slot];
+        }
+    }
+    
+    // with two categories, the only division is one category against the other, already tried
+    if (order.size() > 2 && !bestSplit.value.na) {
+        CategoryKeyLess keyLess = { &means, &categories, &categoryMaps };
+        sort(order.begin(), order.end(), keyLess);
+        
+        double lessThanOrEqualSum = 0.0;
+        double lessThanOrEqualSum2 = 0.0;
+        int lessThanOrEqualCount = 0;
+        
+        double bestMeasure = bestSplit.measure;
+        size_t bestSetSize = 0;
+        bool bestNaToLessOrEqual = false;
+        
+        // first k + 1 categories in sorted order go to less-or-equal branch; sets of one category,
+        // and their complements, were already tried
+        INSTRUMENT_ADD(kSplitCandidates, order.size() - 3)
+        
+        for (size_t k = 0; k + 2 < order.size(); k++) {
+            size_t slot = order[k];
+            
+            lessThanOrEqualSum += categorySum[slot];
+            lessThanOrEqualSum2 += categorySum2[slot];
+            lessThanOrEqualCount += categoryCount[slot];
+            
+            if (k > 0) {
+                bool naToLessOrEqual = false;
+                double setMeasure = learnBranch ?
+                    sdForSplitWithNa(lessThanOrEqualSum, lessThanOrEqualSum2, lessThanOrEqualCount,
+                                     naSum, naSum2, naCount, totalSum, totalSum2, totalCount,
+                                     naToLessOrEqual) :
+                    sdForSplit(lessThanOrEqualSum, lessThanOrEqualSum2, lessThanOrEqualCount,
+                               totalSum, totalSum2, totalCount);
+                
+                // keep single category unless set is strictly better, so that set splits appear
+                // only where they help
+                if (setMeasure < bestMeasure) {
+                    bestMeasure = setMeasure;
+                    bestSetSize = k + 1;
+                    bestNaToLessOrEqual = naToLessOrEqual;
+                }
+            }
+        }
+        
+        if (bestSetSize > 0) {
+            vector<index_t> setCategories;
+            for (size_t k = 0; k < bestSetSize; k++) {
+                setCategories.push_back(categories[order[k]]);
+            }
+            
+            bestSplit.measure = bestMeasure;
+            bestSplit.value.number.i = setCategories[0];
+            bestSplit.categorySet.clear();
+            appendCategorySet(setCategories, bestSplit.categorySet);
+            
+            if (learnBranch) {
+                naValue = learnedCategoricalNaValue(bestNaToLessOrEqual, setCategories[0]);
+            }
+        }
+    }
+}
+
+// for categorical split column and categorical target column; as getBestCategorySetForSd(), but
+// sort categories by fraction of rows in most common target category of node, which finds best
+// division for two target categories, and a good one for more; slotTargetCounts has count for each
+// target category for each slot in turn, and categories gives category in each slot
+void getBestCategorySetForEntropy(const vector<int>& slotTargetCounts,
+                                  const vector<index_t>& categories,
+                                  const vector<int>& naTargetCategoryCounts,
+                                  const vector<int>& totalTargetCategoryCounts,
+                                  bool learnBranch,
+                                  const CategoryMaps& categoryMaps,
+                                  ValueAndMeasure& bestSplit,
+                                  Value& naValue)
+{
+    size_t numTargetCategories = totalTargetCategoryCounts.size();
+    
+    size_t commonTarget = 0;
+    for (size_t k = 1; k < numTargetCategories; k++) {
+        if (totalTargetCategoryCounts[k] > totalTargetCategoryCounts[commonTarget]) {
+            commonTarget = k;
+        }
+    }
+    
+    vector<size_t> order;
+    vector<double> fractions(categories.size(), 0.0);
+    
+    for (size_t slot = 0; slot < categories.size(); slot++) {
+        const int *counts = &slotTargetCounts[slot * numTargetCategories];
+        
+        int count = 0;
+        for (size_t k = 0; k < numTargetCategories; k++) {
+            count += counts[k];
+        }
+        
+        if (count > 0) {
+            order.push_back(slot);
+            fractions[slot] = (double)counts[commonTarget] / count;
+        }
+    }
+    
+    // with two categories, the only division is one category against the other, already tried
+    if (order.size() > 2 && !bestSplit.value.na) {
+        CategoryKeyLess keyLess = { &fractions, &categories, &categoryMaps };
+        sort(order.begin(), order.end(), keyLess);
+        
+        vector<int> lessThanOrEqualCounts(numTargetCategories, 0);
+        vector<int> naLessOrEqualCounts(learnBranch ? numTargetCategories : 0, 0);
+        
+        double bestMeasure = bestSplit.measure;
+        size_t bestSetSize = 0;
+        bool bestNaToLessOrEqual = false;
+        
+        // first k + 1 categories in sorted order go to less-or-equal branch; sets of one category,
+        // and their complements, were already tried
+        INSTRUMENT_ADD(kSplitCandidates, order.size() - 3)
+        
+        for (size_t k = 0; k + 2 < order.size(); k++) {
+            const int *counts = &slotTargetCounts[order[k] * numTargetCategories];
+            
+            for (size_t target = 0; target < numTargetCategories; target++) {
+                lessThanOrEqualCounts[target] += counts[target];
+            }
+            
+            if (k > 0) {
+                bool naToLessOrEqual = false;
+                double setMeasure = learnBranch ?
+                    entropyForSplitWithNa(lessThanOrEqualCounts, naTargetCategoryCounts,
+                                          totalTargetCategoryCounts, naLessOrEqualCounts,
+                                          naToLessOrEqual) :
+                    entropyForSplit(lessThanOrEqualCounts, totalTargetCategoryCounts);
+                
+                // keep single category unless set is strictly better, so that set splits appear
+                // only where they help
+                if (setMeasure < bestMeasure) {
+                    bestMeasure = setMeasure;
+                    bestSetSize = k + 1;
+                    bestNaToLessOrEqual = naToLessOrEqual;
+                }
+            }
+        }
+        
+        if (bestSetSize > 0) {
+            vector<index_t> setCategories;
+            for (size_t k = 0; k < bestSetSize; k++) {
+                setCategories.push_back(categories[order[k]]);
+            }
+            
+            bestSplit.measure = bestMeasure;
+            bestSplit.value.number.i = setCategories[0];
+            bestSplit.categorySet.clear();
+            appendCategorySet(setCategories, bestSplit.categorySet);
+            
+            if (learnBranch) {
+                naValue = learnedCategoricalNaValue(bestNaToLessOrEqual, setCategories[0]);
+            }
+        }
+    }
+}
+
+// return true if rows with category go to less-or-equal branch of split on splitValue, or on
+// splitCategorySet if not empty
+bool isLessOrEqualCategory(index_t category,
+                           const Value& splitValue,
+                           const vector<unsigned int>& splitCategorySet)
+{
+    bool result;
+    
+    if (splitCategorySet.empty()) {
+        result = category == splitValue.number.i;
+        
+    } else {
+        result = isInCategorySet(category, &splitCategorySet[0]);
+    }
+    
+    return result;
+}
+
 // try to improve leaf that has potential for improvement (i.e., not already perfect)
 bool improveImperfectLeaf(TreeNode *nodeP,
                           const vector<size_t>& subsetIndexes,
                           const vector< vector<Value> >& values,
                           const vector<ValueType>& valueTypes,
-                          const vector<CategoryMaps>& categoryMaps,
+                          const vector<const CategoryMaps *>& categoryMaps,
                           const SelectIndexes& selectColumns,
                           size_t targetColumn,
                           const vector< vector<size_t> >& sortedIndexes,
@@ -1445,7 +2650,9 @@ bool improveImperfectLeaf(TreeNode *nodeP,
                           double minImprovement,
                           index_t minLeafCount,
                           index_t maxSplitsPerNumericAttribute,
-                          const vector<Value>& imputedValues)
+                          const vector<Value>& imputedValues,
+                          const vector<ImputeOption>& imputeOptions,
+                          size_t& nextIndex)
 {
     if (gVerbose) CERR << "improveImperfectLeaf" << endl;
     
@@ -1459,6 +2666,8 @@ bool improveImperfectLeaf(TreeNode *nodeP,
     size_t numSubsetCols = subsetIndexes.size();
     
     vector<Value> splitValues(numSubsetCols);
+    vector<Value> naValues(numSubsetCols, gNaValue);
+    vector< vector<unsigned int> > categorySets(numSubsetCols);
     vector<Value> lessOrEqualValues(numSubsetCols);
     vector<Value> greaterOrNotValues(numSubsetCols);
     
@@ -1471,7 +2680,8 @@ bool improveImperfectLeaf(TreeNode *nodeP,
         
         if (gVerbose) CERR << endl << colNames.at(col) << endl;
         
-        ValueAndMeasure bestSplit =  { { { 0.0 }, false }, 0.0 };
+        ValueAndMeasure bestSplit =
+            { { { 0.0 }, false }, 0.0, { { 0.0 }, true }, vector<unsigned int>() };
         bestSplit.value = gNaValue;
         
         switch(valueTypes.at(col)) {
@@ -1479,8 +2689,8 @@ bool improveImperfectLeaf(TreeNode *nodeP,
             {
                 // next trial column is categorical
                 bestSplit = getBestCategoricalSplit(col, targetColumn, selectRows, values,
-                                                    valueTypes, categoryMaps, sortedIndexes,
-                                                    colNames);
+                                                    valueTypes, categoryMaps,
+                                                    imputeOptions.at(col));
                 
                 if (bestSplit.value.na) {
                     // no split found
@@ -1496,7 +2706,9 @@ bool improveImperfectLeaf(TreeNode *nodeP,
                 } else {
                     // found best split for this column
                     splitValues[siIndex] = bestSplit.value;
+                    naValues[siIndex] = bestSplit.naValue;
                     colMeasures[siIndex] = bestSplit.measure;
+                    categorySets[siIndex] = bestSplit.categorySet;
                     
                     // determine rows that go to each side of split
                     SelectIndexes selectLessOrEqualTo(numRows, false);
@@ -1506,15 +2718,25 @@ bool improveImperfectLeaf(TreeNode *nodeP,
                     for (size_t rowIndex = 0; rowIndex < rowIndexes.size(); rowIndex++) {
                         size_t row = rowIndexes[rowIndex];
                         if (!values[col][row].na) {
-                            if (values[col][row].number.i == bestSplit.value.number.i) {
+                            if (isLessOrEqualCategory(values[col][row].number.i, bestSplit.value,
+                                                      bestSplit.categorySet)) {
                                 selectLessOrEqualTo.select(row);
                                 
                             } else {
                                 selectGreaterThan.select(row);
                             }
                             
+                        } else if (bestSplit.naValue.na) {
+                            // not imputed; leave out of both sides
+                            SKIP
+                            
+                        } else if (isLessOrEqualCategory(bestSplit.naValue.number.i,
+                                                         bestSplit.value, bestSplit.categorySet)) {
+                            // imputed for this node
+                            selectLessOrEqualTo.select(row);
+                            
                         } else {
-                            // TODO handle imputation and incorporate NA values here 
+                            selectGreaterThan.select(row);
                         }
                     }
                     
@@ -1523,11 +2745,11 @@ bool improveImperfectLeaf(TreeNode *nodeP,
                         case kCategorical:
                             lessOrEqualValues[siIndex] = modeValue(values[targetColumn],
                                                                    selectLessOrEqualTo,
-                                                                   categoryMaps.at(targetColumn));
+                                                                   *categoryMaps.at(targetColumn));
                             
                             greaterOrNotValues[siIndex] = modeValue(values[targetColumn],
                                                                     selectGreaterThan,
-                                                                    categoryMaps.at(targetColumn));
+                                                                    *categoryMaps.at(targetColumn));
                             break;
                             
                         case kNumeric:
@@ -1540,8 +2762,9 @@ bool improveImperfectLeaf(TreeNode *nodeP,
                     }
                     
                     if (gVerbose) {
-                        string category =
-                            categoryMaps.at(col).getCategoryForIndex(bestSplit.value.number.i);
+                        string category = bestSplit.categorySet.empty() ?
+                            categoryMaps.at(col)->getCategoryForIndex(bestSplit.value.number.i) :
+                            categorySetToString(&bestSplit.categorySet[0], *categoryMaps.at(col));
                         
                         CERR << "    best split " << category <<
                         " measure " << bestSplit.measure << endl;
@@ -1576,7 +2799,7 @@ bool improveImperfectLeaf(TreeNode *nodeP,
                     
                     bestSplit = getBestNumericalSplit(col, targetColumn, selectRows, values,
                                                       valueTypes, categoryMaps, sortedIndexes,
-                                                      colNames);
+                                                      imputeOptions.at(col));
                 }
                 
                 if (bestSplit.value.na) {
@@ -1595,6 +2818,7 @@ bool improveImperfectLeaf(TreeNode *nodeP,
                 } else {
                     // found best split for this column
                     splitValues[siIndex] = bestSplit.value;
+                    naValues[siIndex] = bestSplit.naValue;
                     colMeasures[siIndex] = bestSplit.measure;
                     
                     // determine rows that go to each side of split
@@ -1612,8 +2836,16 @@ bool improveImperfectLeaf(TreeNode *nodeP,
                                 selectGreaterThan.select(row);
                             }
                             
+                        } else if (bestSplit.naValue.na) {
+                            // not imputed; leave out of both sides
+                            SKIP
+                            
+                        } else if (bestSplit.naValue.number.d <= bestSplit.value.number.d) {
+                            // imputed for this node
+                            selectLessOrEqualTo.select(row);
+                            
                         } else {
-                            // TODO handle imputation and incorporate NA values here 
+                            selectGreaterThan.select(row);
                         }
                     }
                     
@@ -1622,11 +2854,11 @@ bool improveImperfectLeaf(TreeNode *nodeP,
                         case kCategorical:
                             lessOrEqualValues[siIndex] = modeValue(values[targetColumn],
                                                                    selectLessOrEqualTo,
-                                                                   categoryMaps.at(targetColumn));
+                                                                   *categoryMaps.at(targetColumn));
                             
                             greaterOrNotValues[siIndex] = modeValue(values[targetColumn],
                                                                     selectGreaterThan,
-                                                                    categoryMaps.at(targetColumn));
+                                                                    *categoryMaps.at(targetColumn));
                             break;
                             
                         case kNumeric:
@@ -1680,8 +2912,8 @@ bool improveImperfectLeaf(TreeNode *nodeP,
             case kCategorical:
             {
                 // calculate leaf measure
-                size_t numTargetCategories = categoryMaps.at(targetColumn).countAllCategories();
-                index_t beginCategoryIndex = categoryMaps.at(targetColumn).beginIndex();
+                size_t numTargetCategories = categoryMaps.at(targetColumn)->countAllCategories();
+                index_t beginCategoryIndex = categoryMaps.at(targetColumn)->beginIndex();
                 
                 int leafTotal = 0;
                 vector<int> leafCounts(numTargetCategories, 0);
@@ -1736,7 +2968,7 @@ bool improveImperfectLeaf(TreeNode *nodeP,
                     size_t columnIndex = subsetIndexes[bestSiIndex];
                     size_t col = selectColumnIndexes[columnIndex];
                     if (valueTypes.at(col) == kCategorical) {
-                        factor = categoryMaps.at(col).countAllCategories();   
+                        factor = categoryMaps.at(col)->countAllCategories();   
                     }
                     
                     delta *= factor;
@@ -1758,6 +2990,7 @@ bool improveImperfectLeaf(TreeNode *nodeP,
         // we have improvement - create split in tree
         
         Value splitValue = splitValues[bestSiIndex];
+        const vector<unsigned int>& splitCategorySet = categorySets[bestSiIndex];
         
         // new TreeNode
         TreeNode *lessOrEqualNode = new TreeNode;
@@ -1771,7 +3004,7 @@ bool improveImperfectLeaf(TreeNode *nodeP,
         lessOrEqualNode->leafLessOrEqualCount = 0;          
         lessOrEqualNode->leafGreaterOrNotCount = 0;
         lessOrEqualNode->selectRows.clear(numRows);
-        lessOrEqualNode->index = gNextIndex++;
+        lessOrEqualNode->index = nextIndex++;
         
         // new TreeNode
         TreeNode *greaterOrNotNode = new TreeNode;
@@ -1785,7 +3018,9 @@ bool improveImperfectLeaf(TreeNode *nodeP,
         greaterOrNotNode->leafLessOrEqualCount = 0;          
         greaterOrNotNode->leafGreaterOrNotCount = 0;
         greaterOrNotNode->selectRows.clear(numRows);
-        greaterOrNotNode->index = gNextIndex++;
+        greaterOrNotNode->index = nextIndex++;
+        
+        INSTRUMENT_ADD(kNodesCreated, 2)
         
         size_t splitColIndex = subsetIndexes[bestSiIndex];
         size_t col = selectColumnIndexes[splitColIndex];
@@ -1805,19 +3040,25 @@ bool improveImperfectLeaf(TreeNode *nodeP,
                 break;
         }
 
+        // value imputed for NA at this node if imputing per branch
+        Value naValue = naValues[bestSiIndex];
+        
         const vector<size_t>& rowIndexes = selectRows.indexVector();
         for (size_t rowIndex = 0; rowIndex < rowIndexes.size(); rowIndex++) {
             size_t row = rowIndexes[rowIndex];
             
             bool isLessOrEqual = false;
             
+            const Value& rowValue = values.at(col)[row].na ? naValue : values.at(col)[row];
+            
             switch(valueTypes.at(col)) {
                 case kCategorical:
-                    isLessOrEqual = values.at(col)[row].number.i == splitValue.number.i;
+                    isLessOrEqual = isLessOrEqualCategory(rowValue.number.i, splitValue,
+                                                          splitCategorySet);
                     break;
                     
                 case kNumeric:
-                    isLessOrEqual = values.at(col)[row].number.d <= splitValue.number.d;
+                    isLessOrEqual = rowValue.number.d <= splitValue.number.d;
                     break;
             }
             
@@ -1898,12 +3139,14 @@ bool improveImperfectLeaf(TreeNode *nodeP,
         if (splitLessOrEqualCount >= minLeafCount && splitGreaterOrNotCount >= minLeafCount) {
             // modify TreeNode for split
             nodeP->splitValue = splitValue;
+            nodeP->splitCategorySet = splitCategorySet;
             nodeP->splitColIndex = (index_t)splitColIndex;
             nodeP->lessOrEqualNode = lessOrEqualNode;
             nodeP->greaterOrNotNode = greaterOrNotNode;
             
             bool toLessOrEqualIfNA = false;
-            Value imputed = imputedValues[col];
+            Value imputed = isBranchImputeOption(imputeOptions.at(col)) ? naValue :
+                imputedValues[col];
             
             switch(valueTypes.at(col)) {
                 case kNumeric:
@@ -1911,7 +3154,8 @@ bool improveImperfectLeaf(TreeNode *nodeP,
                     break;
                     
                 case kCategorical:
-                    toLessOrEqualIfNA = !imputed.na && imputed.number.i == splitValue.number.i;
+                    toLessOrEqualIfNA = !imputed.na &&
+                        isLessOrEqualCategory(imputed.number.i, splitValue, splitCategorySet);
                     break;
             }
             
@@ -1921,6 +3165,8 @@ bool improveImperfectLeaf(TreeNode *nodeP,
             // back out - not improved
             delete lessOrEqualNode;
             delete greaterOrNotNode;
+            
+            INSTRUMENT_ADD(kNodesBackedOut, 2)
             improved = false;
         }
     }
@@ -1934,7 +3180,7 @@ bool improveLeaf(TreeNode *nodeP,
                  const vector<size_t>& subsetIndexes,
                  const vector< vector<Value> >& values,
                  const vector<ValueType>& valueTypes,
-                 const vector<CategoryMaps>& categoryMaps,
+                 const vector<const CategoryMaps *>& categoryMaps,
                  const SelectIndexes& selectColumns,
                  size_t targetColumn,
                  const vector< vector<size_t> >& sortedIndexes,
@@ -1942,7 +3188,9 @@ bool improveLeaf(TreeNode *nodeP,
                  double minImprovement,
                  index_t minLeafCount,
                  index_t maxSplitsPerNumericAttribute,
-                 const vector<Value>& imputedValues)
+                 const vector<Value>& imputedValues,
+                 const vector<ImputeOption>& imputeOptions,
+                 size_t& nextIndex)
 {
     bool improved = false;
     
@@ -1961,7 +3209,7 @@ bool improveLeaf(TreeNode *nodeP,
                                                 categoryMaps, selectColumns, targetColumn,
                                                 sortedIndexes, colNames, minImprovement,
                                                 minLeafCount, maxSplitsPerNumericAttribute,
-                                                imputedValues);
+                                                imputedValues, imputeOptions, nextIndex);
             }
         }
             break;
@@ -1978,7 +3226,7 @@ bool improveLeaf(TreeNode *nodeP,
                                                 categoryMaps, selectColumns, targetColumn,
                                                 sortedIndexes, colNames, minImprovement,
                                                 minLeafCount, maxSplitsPerNumericAttribute,
-                                                imputedValues);
+                                                imputedValues, imputeOptions, nextIndex);
             }
         }
             break;
@@ -1992,20 +3240,23 @@ void evaluateTree(CompactTree& compactTree,
                   int maxDepth,
                   int maxNodes,
                   int& maxDepthUsed,
+                  size_t& rowsScanned,
                   bool doPrune,
+                  bool pruneAfterGrowing,     // for testing; prune with pruneTree() when tree done
                   double minImprovement,
                   index_t minLeafCount,
                   index_t maxSplitsPerNumericAttribute,
                   const vector< vector<Value> >& values,
                   const vector<ValueType>& valueTypes, 
-                  const vector<CategoryMaps>& categoryMaps,
+                  const vector<const CategoryMaps *>& categoryMaps,
                   const vector<size_t>& subsetIndexes,
                   const SelectIndexes& selectRows,
                   const SelectIndexes& selectColumns,
                   size_t targetColumn,
                   const vector< vector<size_t> >& sortedIndexes,
                   const vector<string>& colNames,
-                  const vector<Value>& imputedValues)
+                  const vector<Value>& imputedValues,
+                  const vector<ImputeOption>& imputeOptions)
 {
     time_t startTime;
     time(&startTime);
@@ -2032,7 +3283,7 @@ void evaluateTree(CompactTree& compactTree,
             
         case kCategorical:
             defaultValue = modeValue(values[targetColumn], selectRows,
-                                     categoryMaps.at(targetColumn));
+                                     *categoryMaps.at(targetColumn));
             break;
     }
     
@@ -2047,7 +3298,7 @@ void evaluateTree(CompactTree& compactTree,
     root.leafLessOrEqualCount = 0;
     root.leafGreaterOrNotCount = 0;
     root.selectRows = selectRows;
-    root.index = gNextIndex++;
+    root.index = 0;
     
     index_t numSelectedRows = 0;
     
@@ -2099,17 +3350,20 @@ void evaluateTree(CompactTree& compactTree,
             break;
     }
 
-    gNextIndex = 0; // start indexes from zero
+    size_t nextIndex = 0;   // counts nodes created below root, for maxNodes
 
     // initialize values updated in improveSubtree()
     maxDepthUsed = 1;
     index_t finalLeafCount = 0;
+    rowsScanned = 0;
     
-    // recursively improve tree beginning from root node
-    improveSubtree(&root, 1, maxDepth, maxNodes, maxDepthUsed, subsetIndexes, values, valueTypes,
-                   categoryMaps, selectColumns, targetColumn, sortedIndexes, colNames,
-                   minImprovement, minLeafCount, maxSplitsPerNumericAttribute,finalLeafCount,
-                   imputedValues);
+    // recursively improve tree beginning from root node; unless pruneAfterGrowing, each subtree is
+    // pruned as soon as it is complete
+    bool pruneWhileGrowing = doPrune && !pruneAfterGrowing;
+    improveSubtree(&root, 1, maxDepth, maxNodes, maxDepthUsed, pruneWhileGrowing, subsetIndexes,
+                   values, valueTypes, categoryMaps, selectColumns, targetColumn, sortedIndexes,
+                   colNames, minImprovement, minLeafCount, maxSplitsPerNumericAttribute,
+                   finalLeafCount, rowsScanned, imputedValues, imputeOptions, nextIndex);
     
     if (gVerbose2) {
         CERR << endl << "Before pruning:" << endl;
@@ -2119,8 +3373,10 @@ void evaluateTree(CompactTree& compactTree,
     
     // ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~
     
-    if (doPrune) {
+    if (doPrune && pruneAfterGrowing) {
+        INSTRUMENT_TIME_BEGIN(pruneStart)
         pruneTree(root, values, valueTypes, targetColumn, categoryMaps, sortedIndexes, colNames);
+        INSTRUMENT_TIME_END(kPruneMicroseconds, pruneStart)
         
         if (gVerbose2) {
             CERR << endl << "After pruning:" << endl;
@@ -2145,6 +3401,12 @@ void evaluateTree(CompactTree& compactTree,
     
 }
 
+// for ctest_train; TrainProgressFunction that appends progress to vector<TrainProgress> at context
+void collectTrainProgress(const TrainProgress& progress, void *context)
+{
+    ((vector<TrainProgress> *)context)->push_back(progress);
+}
+
 // ========== Tests ================================================================================
 
 // component tests
@@ -2156,9 +3418,239 @@ void ctest_train(int& totalPassed, int& totalFailed, bool verbose)
     // ~~~~~~~~~~~~~~~~~~~~~~
     // train 
 
+    {
+        // trees grown on several threads should be same, and in same order, as trees grown on one
+        // thread; last batch of trees is partly filled, and some trees are dropped by minDepth;
+        // with long interval, progress is reported only once, when all trees are done
+        
+        ostringstream csv;
+        csv << "X1,X2,X3,X4,X5,Y,Z" << endl;
+        
+        unsigned long seed = 54321;
+        for (int row = 0; row < 200; row++) {
+            double x[5];
+            for (int k = 0; k < 5; k++) {
+                seed = (seed * 1103515245 + 12345) % 2147483648UL;
+                x[k] = (double)(seed % 1000) / 1000.0;
+            }
+            
+            csv << x[0] << "," << x[1] << "," << x[2] << "," << (x[3] < 0.5 ? "P" : "Q") << "," <<
+                   x[4] << "," << (x[0] + x[1] > 1.0 ? "A" : "B") << "," <<
+                   3 * x[0] + (x[3] < 0.5 ? x[2] : 0.0) << endl;
+        }
+        
+        vector< vector<Value> > values;
+        vector<ValueType> valueTypes;
+        vector<CategoryMaps> categoryMaps;
+        vector<string> colNames;
+        vector< vector<string> > cells;
+        vector< vector<bool> > quoted;
+        
+        readCsvString(csv.str(), cells, quoted, colNames);
+        getDefaultValueTypes(cells, quoted, true, "NA", valueTypes);
+        cellsToValues(cells, quoted, valueTypes, true, "NA", values, false, categoryMaps);
+        
+        SelectIndexes selectRows(values[0].size(), true);
+        bool same = true;
+        
+        for (size_t targetColumn = 5; targetColumn <= 6; targetColumn++) {
+            SelectIndexes availableColumns(values.size(), true);
+            availableColumns.unselect(5);
+            availableColumns.unselect(6);
+            
+            vector<CompactTree> trees[2];
+            SelectIndexes selectColumns;
+            vector<TrainProgress> reports;
+            
+            for (int pass = 0; pass < 2; pass++) {
+                vector< vector<Value> > trainValues = values;
+                vector<CategoryMaps> trainCategoryMaps = categoryMaps;
+                vector<ImputeOption> imputeOptions(values.size(), kToDefault);
+                
+                if (pass == 1) {
+                    setTrainProgress(collectTrainProgress, &reports, 1.0e9);
+                }
+                
+                train(trees[pass], 2, 100, 12, false, 0.0, 1, -1, 10, 0, selectRows,
+                      availableColumns, selectColumns, trainValues, valueTypes, trainCategoryMaps,
+                      targetColumn, colNames, imputeOptions, pass == 0 ? 1 : 4);
+                
+                setTrainProgress(NULL, NULL, 0.0);
+            }
+            
+            same = same && reports.size() == 1 &&
+                   reports[0].treesCompleted == reports[0].treesTotal &&
+                   reports[0].treesKept == trees[1].size() &&
+                   reports[0].treesKept < reports[0].treesCompleted &&
+                   reports[0].nodesSplit > 0 && reports[0].rowsScanned > 0 &&
+                   reports[0].secondsRemaining == 0.0;
+            
+            // tree values have unused bytes zeroed by compressTree, so can be compared as bytes
+            same = same && trees[0].size() == trees[1].size() && trees[0].size() > 0;
+            for (size_t treeIndex = 0; treeIndex < trees[0].size() && same; treeIndex++) {
+                const CompactTree& tree0 = trees[0][treeIndex];
+                const CompactTree& tree1 = trees[1][treeIndex];
+                
+                same = tree0.splitColIndex == tree1.splitColIndex &&
+                       tree0.lessOrEqualIndex == tree1.lessOrEqualIndex &&
+                       tree0.greaterOrNotIndex == tree1.greaterOrNotIndex &&
+                       tree0.toLessOrEqualIfNA == tree1.toLessOrEqualIfNA &&
+                       tree0.categorySetIndex == tree1.categorySetIndex &&
+                       tree0.categorySets == tree1.categorySets &&
+                       tree0.value.size() == tree1.value.size() &&
+                       memcmp(&tree0.value[0], &tree1.value[0],
+                              tree0.value.size() * sizeof(Number)) == 0;
+            }
+        }
+        
+        if (same) passed++; else failed++;
+    }
+
+    // ~~~~~~~~~~~~~~~~~~~~~~
+    // fillTreeBlock
+    // unpackTreeColumns
+    
+    {
+        // block holds subset columns in subset order, then target; split columns map back to
+        // indexes into selectColumns
+        
+        size_t numRows = 6;
+        vector< vector<Value> > values(5, vector<Value>(numRows, gNaValue));
+        for (size_t col = 0; col < values.size(); col++) {
+            for (size_t row = 0; row < numRows; row++) {
+                values[col][row].na = false;
+                values[col][row].number.d = (double)(col * 10 + (row * 5) % numRows);
+            }
+        }
+        
+        vector<ValueType> valueTypes(values.size(), kNumeric);
+        vector<CategoryMaps> categoryMaps(values.size());
+        vector<string> colNames;
+        colNames.push_back("A");
+        colNames.push_back("B");
+        colNames.push_back("C");
+        colNames.push_back("D");
+        colNames.push_back("Y");
+        vector<Value> imputedValues(values.size(), gNaValue);
+        vector<ImputeOption> imputeOptions(values.size(), kToMean);
+        
+        // column 1 and target column not selected, so selected columns are 0, 2, 3
+        SelectIndexes selectColumns(5, true);
+        selectColumns.unselect(1);
+        selectColumns.unselect(4);
+        
+        vector< vector<size_t> > sortedIndexes;
+        makeSortedIndexes(values, valueTypes, selectColumns, sortedIndexes, 1);
+        
+        vector<size_t> subset;
+        subset.push_back(2);
+        subset.push_back(0);
+        
+        TreeBlock block;
+        for (int pass = 0; pass < 2; pass++) {
+            fillTreeBlock(subset, selectColumns, 4, values, valueTypes, categoryMaps,
+                          sortedIndexes, colNames, imputedValues, imputeOptions, block);
+        }
+        
+        bool same = block.values.size() == 3 && block.targetColumn == 2;
+        
+        size_t expectedCols[] = { 3, 0, 4 };
+        for (size_t k = 0; k < 3 && same; k++) {
+            for (size_t row = 0; row < numRows; row++) {
+                same = same && block.values[k].size() == numRows &&
+                       block.values[k][row].number.d == values[expectedCols[k]][row].number.d;
+            }
+        }
+        
+        same = same && block.sortedIndexes[0] == sortedIndexes[3] &&
+                    block.sortedIndexes[1] == sortedIndexes[0] &&
+                    block.categoryMaps[0] == &categoryMaps[3] &&
+                    block.categoryMaps[2] == &categoryMaps[4] &&
+                    block.colNames[0] == "D" && block.colNames[2] == "Y" &&
+                    block.selectColumns.countSelected() == 2 &&
+                    !block.selectColumns.boolVector()[2] &&
+                    block.subsetIndexes.size() == 2 && block.subsetIndexes[1] == 1;
+        
+        CompactTree compactTree;
+        compactTree.splitColIndex.push_back(1);
+        compactTree.splitColIndex.push_back(NO_INDEX);
+        compactTree.splitColIndex.push_back(0);
+        
+        unpackTreeColumns(compactTree, subset);
+        
+        same = same && compactTree.splitColIndex[0] == 0 &&
+               compactTree.splitColIndex[1] == NO_INDEX && compactTree.splitColIndex[2] == 2;
+        
+        if (same) passed++; else failed++;
+    }
+
     // ~~~~~~~~~~~~~~~~~~~~~~
     // deleteSubtrees
     
+    // ~~~~~~~~~~~~~~~~~~~~~~
+    // compressTree
+    
+    {
+        // split with equal leaves collapses, which makes both branches of root identical, so tree
+        // becomes one split; predictions unchanged
+        
+        index_t splitColIndex[] =     { 0, 1, NO_INDEX, NO_INDEX, 1, NO_INDEX, 0, NO_INDEX,
+                                        NO_INDEX };
+        index_t lessOrEqualIndex[] =  { 1, 2, NO_INDEX, NO_INDEX, 5, NO_INDEX, 7, NO_INDEX,
+                                        NO_INDEX };
+        index_t greaterOrNotIndex[] = { 4, 3, NO_INDEX, NO_INDEX, 6, NO_INDEX, 8, NO_INDEX,
+                                        NO_INDEX };
+        double value[] = { 0.5, 2.0, 10.0, 20.0, 2.0, 10.0, 0.8, 20.0, 20.0 };
+        
+        CompactTree tree;
+        for (size_t nodeIndex = 0; nodeIndex < 9; nodeIndex++) {
+            Number number;
+            number.d = value[nodeIndex];
+            
+            tree.splitColIndex.push_back(splitColIndex[nodeIndex]);
+            tree.lessOrEqualIndex.push_back(lessOrEqualIndex[nodeIndex]);
+            tree.greaterOrNotIndex.push_back(greaterOrNotIndex[nodeIndex]);
+            tree.toLessOrEqualIfNA.push_back(nodeIndex == 6);
+            tree.value.push_back(number);
+            tree.categorySetIndex.push_back(NO_INDEX);
+        }
+        
+        vector<ValueType> valueTypes(3, kNumeric);
+        SelectIndexes selectColumns(3, true);
+        selectColumns.unselect(2);
+        
+        CompactTree compressed = tree;
+        compressTree(compressed, valueTypes, 2, selectColumns);
+        
+        bool same = compressed.value.size() == 3 && compressed.splitColIndex[0] == 1 &&
+                    compressed.value[0].d == 2.0;
+        
+        for (double x0 = 0.0; x0 < 1.0 && same; x0 += 0.25) {
+            for (double x1 = 1.0; x1 < 3.0 && same; x1 += 0.5) {
+                double x[] = { x0, x1 };
+                double result[2];
+                
+                for (int pass = 0; pass < 2; pass++) {
+                    const CompactTree& nextTree = pass == 0 ? tree : compressed;
+                    
+                    size_t nodeIndex = 0;
+                    while (nextTree.splitColIndex[nodeIndex] != NO_INDEX) {
+                        nodeIndex = x[nextTree.splitColIndex[nodeIndex]] <=
+                                    nextTree.value[nodeIndex].d ?
+                                        (size_t)nextTree.lessOrEqualIndex[nodeIndex] :
+                                        (size_t)nextTree.greaterOrNotIndex[nodeIndex];
+                    }
+                    
+                    result[pass] = nextTree.value[nodeIndex].d;
+                }
+                
+                same = result[0] == result[1];
+            }
+        }
+        
+        if (same) passed++; else failed++;
+    }
+    
     // ~~~~~~~~~~~~~~~~~~~~~~
     // printCompactTrees
 
@@ -2171,6 +3663,110 @@ void ctest_train(int& totalPassed, int& totalFailed, bool verbose)
     // ~~~~~~~~~~~~~~~~~~~~~~
     // evaluateTree
 
+    {
+        // pruning each subtree as it completes gives same trees as pruning after growing; noisy
+        // target so that pruning removes some subtrees
+        
+        ostringstream csv;
+        csv << "X1,X2,X3,Y,Z" << endl;
+        
+        unsigned long seed = 12345;
+        for (int row = 0; row < 300; row++) {
+            double x[3];
+            for (int k = 0; k < 3; k++) {
+                seed = (seed * 1103515245 + 12345) % 2147483648UL;
+                x[k] = (double)(seed % 1000) / 1000.0;
+            }
+            
+            bool noisy = x[2] < 0.25;
+            bool isA = (x[0] + x[1] > 1.0) != noisy;
+            
+            csv << x[0] << "," << x[1] << "," << (x[2] < 0.5 ? "P" : "Q") << "," <<
+                   (isA ? "A" : "B") << "," << 3 * x[0] + (noisy ? x[1] : 0.0) << endl;
+        }
+        
+        vector< vector<Value> > values;
+        vector<ValueType> valueTypes;
+        vector<CategoryMaps> categoryMaps;
+        vector<string> colNames;
+        vector< vector<string> > cells;
+        vector< vector<bool> > quoted;
+        
+        readCsvString(csv.str(), cells, quoted, colNames);
+        getDefaultValueTypes(cells, quoted, true, "NA", valueTypes);
+        cellsToValues(cells, quoted, valueTypes, true, "NA", values, false, categoryMaps);
+        
+        size_t numCols = values.size();
+        SelectIndexes selectRows(values[0].size(), true);
+        SelectIndexes selectColumns(numCols, true);
+        selectColumns.unselect(3);
+        selectColumns.unselect(4);
+        
+        vector< vector<size_t> > sortedIndexes;
+        makeSortedIndexes(values, valueTypes, selectColumns, sortedIndexes, 1);
+        
+        vector<const CategoryMaps *> categoryMapPointers;
+        for (size_t col = 0; col < numCols; col++) {
+            categoryMapPointers.push_back(&categoryMaps[col]);
+        }
+        
+        vector<Value> imputedValues(numCols, gNaValue);
+        vector<ImputeOption> imputeOptions(numCols, kNoImpute);
+        
+        const vector<size_t>& selectColumnIndexes = selectColumns.indexVector();
+        bool same = true;
+        
+        for (size_t targetColumn = 3; targetColumn <= 4; targetColumn++) {
+            // each pair of columns, then all three
+            for (size_t omit = 0; omit <= 3; omit++) {
+                vector<size_t> subsetIndexes;
+                for (size_t k = 0; k < 3; k++) {
+                    if (k != omit) {
+                        subsetIndexes.push_back(k);
+                    }
+                }
+                
+                CompactTree trees[2];
+                
+                for (int pass = 0; pass < 2; pass++) {
+                    int maxDepthUsed = 0;
+                    size_t rowsScanned = 0;
+                    
+                    evaluateTree(trees[pass], 100, 0, maxDepthUsed, rowsScanned, true, pass == 0,
+                                 0.0, 10, -1, values, valueTypes, categoryMapPointers,
+                                 subsetIndexes, selectRows, selectColumns, targetColumn,
+                                 sortedIndexes, colNames, imputedValues, imputeOptions);
+                }
+                
+                const CompactTree& tree0 = trees[0];
+                const CompactTree& tree1 = trees[1];
+                
+                same = same && tree0.splitColIndex == tree1.splitColIndex &&
+                       tree0.lessOrEqualIndex == tree1.lessOrEqualIndex &&
+                       tree0.greaterOrNotIndex == tree1.greaterOrNotIndex &&
+                       tree0.toLessOrEqualIfNA == tree1.toLessOrEqualIfNA &&
+                       tree0.categorySetIndex == tree1.categorySetIndex &&
+                       tree0.categorySets == tree1.categorySets &&
+                       tree0.value.size() == tree1.value.size();
+                
+                for (size_t node = 0; node < tree0.value.size() && same; node++) {
+                    index_t splitColIndex = tree0.splitColIndex[node];
+                    size_t column = splitColIndex == NO_INDEX ? targetColumn :
+                                        selectColumnIndexes.at(subsetIndexes.at(splitColIndex));
+                    
+                    if (valueTypes[column] == kCategorical) {
+                        same = tree0.value[node].i == tree1.value[node].i;
+                        
+                    } else {
+                        same = tree0.value[node].d == tree1.value[node].d;
+                    }
+                }
+            }
+        }
+        
+        if (same) passed++; else failed++;
+    }
+
     // ~~~~~~~~~~~~~~~~~~~~~~
     // improveLeaf
 
@@ -2216,9 +3812,444 @@ void ctest_train(int& totalPassed, int& totalFailed, bool verbose)
     // ~~~~~~~~~~~~~~~~~~~~~~
     // getBestNumericalSplit
 
+    // values with NA in numeric and categorical columns, for testing branch imputation; targets
+    // are small integers so that sums are exact
+    
+    size_t numRows = 200;
+    
+    vector< vector<Value> > values(4, vector<Value>(numRows, gNaValue));
+    
+    vector<ValueType> valueTypes;
+    valueTypes.push_back(kNumeric);
+    valueTypes.push_back(kCategorical);
+    valueTypes.push_back(kNumeric);
+    valueTypes.push_back(kCategorical);
+    
+    vector<CategoryMaps> categoryMaps(4);
+    categoryMaps[1].insertCategory("A");
+    categoryMaps[1].insertCategory("B");
+    categoryMaps[1].insertCategory("C");
+    categoryMaps[1].insertCategory("D");
+    categoryMaps[3].insertCategory("x");
+    categoryMaps[3].insertCategory("y");
+    categoryMaps[3].insertCategory("z");
+    
+    // split functions take pointers to category maps, which tree blocks share
+    vector<const CategoryMaps *> categoryMapPointers;
+    for (size_t col = 0; col < categoryMaps.size(); col++) {
+        categoryMapPointers.push_back(&categoryMaps[col]);
+    }
+    
+    vector<string> colNames(4, "");
+    
+    SelectIndexes selectRows(numRows, false);
+    
+    for (size_t row = 0; row < numRows; row++) {
+        if (row % 4 != 0) {
+            values[0][row].na = false;
+            values[0][row].number.d = (double)((row * 37) % 101) / 4.0;
+        }
+        
+        if (row % 5 != 0) {
+            values[1][row].na = false;
+            values[1][row].number.i = (index_t)((row * 3) % 4);
+        }
+        
+        values[2][row].na = false;
+        values[2][row].number.d = (double)((row * 11 + row / 9) % 7);
+        
+        values[3][row].na = false;
+        values[3][row].number.i = (index_t)((row + row / 7) % 3);
+        
+        if (row % 3 != 1) {
+            selectRows.select(row);
+        }
+    }
+    
+    SelectIndexes selectCols(values.size(), true);
+    
+    vector< vector<size_t> > sortedIndexes;
+    makeSortedIndexes(values, valueTypes, selectCols, sortedIndexes, 1);
+    
+    {
+        // imputing mean or median per branch matches imputing the same value before sorting
+        
+        bool ok = true;
+        
+        ImputeOption imputeOptions[] = { kToBranchMean, kToBranchMedian };
+        for (size_t k = 0; k < 2; k++) {
+            Value imputed = imputeOptions[k] == kToBranchMean ? meanValue(values[0], selectRows) :
+                medianValue(values[0], selectRows);
+            
+            vector< vector<Value> > imputedValues(values);
+            const vector<size_t>& rowIndexes = selectRows.indexVector();
+            for (size_t rowIndex = 0; rowIndex < rowIndexes.size(); rowIndex++) {
+                if (imputedValues[0][rowIndexes[rowIndex]].na) {
+                    imputedValues[0][rowIndexes[rowIndex]] = imputed;
+                }
+            }
+            
+            vector< vector<size_t> > imputedSortedIndexes;
+            makeSortedIndexes(imputedValues, valueTypes, selectCols, imputedSortedIndexes, 1);
+            
+            for (size_t targetColumn = 2; targetColumn < 4; targetColumn++) {
+                ValueAndMeasure split = getBestNumericalSplit(0, targetColumn, selectRows, values,
+                                                              valueTypes, categoryMapPointers,
+                                                              sortedIndexes, imputeOptions[k]);
+                
+                ValueAndMeasure expected = getBestNumericalSplit(0, targetColumn, selectRows,
+                                                                 imputedValues, valueTypes,
+                                                                 categoryMapPointers,
+                                                                 imputedSortedIndexes, kNoImpute);
+                
+                ok = ok && !split.value.na && !expected.value.na && expected.naValue.na;
+                ok = ok && split.value.number.d == expected.value.number.d;
+                ok = ok && split.measure == expected.measure;
+                ok = ok && !split.naValue.na && split.naValue.number.d == imputed.number.d;
+            }
+        }
+        
+        if (ok) {
+            passed++;
+        } else {
+            failed++;
+        }
+    }
+    
     // ~~~~~~~~~~~~~~~~~~~~~~
     // getBestCategoricalSplit
 
+    {
+        // imputing mode per branch matches imputing the same value before sorting
+        
+        bool ok = true;
+        
+        Value imputed = modeValue(values[1], selectRows, categoryMaps[1]);
+        
+        vector< vector<Value> > imputedValues(values);
+        const vector<size_t>& rowIndexes = selectRows.indexVector();
+        for (size_t rowIndex = 0; rowIndex < rowIndexes.size(); rowIndex++) {
+            if (imputedValues[1][rowIndexes[rowIndex]].na) {
+                imputedValues[1][rowIndexes[rowIndex]] = imputed;
+            }
+        }
+        
+        for (size_t targetColumn = 2; targetColumn < 4; targetColumn++) {
+            ValueAndMeasure split = getBestCategoricalSplit(1, targetColumn, selectRows, values,
+                                                            valueTypes, categoryMapPointers,
+                                                            kToBranchMode);
+            
+            ValueAndMeasure expected = getBestCategoricalSplit(1, targetColumn, selectRows,
+                                                               imputedValues, valueTypes,
+                                                               categoryMapPointers, kNoImpute);
+            
+            ok = ok && !split.value.na && !expected.value.na && expected.naValue.na;
+            ok = ok && split.value.number.i == expected.value.number.i;
+            ok = ok && split.measure == expected.measure;
+            ok = ok && !split.naValue.na && split.naValue.number.i == imputed.number.i;
+        }
+        
+        if (ok) {
+            passed++;
+        } else {
+            failed++;
+        }
+    }
+    
+    {
+        // learning NA branch finds best measure over all splits with NA rows sent either way, and
+        // naValue sends NA rows the way that gives that measure; for categorical column, a split
+        // on a set of categories may do better than any single category
+        
+        bool ok = true;
+        
+        const vector<size_t>& rowIndexes = selectRows.indexVector();
+        
+        for (size_t col = 0; col < 2; col++) {
+            // candidate split values: midpoints between numeric values, or each category
+            vector<double> numbers;
+            for (size_t rowIndex = 0; rowIndex < rowIndexes.size(); rowIndex++) {
+                const Value& value = values[col][rowIndexes[rowIndex]];
+                if (!value.na) {
+                    numbers.push_back(col == 0 ? value.number.d : (double)value.number.i);
+                }
+            }
+            
+            sort(numbers.begin(), numbers.end());
+            numbers.erase(unique(numbers.begin(), numbers.end()), numbers.end());
+            
+            vector<Value> candidates;
+            for (size_t k = 0; k < numbers.size(); k++) {
+                Value candidate = gNaValue;
+                candidate.na = false;
+                
+                if (col == 1) {
+                    candidate.number.i = (index_t)numbers[k];
+                    candidates.push_back(candidate);
+                    
+                } else if (k + 1 < numbers.size()) {
+                    candidate.number.d = 0.5 * (numbers[k] + numbers[k + 1]);
+                    candidates.push_back(candidate);
+                }
+            }
+            
+            for (size_t targetColumn = 2; targetColumn < 4; targetColumn++) {
+                ValueAndMeasure split = col == 0 ?
+                    getBestNumericalSplit(col, targetColumn, selectRows, values, valueTypes,
+                                          categoryMapPointers, sortedIndexes, kToLearnedBranch) :
+                    getBestCategoricalSplit(col, targetColumn, selectRows, values, valueTypes,
+                                            categoryMapPointers, kToLearnedBranch);
+                
+                ok = ok && !split.value.na && !split.naValue.na;
+                
+                bool splitNaToLessOrEqual = col == 0 ?
+                    split.naValue.number.d <= split.value.number.d :
+                    isLessOrEqualCategory(split.naValue.number.i, split.value, split.categorySet);
+                
+                bool bestSeen = false;
+                bool splitSeen = false;
+                double bestMeasure = 0.0;
+                
+                // last candidate is split found, to check its measure
+                candidates.push_back(split.value);
+                vector<unsigned int> noSet;
+                
+                for (size_t k = 0; k < 2 * candidates.size(); k++) {
+                    const Value& candidate = candidates[k / 2];
+                    bool naToLessOrEqual = k % 2 == 0;
+                    bool isSplit = k / 2 == candidates.size() - 1;
+                    
+                    double lessThanOrEqualSum = 0.0;
+                    double lessThanOrEqualSum2 = 0.0;
+                    int lessThanOrEqualCount = 0;
+                    double totalSum = 0.0;
+                    double totalSum2 = 0.0;
+                    int totalCount = 0;
+                    vector<int> lessThanOrEqualCounts(3, 0);
+                    vector<int> totalCounts(3, 0);
+                    
+                    for (size_t rowIndex = 0; rowIndex < rowIndexes.size(); rowIndex++) {
+                        size_t row = rowIndexes[rowIndex];
+                        const Value& value = values[col][row];
+                        
+                        bool lessOrEqual = value.na ? naToLessOrEqual : col == 0 ?
+                            value.number.d <= candidate.number.d :
+                            isLessOrEqualCategory(value.number.i, candidate,
+                                                  isSplit ? split.categorySet : noSet);
+                        
+                        const Value& target = values[targetColumn][row];
+                        
+                        if (targetColumn == 2) {
+                            totalSum += target.number.d;
+                            totalSum2 += target.number.d * target.number.d;
+                            totalCount++;
+                            
+                            if (lessOrEqual) {
+                                lessThanOrEqualSum += target.number.d;
+                                lessThanOrEqualSum2 += target.number.d * target.number.d;
+                                lessThanOrEqualCount++;
+                            }
+                            
+                        } else {
+                            totalCounts[(size_t)target.number.i]++;
+                            
+                            if (lessOrEqual) {
+                                lessThanOrEqualCounts[(size_t)target.number.i]++;
+                            }
+                        }
+                    }
+                    
+                    double measure = targetColumn == 2 ?
+                        sdForSplit(lessThanOrEqualSum, lessThanOrEqualSum2, lessThanOrEqualCount,
+                                   totalSum, totalSum2, totalCount) :
+                        entropyForSplit(lessThanOrEqualCounts, totalCounts);
+                    
+                    if (!isSplit) {
+                        if (!bestSeen || measure < bestMeasure) {
+                            bestMeasure = measure;
+                            bestSeen = true;
+                        }
+                        
+                    } else if (naToLessOrEqual == splitNaToLessOrEqual) {
+                        ok = ok && measure == split.measure;
+                        splitSeen = true;
+                    }
+                }
+                
+                candidates.pop_back();
+                
+                ok = ok && bestSeen && splitSeen;
+                ok = ok && (split.categorySet.empty() ? split.measure == bestMeasure :
+                            split.measure < bestMeasure);
+            }
+        }
+        
+        if (ok) {
+            passed++;
+        } else {
+            failed++;
+        }
+    }
+    
+    {
+        // NA rows are left out of sorted indexes, but are still found if not imputed
+        
+        int caught = 0;
+        
+        try {
+            getBestNumericalSplit(0, 3, selectRows, values, valueTypes, categoryMapPointers,
+                                  sortedIndexes, kNoImpute);
+        } catch(...) {
+            caught++;
+        }
+        
+        try {
+            getBestCategoricalSplit(1, 3, selectRows, values, valueTypes, categoryMapPointers,
+                                    kNoImpute);
+        } catch(...) {
+            caught++;
+        }
+        
+        if (caught == 2) {
+            passed++;
+        } else {
+            failed++;
+        }
+    }
+    
+    // ~~~~~~~~~~~~~~~~~~~~~~
+    // modalCategory
+    
+    // ~~~~~~~~~~~~~~~~~~~~~~
+    // sdForSplitWithNa
+    
+    // ~~~~~~~~~~~~~~~~~~~~~~
+    // entropyForSplitWithNa
+    
+    // ~~~~~~~~~~~~~~~~~~~~~~
+    // learnedNumericalNaValue
+    
+    // ~~~~~~~~~~~~~~~~~~~~~~
+    // learnedCategoricalNaValue
+
+    // ~~~~~~~~~~~~~~~~~~~~~~
+    // getBestCategorySetForSd
+    // getBestCategorySetForEntropy
+    
+    {
+        // with numeric target or two target categories, split on set of categories has best
+        // measure over all divisions of categories into two sets
+        
+        bool ok = true;
+        
+        size_t numSetRows = 120;
+        size_t numSetCategories = 7;
+        
+        vector< vector<Value> > setValues(3, vector<Value>(numSetRows, gNaValue));
+        
+        vector<ValueType> setValueTypes;
+        setValueTypes.push_back(kCategorical);
+        setValueTypes.push_back(kNumeric);
+        setValueTypes.push_back(kCategorical);
+        
+        vector<CategoryMaps> setCategoryMaps(3);
+        for (size_t category = 0; category < numSetCategories; category++) {
+            setCategoryMaps[0].insertCategory(string(1, (char)('G' - category)));
+        }
+        setCategoryMaps[2].insertCategory("x");
+        setCategoryMaps[2].insertCategory("y");
+        
+        vector<const CategoryMaps *> setCategoryMapPointers;
+        for (size_t col = 0; col < setCategoryMaps.size(); col++) {
+            setCategoryMapPointers.push_back(&setCategoryMaps[col]);
+        }
+        
+        for (size_t row = 0; row < numSetRows; row++) {
+            index_t category = (index_t)((row * 5) % numSetCategories);
+            bool high = category % 3 == 1 || category == 0;
+            
+            setValues[0][row].na = false;
+            setValues[0][row].number.i = category;
+            
+            setValues[1][row].na = false;
+            setValues[1][row].number.d = (high ? 10.0 : 0.0) + (double)(row % 4);
+            
+            setValues[2][row].na = false;
+            setValues[2][row].number.i = (high && row % 6 != 0) || (!high && row % 5 == 0) ? 1 : 0;
+        }
+        
+        SelectIndexes setSelectRows(numSetRows, true);
+        
+        for (size_t targetColumn = 1; targetColumn < 3; targetColumn++) {
+            ValueAndMeasure split = getBestCategoricalSplit(0, targetColumn, setSelectRows,
+                                                            setValues, setValueTypes,
+                                                            setCategoryMapPointers, kNoImpute);
+            
+            ok = ok && !split.value.na && !split.categorySet.empty();
+            ok = ok && isLessOrEqualCategory(split.value.number.i, split.value,
+                                             split.categorySet);
+            
+            // try every set of categories; complements give same measure, so only sets without
+            // last category are needed
+            double bestMeasure = 0.0;
+            
+            for (size_t mask = 1; mask < ((size_t)1 << (numSetCategories - 1)); mask++) {
+                double lessThanOrEqualSum = 0.0;
+                double lessThanOrEqualSum2 = 0.0;
+                int lessThanOrEqualCount = 0;
+                double totalSum = 0.0;
+                double totalSum2 = 0.0;
+                int totalCount = 0;
+                vector<int> lessThanOrEqualCounts(2, 0);
+                vector<int> totalCounts(2, 0);
+                
+                for (size_t row = 0; row < numSetRows; row++) {
+                    bool lessOrEqual = (mask >> setValues[0][row].number.i) & 1;
+                    const Value& target = setValues[targetColumn][row];
+                    
+                    if (targetColumn == 1) {
+                        totalSum += target.number.d;
+                        totalSum2 += target.number.d * target.number.d;
+                        totalCount++;
+                        
+                        if (lessOrEqual) {
+                            lessThanOrEqualSum += target.number.d;
+                            lessThanOrEqualSum2 += target.number.d * target.number.d;
+                            lessThanOrEqualCount++;
+                        }
+                        
+                    } else {
+                        totalCounts[(size_t)target.number.i]++;
+                        
+                        if (lessOrEqual) {
+                            lessThanOrEqualCounts[(size_t)target.number.i]++;
+                        }
+                    }
+                }
+                
+                double measure = targetColumn == 1 ?
+                    sdForSplit(lessThanOrEqualSum, lessThanOrEqualSum2, lessThanOrEqualCount,
+                               totalSum, totalSum2, totalCount) :
+                    entropyForSplit(lessThanOrEqualCounts, totalCounts);
+                
+                if (mask == 1 || measure < bestMeasure) {
+                    bestMeasure = measure;
+                }
+            }
+            
+            ok = ok && fabs(split.measure - bestMeasure) < 1.0e-9;
+        }
+        
+        if (ok) {
+            passed++;
+        } else {
+            failed++;
+        }
+    }
+    
+    // ~~~~~~~~~~~~~~~~~~~~~~
+    // isLessOrEqualCategory
+
     // ~~~~~~~~~~~~~~~~~~~~~~
     
     if (verbose) {
@@ -2236,6 +4267,7 @@ void cover_train(bool verbose)
     // train 
     // printCompactTrees
     // deleteSubtrees
+    // compressTree
     // evaluateTree
     // improveLeaf
     // improveSubtree
@@ -2253,6 +4285,7 @@ void cover_train(bool verbose)
     // sdForSplit
     // getBestNumericalSplit
     // getBestCategoricalSplit
+    // modalCategory
 
     int maxDepth = 100;
     double minImprovement = 0.0;
@@ -2308,7 +4341,7 @@ void cover_train(bool verbose)
         train(trees, columnsPerTree, maxDepth, minDepth, doPrune, minImprovement, minLeafCount,
               maxSplitsPerNumericAttribute,maxTrees, maxNodes, selectRows, availableColumns,
               selectColumns, trainValues, valueTypes, categoryMaps, targetColumn, colNames,
-              imputeOptions);
+              imputeOptions, 1);
     }
     
     {
@@ -2331,7 +4364,7 @@ void cover_train(bool verbose)
         train(trees, columnsPerTree, maxDepth, minDepth, doPrune, minImprovement, minLeafCount,
               maxSplitsPerNumericAttribute,maxTrees, maxNodes, selectRows, availableColumns,
               selectColumns, trainValues, valueTypes, categoryMaps, targetColumn, colNames,
-              imputeOptions);
+              imputeOptions, 1);
         
         if (verbose) {
             printCompactTrees(trees, valueTypes, targetColumn, selectColumns, colNames,
@@ -2357,7 +4390,7 @@ void cover_train(bool verbose)
         train(trees, columnsPerTree, maxDepth, minDepth, doPrune, minImprovement, minLeafCount,
               maxSplitsPerNumericAttribute,maxTrees, maxNodes, selectRows, availableColumns,
               selectColumns, trainValues, valueTypes, categoryMaps, targetColumn, colNames,
-              imputeOptions);
+              imputeOptions, 1);
     }
     
     values.push_back(values[4]);
@@ -2401,7 +4434,7 @@ void cover_train(bool verbose)
         train(trees, columnsPerTree, maxDepth, minDepth, doPrune, minImprovement, minLeafCount,
               maxSplitsPerNumericAttribute,maxTrees, maxNodes, selectRows, availableColumns,
               selectColumns, trainValues, valueTypes, categoryMaps, targetColumn, colNames,
-              imputeOptions);
+              imputeOptions, 1);
     }
     
     {
@@ -2422,7 +4455,7 @@ void cover_train(bool verbose)
         train(trees, columnsPerTree, maxDepth, minDepth, doPrune, minImprovement, minLeafCount,
               maxSplitsPerNumericAttribute,maxTrees, maxNodes, selectRows, availableColumns,
               selectColumns, trainValues, valueTypes, categoryMaps, targetColumn, colNames,
-              imputeOptions);
+              imputeOptions, 1);
     }
     
     imputeOptions[4] = kToMode;
@@ -2445,7 +4478,7 @@ void cover_train(bool verbose)
         train(trees, columnsPerTree, maxDepth, minDepth, doPrune, minImprovement, minLeafCount,
               maxSplitsPerNumericAttribute,maxTrees, maxNodes, selectRows, availableColumns,
               selectColumns, trainValues, valueTypes, categoryMaps, targetColumn, colNames,
-              imputeOptions);
+              imputeOptions, 1);
     }
     
     values[1][2].number.i = categoryMaps[1].findOrInsertCategory("C");
@@ -2468,7 +4501,38 @@ void cover_train(bool verbose)
         train(trees, columnsPerTree, maxDepth, minDepth, doPrune, minImprovement, minLeafCount,
               maxSplitsPerNumericAttribute,maxTrees, maxNodes, selectRows, availableColumns,
               selectColumns, trainValues, valueTypes, categoryMaps, targetColumn, colNames,
-              imputeOptions);
+              imputeOptions, 1);
+    }
+    
+    for (size_t k = 0; k < 3; k++) {
+        imputeOptions[4] = k < 2 ? kToBranchMode : kToLearnedBranch;
+        imputeOptions[5] = k == 0 ? kToBranchMedian : k == 1 ? kToBranchMean : kToLearnedBranch;
+        imputeOptions[6] = imputeOptions[4];
+        
+        for (size_t targetColumn = 0; targetColumn < 2; targetColumn++) {
+            vector<CompactTree> trees;
+            SelectIndexes selectColumns;
+            
+            index_t maxTrees = 100;
+            index_t columnsPerTree = -1;
+            int minDepth = 0;
+            bool doPrune = true;
+            
+            SelectIndexes availableColumns(numCols, true);
+            availableColumns.unselect(targetColumn);
+            
+            vector< vector<Value> > trainValues = values;
+            
+            train(trees, columnsPerTree, maxDepth, minDepth, doPrune, minImprovement,
+                  minLeafCount, maxSplitsPerNumericAttribute,maxTrees, maxNodes, selectRows,
+                  availableColumns, selectColumns, trainValues, valueTypes, categoryMaps,
+                  targetColumn, colNames, imputeOptions, 1);
+            
+            if (verbose) {
+                printCompactTrees(trees, valueTypes, targetColumn, selectColumns, colNames,
+                                  categoryMaps);
+            }
+        }
     }
         
     // ~~~~~~~~~~~~~~~~~~~~~~
@@ -36,6 +36,12 @@ struct CompactTree {
                                             // lessOrEqualNode if true else choose greaterOrNotNode
     
     std::vector<Number> value;              // value for leaf or split
+    
+    std::vector<index_t> categorySetIndex;  // index into categorySets of set of categories that
+                                            // choose lessOrEqualNode; NO_INDEX unless split is on
+                                            // set of categories
+    
+    std::vector<unsigned int> categorySets; // sets made by appendCategorySet, one after another
 };
 typedef struct CompactTree CompactTree;
 
@@ -49,6 +55,10 @@ struct TreeNode {
     bool toLessOrEqualIfNA;         // when have NA to compare with splitValue, choose
                                     // lessOrEqualNode if true else choose greaterOrNotNode
     
+    std::vector<unsigned int> splitCategorySet; // set made by appendCategorySet of categories
+                                                // that choose lessOrEqualNode; empty unless split
+                                                // is on set of categories
+    
     index_t splitColIndex;          // index into selectColumns of column of split attribute
     index_t leafLessOrEqualCount;   // count of training rows that go to lessOrEqualNode
     index_t leafGreaterOrNotCount;  // count of training rows that go to greaterOrNotNode
@@ -63,9 +73,26 @@ struct TreeNode {
 };
 typedef struct TreeNode TreeNode;
 
+// progress of train, as passed to TrainProgressFunction
+struct TrainProgress {
+    size_t treesTotal;          // count of column subsets for which trees will be grown
+    size_t treesCompleted;      // count of trees grown so far, whether kept or not
+    size_t treesKept;           // count of trees grown so far that reached minDepth
+    size_t nodesSplit;          // count of split nodes in trees grown so far
+    size_t rowsScanned;         // rows searched for splits so far, counted once per column
+    double elapsedSeconds;      // wall-clock time since trees began to be grown
+    double rowsPerSecond;       // rowsScanned / elapsedSeconds
+    double secondsRemaining;    // estimate of time to grow remaining trees; -1 if unknown
+};
+typedef struct TrainProgress TrainProgress;
+
+// function called to report progress of train, with context as passed to setTrainProgress
+typedef void (*TrainProgressFunction)(const TrainProgress& progress, void *context);
+
 // ========== Function Headers =====================================================================
 
-// train ensemble of decision trees
+// train ensemble of decision trees; trees are grown on up to numThreads threads, or one per
+// processor if numThreads is 0, with same result for any numThreads
 void train(std::vector<CompactTree>& trees, 
            index_t columnsPerTree,
            int maxDepth,
@@ -84,11 +111,29 @@ void train(std::vector<CompactTree>& trees,
            std::vector<CategoryMaps>& categoryMaps,
            size_t targetColumn,
            const std::vector<std::string>& colNames,
-           std::vector<ImputeOption>& imputeOptions);
+           std::vector<ImputeOption>& imputeOptions,
+           size_t numThreads);
+
+// report progress of train by calling progressFunction(progress, context) on thread that called
+// train, at most once per minInterval seconds while trees are grown, and once when all are done;
+// no progress is reported if progressFunction is NULL
+void setTrainProgress(TrainProgressFunction progressFunction, void *context, double minInterval);
+
+// TrainProgressFunction that prints progress to CERR as one line of name=value pairs; context is
+// not used
+void printTrainProgress(const TrainProgress& progress, void *context);
 
 // delete all nodes for which specified node is ancestor
 void deleteSubtrees(TreeNode *nodeP);
 
+// merge structurally identical subtrees of tree so that they share nodes, and replace each split
+// whose two branches are identical with one branch; predictions from tree are unchanged; root stays
+// first, and each node stays before its branches
+void compressTree(CompactTree& tree,
+                  const std::vector<ValueType>& valueTypes,
+                  size_t targetColumn,
+                  const SelectIndexes& selectColumns);
+
 // for debugging; print list of decision trees
 void printCompactTrees(const std::vector<CompactTree>& trees,
                        const std::vector<ValueType>& valueTypes,
@@ -20,6 +20,7 @@
 #include "format.h"
 #include "shim.h"
 
+#include <iomanip>
 #include <iostream>
 #include <sstream>
 #include <stdexcept>
@@ -29,11 +30,63 @@
 #if defined _WIN32 || defined _WIN64
 #include <windows.h>
 #else
+#include <pthread.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #endif
 
 using namespace std;
 
+// ========== Local Types ==========================================================================
+
+// work shared by threads of runParallel; each thread takes next item until all are taken
+struct ParallelWork {
+    size_t count;
+    size_t nextItem;
+    bool failed;
+    std::string message;    // from exception of first item that failed, if any
+    void (*work)(size_t item, void *context);
+    void *context;
+    
+#if defined _WIN32 || defined _WIN64
+    CRITICAL_SECTION mutex;
+#else
+    pthread_mutex_t mutex;
+#endif
+};
+typedef struct ParallelWork ParallelWork;
+
+// ========== Local Headers ========================================================================
+
+// thread for runParallel; do items until none left
+#if defined _WIN32 || defined _WIN64
+DWORD WINAPI parallelThread(LPVOID workP);
+#else
+void *parallelThread(void *workP);
+#endif
+
+// ========== Globals ==============================================================================
+
+// for profiling; updated by addInstrumentCount
+size_t gInstrumentCounts[kInstrumentCounterCount];
+
+// names of counters in JSON written by writeInstrumentCounts, in order of InstrumentCounter
+const char *gInstrumentNames[kInstrumentCounterCount] = {
+    "splitCandidates",
+    "numericalSplitCalls",
+    "numericalSplitRows",
+    "categoricalSplitCalls",
+    "categoricalSplitRows",
+    "nodesCreated",
+    "nodesBackedOut",
+    "sortMicroseconds",
+    "imputeMicroseconds",
+    "pruneMicroseconds",
+    "predictOneRows",
+    "predictOneLockstepRows",
+    "predictOneSplitsVisited"
+};
+
 // ========== Functions ============================================================================
 
 // throw std::logic_error with custom message include source file name and line number
@@ -95,6 +148,65 @@ string localTimeString(const time_t t)
     return string(str);
 }
 
+// return wall-clock time in seconds from an arbitrary origin, with resolution finer than a second
+double wallSeconds()
+{
+#if defined _WIN32 || defined _WIN64
+    LARGE_INTEGER counter;
+    LARGE_INTEGER frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    
+    return (double)tv.tv_sec + (double)tv.tv_usec / 1.0e6;
+#endif
+}
+
+// for profiling; add count to counter; safe to call from any thread
+void addInstrumentCount(InstrumentCounter counter, size_t count)
+{
+    __sync_fetch_and_add(&gInstrumentCounts[counter], count);
+}
+
+// for profiling; set all counters to zero
+void clearInstrumentCounts()
+{
+    for (size_t k = 0; k < kInstrumentCounterCount; k++) {
+        gInstrumentCounts[k] = 0;
+    }
+}
+
+// for profiling; write counters and averages made from them to stream as one JSON object
+void writeInstrumentCounts(std::ostream& os)
+{
+    size_t splitCalls = gInstrumentCounts[kNumericalSplitCalls] +
+        gInstrumentCounts[kCategoricalSplitCalls];
+    
+    size_t splitRows = gInstrumentCounts[kNumericalSplitRows] +
+        gInstrumentCounts[kCategoricalSplitRows];
+    
+    size_t predictRows = gInstrumentCounts[kPredictOneRows];
+    
+    ostringstream oss;
+    oss << "{";
+    
+    for (size_t k = 0; k < kInstrumentCounterCount; k++) {
+        oss << "\"" << gInstrumentNames[k] << "\": " << gInstrumentCounts[k] << ", ";
+    }
+    
+    oss << fixed << setprecision(3) <<
+    "\"rowsPerSplitCall\": " << (splitCalls > 0 ? (double)splitRows / splitCalls : 0.0) << ", " <<
+    "\"averagePredictOneDepth\": " <<
+    (predictRows > 0 ? (double)gInstrumentCounts[kPredictOneSplitsVisited] / predictRows : 0.0) <<
+    "}";
+    
+    os << oss.str() << endl;
+}
+
 // return true if entire string is parsable as number
 bool isNumeric(const std::string str)
 {
@@ -176,6 +288,102 @@ std::string badPathErrorMessage(const std::string& file)
     return msg;
 }
 
+// return number of processors available
+size_t countProcessors()
+{
+    long count;
+    
+#if defined _WIN32 || defined _WIN64
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    count = (long)info.dwNumberOfProcessors;
+#else
+    count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    
+    return count > 0 ? (size_t)count : 1;
+}
+
+// call work(item, context) for each item from 0 to count - 1, spread across up to numThreads
+// threads, or one per processor if numThreads is 0; work must not call R, but in R package may use
+// CERR and error macros, as output is held and errors are thrown until all threads are done; return
+// true if all items completed without throwing, else return false with message of first failure
+bool runParallel(size_t count,
+                 size_t numThreads,
+                 void (*work)(size_t item, void *context),
+                 void *context,
+                 std::string& message)
+{
+    if (numThreads == 0) {
+        numThreads = countProcessors();
+    }
+    
+    if (numThreads > count) {
+        numThreads = count;
+    }
+    
+    ParallelWork parallelWork;
+    parallelWork.count = count;
+    parallelWork.nextItem = 0;
+    parallelWork.failed = false;
+    parallelWork.work = work;
+    parallelWork.context = context;
+    
+#if RPACKAGE
+    // threads, including calling thread while working on items, must not call R
+    beginRParallel();
+#endif
+    
+#if defined _WIN32 || defined _WIN64
+    InitializeCriticalSection(&parallelWork.mutex);
+    
+    // calling thread is one of the workers
+    vector<HANDLE> threads;
+    for (size_t k = 1; k < numThreads; k++) {
+        HANDLE thread = CreateThread(NULL, 0, parallelThread, &parallelWork, 0, NULL);
+        if (thread != NULL) {
+            threads.push_back(thread);
+        }
+    }
+    
+    parallelThread(&parallelWork);
+    
+    for (size_t k = 0; k < threads.size(); k++) {
+        WaitForSingleObject(threads[k], INFINITE);
+        CloseHandle(threads[k]);
+    }
+    
+    DeleteCriticalSection(&parallelWork.mutex);
+#else
+    pthread_mutex_init(&parallelWork.mutex, NULL);
+    
+    // calling thread is one of the workers
+    vector<pthread_t> threads;
+    for (size_t k = 1; k < numThreads; k++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, parallelThread, &parallelWork) == 0) {
+            threads.push_back(thread);
+        }
+    }
+    
+    parallelThread(&parallelWork);
+    
+    for (size_t k = 0; k < threads.size(); k++) {
+        pthread_join(threads[k], NULL);
+    }
+    
+    pthread_mutex_destroy(&parallelWork.mutex);
+#endif
+    
+#if RPACKAGE
+    endRParallel();
+#endif
+    
+    message = parallelWork.message;
+    
+    return !parallelWork.failed;
+}
+
 // for debugging and testing; create directory
 void makeDir(const std::string& path)
 {
@@ -207,8 +415,96 @@ void noop()
 {
 }
 
+// ========== Local Functions ======================================================================
+
+// thread for runParallel; do items until none left
+#if defined _WIN32 || defined _WIN64
+DWORD WINAPI parallelThread(LPVOID workP)
+#else
+void *parallelThread(void *workP)
+#endif
+{
+    ParallelWork& parallelWork = *(ParallelWork *)workP;
+    
+    bool done = false;
+    
+    while (!done) {
+        size_t item = 0;
+        
+#if defined _WIN32 || defined _WIN64
+        EnterCriticalSection(&parallelWork.mutex);
+#else
+        pthread_mutex_lock(&parallelWork.mutex);
+#endif
+        
+        // stop taking items after any failure
+        done = parallelWork.failed || parallelWork.nextItem >= parallelWork.count;
+        
+        if (!done) {
+            item = parallelWork.nextItem++;
+        }
+        
+#if defined _WIN32 || defined _WIN64
+        LeaveCriticalSection(&parallelWork.mutex);
+#else
+        pthread_mutex_unlock(&parallelWork.mutex);
+#endif
+        
+        if (!done) {
+            bool failed = false;
+            string message;
+            
+            try {
+                parallelWork.work(item, parallelWork.context);
+                
+            } catch (const exception& x) {
+                failed = true;
+                message = x.what();
+                
+            } catch (...) {
+                failed = true;
+                message = "unknown error";
+            }
+            
+            if (failed) {
+#if defined _WIN32 || defined _WIN64
+                EnterCriticalSection(&parallelWork.mutex);
+                if (!parallelWork.failed) parallelWork.message = message;
+                parallelWork.failed = true;
+                LeaveCriticalSection(&parallelWork.mutex);
+#else
+                pthread_mutex_lock(&parallelWork.mutex);
+                if (!parallelWork.failed) parallelWork.message = message;
+                parallelWork.failed = true;
+                pthread_mutex_unlock(&parallelWork.mutex);
+#endif
+            }
+        }
+    }
+    
+#if defined _WIN32 || defined _WIN64
+    return 0;
+#else
+    return NULL;
+#endif
+}
+
 // ========== Tests ================================================================================
 
+// for testing runParallel; store square of item
+void testParallelWork(size_t item, void *context)
+{
+    vector<size_t>& squares = *(vector<size_t> *)context;
+    squares[item] = item * item;
+}
+
+// for testing runParallel; store square of item, but fail on item 500
+void testParallelFailWork(size_t item, void *context)
+{
+    RUNTIME_ERROR_IF(item == 500, "item 500 failed");
+    testParallelWork(item, context);
+}
+
 // component tests
 void ctest_utils(int& totalPassed, int& totalFailed, bool verbose)
 {
@@ -224,6 +520,34 @@ void ctest_utils(int& totalPassed, int& totalFailed, bool verbose)
     // ~~~~~~~~~~~~~~~~~~~~~~
     // localTimeString
     
+    // ~~~~~~~~~~~~~~~~~~~~~~
+    // wallSeconds
+    // addInstrumentCount
+    // clearInstrumentCounts
+    // writeInstrumentCounts
+    
+    {
+        clearInstrumentCounts();
+        
+        addInstrumentCount(kNodesCreated, 2);
+        addInstrumentCount(kNodesCreated, 2);
+        addInstrumentCount(kPredictOneRows, 4);
+        addInstrumentCount(kPredictOneSplitsVisited, 10);
+        
+        ostringstream oss;
+        writeInstrumentCounts(oss);
+        string json = oss.str();
+        
+        clearInstrumentCounts();
+        
+        bool ok = json.find("\"nodesCreated\": 4,") != string::npos &&
+                  json.find("\"nodesBackedOut\": 0,") != string::npos &&
+                  json.find("\"averagePredictOneDepth\": 2.500}") != string::npos &&
+                  wallSeconds() > 0.0;
+        
+        if (ok) passed++; else failed++;
+    }
+    
     // ~~~~~~~~~~~~~~~~~~~~~~
     // isNumeric
     
@@ -257,6 +581,27 @@ void ctest_utils(int& totalPassed, int& totalFailed, bool verbose)
     
     if (outStr == inStr) passed++; else failed++;
     
+    // ~~~~~~~~~~~~~~~~~~~~~~
+    // countProcessors
+    // runParallel
+    
+    {
+        vector<size_t> squares(1000, 0);
+        string message;
+        bool ok = runParallel(squares.size(), 4, testParallelWork, &squares, message);
+        
+        for (size_t k = 0; k < squares.size(); k++) {
+            ok = ok && squares[k] == k * k;
+        }
+        
+        // message of failed item is returned
+        string failMessage;
+        bool failOk = !runParallel(squares.size(), 4, testParallelFailWork, &squares, failMessage);
+        failOk = failOk && failMessage.find("item 500 failed") != string::npos;
+        
+        if (ok && message.empty() && failOk && countProcessors() > 0) passed++; else failed++;
+    }
+    
     // ~~~~~~~~~~~~~~~~~~~~~~
     // getWorkingDirectory
     
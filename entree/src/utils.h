@@ -18,6 +18,7 @@
 
 #include "shim.h"
 
+#include <iostream>
 #include <string>
 #include <vector>
 
@@ -42,6 +43,40 @@
 #define SKIP
 #endif
 
+#ifdef INSTRUMENT
+// for profiling; count work done in hot paths, dumped by writeInstrumentCounts; a count argument
+// is evaluated only to be discarded if INSTRUMENT is not defined, so should be a plain variable
+#define INSTRUMENT_ADD(counter, count) addInstrumentCount(counter, (size_t)(count));
+#define INSTRUMENT_TIME_BEGIN(startVar) double startVar = wallSeconds();
+#define INSTRUMENT_TIME_END(counter, startVar) \
+    addInstrumentCount(counter, (size_t)((wallSeconds() - startVar) * 1.0e6));
+#else
+#define INSTRUMENT_ADD(counter, count) (void)(count);
+#define INSTRUMENT_TIME_BEGIN(startVar)
+#define INSTRUMENT_TIME_END(counter, startVar)
+#endif
+
+// ========== Types ================================================================================
+
+// for profiling; counters of work done in hot paths of train and predict, updated only if
+// INSTRUMENT is defined
+enum InstrumentCounter {
+    kSplitCandidates,           // candidate split values whose measure was compared
+    kNumericalSplitCalls,       // calls to getBestNumericalSplit
+    kNumericalSplitRows,        // rows visited by getBestNumericalSplit
+    kCategoricalSplitCalls,     // calls to getBestCategoricalSplit
+    kCategoricalSplitRows,      // rows visited by getBestCategoricalSplit
+    kNodesCreated,              // nodes created by splitting leaf
+    kNodesBackedOut,            // nodes deleted again because split did not improve leaf
+    kSortMicroseconds,          // time in makeSortedIndexes during train
+    kImputeMicroseconds,        // time in imputeValues during train
+    kPruneMicroseconds,         // time pruning trees, summed over threads
+    kPredictOneRows,            // rows predicted by predictOne, summed over trees
+    kPredictOneLockstepRows,    // of those, rows predicted in lockstep blocks
+    kPredictOneSplitsVisited,   // split nodes visited by rows predicted by predictOne
+    kInstrumentCounterCount
+};
+
 // ========== Function Headers =====================================================================
 
 // throw std::logic_error with custom message include source file name and line number
@@ -54,6 +89,18 @@ void throw_runtime_error(const std::string& path, int line, const std::string& m
 // convert time_t to local time string in ISO format
 std::string localTimeString(const time_t t);
 
+// return wall-clock time in seconds from an arbitrary origin, with resolution finer than a second
+double wallSeconds();
+
+// for profiling; add count to counter; safe to call from any thread
+void addInstrumentCount(InstrumentCounter counter, size_t count);
+
+// for profiling; set all counters to zero
+void clearInstrumentCounts();
+
+// for profiling; write counters and averages made from them to stream as one JSON object
+void writeInstrumentCounts(std::ostream& os);
+
 // return true if entire string is parsable as number
 bool isNumeric(const std::string str);
 
@@ -75,6 +122,19 @@ std::string getWorkingDirectory();
 // return error message for bad path
 std::string badPathErrorMessage(const std::string& file);
 
+// return number of processors available
+size_t countProcessors();
+
+// call work(item, context) for each item from 0 to count - 1, spread across up to numThreads
+// threads, or one per processor if numThreads is 0; work must not call R, but in R package may use
+// CERR and error macros, as output is held and errors are thrown until all threads are done; return
+// true if all items completed without throwing, else return false with message of first failure
+bool runParallel(size_t count,
+                 size_t numThreads,
+                 void (*work)(size_t item, void *context),
+                 void *context,
+                 std::string& message);
+
 // for debugging and testing; create directory
 void makeDir(const std::string& path);
 
@@ -0,0 +1,443 @@
+//
+//  benchmark.cpp
+//  entree
+//
+//  Created by MPB on 10/18/26.
+//  Copyright (c) 2026 Quadrivio Corporation. All rights reserved.
+//  License http://opensource.org/licenses/BSD-2-Clause
+//          <YEAR> = 2026
+//          <OWNER> = Quadrivio Corporation
+//
+
+//
+// Timing of train() and predict() on iris, crime and synthetic data, called when --benchmark
+// argument is used
+//
+
+#include "benchmark.h"
+
+#include "crime.h"
+#include "csv.h"
+#include "format.h"
+#include "iris.h"
+#include "predict.h"
+#include "train.h"
+#include "utils.h"
+
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include <sys/resource.h>
+
+using namespace std;
+
+// ========== Local Types ==========================================================================
+
+// one data set, with parameters for training on it
+struct BenchmarkCase {
+    string name;
+    string targetName;      // "numeric" or "categorical"
+
+    vector< vector<Value> > values;
+    vector<ValueType> valueTypes;
+    vector<CategoryMaps> categoryMaps;
+    vector<string> colNames;
+    SelectIndexes selectRows;
+    SelectIndexes availableColumns;
+    size_t targetColumn;
+
+    index_t columnsPerTree;
+    int maxDepth;
+    int minDepth;
+    bool doPrune;
+    index_t minLeafCount;
+    index_t maxSplitsPerNumericAttribute;
+    index_t maxTrees;
+    index_t maxNodes;
+};
+typedef struct BenchmarkCase BenchmarkCase;
+
+// ========== Local Headers ========================================================================
+
+// make case from iris data, with parameters of test_iris()
+void makeIrisCase(BenchmarkCase& benchmarkCase);
+
+// make case from crime data, with parameters of test_crime()
+void makeCrimeCase(BenchmarkCase& benchmarkCase);
+
+// make synthetic case of numRows rows, numAttributeCols attribute columns and target column of
+// targetType; every fifth attribute column is categorical with 8 categories, others are numeric
+// in [0, 1); target depends on columns 0, 1 and 4, with noise; data are same for every run
+void makeSyntheticCase(size_t numRows,
+                       size_t numAttributeCols,
+                       ValueType targetType,
+                       index_t maxTrees,
+                       BenchmarkCase& benchmarkCase);
+
+// train and predict for case, then write results to os as one line of JSON
+void runBenchmarkCase(BenchmarkCase& benchmarkCase, size_t numThreads, ostream& os);
+
+// return uniform random number in [0, 1) from linear congruential generator
+double nextUniform(unsigned long& seed);
+
+// return peak resident set size of process so far, in kilobytes
+long peakRssKilobytes();
+
+// TrainProgressFunction that copies progress to TrainProgress at context
+void keepTrainProgress(const TrainProgress& progress, void *context);
+
+// ========== Functions ============================================================================
+
+// run train and predict on each benchmark data set, writing one line of JSON per data set to
+// stdout; synthetic data sets with more than maxCells attribute values are skipped; empty strings
+// select default parameters
+void benchmark(const std::string& maxTreesStr,
+               const std::string& numThreadsStr,
+               const std::string& maxCellsStr,
+               bool verbose)
+{
+    index_t maxTrees = 10;
+    size_t numThreads = 1;
+    size_t maxCells = 10000000;
+
+    if (!maxTreesStr.empty()) {
+        maxTrees = (index_t)toLong(maxTreesStr);
+    }
+
+    if (!numThreadsStr.empty()) {
+        numThreads = (size_t)toLong(numThreadsStr);
+    }
+
+    if (!maxCellsStr.empty()) {
+        maxCells = (size_t)toDouble(maxCellsStr);
+    }
+
+    if (numThreads == 0) {
+        numThreads = countProcessors();
+    }
+
+    // ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~
+    // data sets of tests, with same parameters as tests
+
+    {
+        BenchmarkCase benchmarkCase;
+        makeIrisCase(benchmarkCase);
+
+        if (verbose) CERR << "benchmark iris" << endl;
+
+        runBenchmarkCase(benchmarkCase, numThreads, cout);
+    }
+
+    {
+        BenchmarkCase benchmarkCase;
+        makeCrimeCase(benchmarkCase);
+
+        if (verbose) CERR << "benchmark crime" << endl;
+
+        runBenchmarkCase(benchmarkCase, numThreads, cout);
+    }
+
+    // ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~
+    // synthetic data sets, in ascending order of size, so that peak resident set size of process
+    // is that of biggest data set so far
+
+    const size_t rowCounts[] = { 10000, 100000, 1000000, 10000000 };
+    const size_t colCounts[] = { 10, 100, 1000 };
+    const ValueType targetTypes[] = { kNumeric, kCategorical };
+
+    for (size_t rowsIndex = 0; rowsIndex < sizeof(rowCounts) / sizeof(rowCounts[0]); rowsIndex++) {
+        for (size_t colsIndex = 0; colsIndex < sizeof(colCounts) / sizeof(colCounts[0]);
+             colsIndex++) {
+
+            size_t numRows = rowCounts[rowsIndex];
+            size_t numCols = colCounts[colsIndex];
+
+            if (numRows * numCols > maxCells) {
+                if (verbose) {
+                    CERR << "benchmark synthetic " << numRows << " x " << numCols <<
+                    " skipped; more than " << maxCells << " cells" << endl;
+                }
+
+            } else {
+                for (size_t typeIndex = 0; typeIndex < 2; typeIndex++) {
+                    BenchmarkCase benchmarkCase;
+                    makeSyntheticCase(numRows, numCols, targetTypes[typeIndex], maxTrees,
+                                      benchmarkCase);
+
+                    if (verbose) {
+                        CERR << "benchmark synthetic " << numRows << " x " << numCols << " " <<
+                        benchmarkCase.targetName << endl;
+                    }
+
+                    runBenchmarkCase(benchmarkCase, numThreads, cout);
+                }
+            }
+        }
+    }
+}
+
+// ========== Local Functions ======================================================================
+
+// make case from iris data, with parameters of test_iris()
+void makeIrisCase(BenchmarkCase& benchmarkCase)
+{
+    vector< vector<string> > cells;
+    vector< vector<bool> > quoted;
+
+    readCsvString(gIris, cells, quoted, benchmarkCase.colNames);
+    getDefaultValueTypes(cells, quoted, true, "NA", benchmarkCase.valueTypes);
+    cellsToValues(cells, quoted, benchmarkCase.valueTypes, true, "NA", benchmarkCase.values, false,
+                  benchmarkCase.categoryMaps);
+
+    size_t numCols = benchmarkCase.values.size();
+    size_t numRows = benchmarkCase.values[0].size();
+
+    benchmarkCase.name = "iris";
+    benchmarkCase.targetColumn = numCols - 1;
+    benchmarkCase.targetName = "categorical";
+
+    benchmarkCase.selectRows.selectAll(numRows);
+    benchmarkCase.availableColumns.selectAll(numCols);
+    benchmarkCase.availableColumns.unselect(benchmarkCase.targetColumn);
+
+    benchmarkCase.columnsPerTree = 4;
+    benchmarkCase.maxDepth = 100;
+    benchmarkCase.minDepth = 0;
+    benchmarkCase.doPrune = true;
+    benchmarkCase.minLeafCount = 1;
+    benchmarkCase.maxSplitsPerNumericAttribute = -1;
+    benchmarkCase.maxTrees = 1;
+    benchmarkCase.maxNodes = 100;
+}
+
+// make case from crime data, with parameters of test_crime()
+void makeCrimeCase(BenchmarkCase& benchmarkCase)
+{
+    vector< vector<string> > cells;
+    vector< vector<bool> > quoted;
+
+    readCsvString(gCrime, cells, quoted, benchmarkCase.colNames);
+    getDefaultValueTypes(cells, quoted, true, "?", benchmarkCase.valueTypes);
+    cellsToValues(cells, quoted, benchmarkCase.valueTypes, true, "?", benchmarkCase.values, false,
+                  benchmarkCase.categoryMaps);
+
+    size_t numCols = benchmarkCase.values.size();
+    size_t numRows = benchmarkCase.values[0].size();
+
+    benchmarkCase.name = "crime";
+    benchmarkCase.targetColumn = numCols - 2;
+    benchmarkCase.targetName = "numeric";
+
+    benchmarkCase.availableColumns.selectAll(numCols);
+
+    for (size_t k = 0; k <= 4; k++) {
+        benchmarkCase.availableColumns.unselect(k);
+    }
+
+    for (size_t k = numCols - 18; k < numCols; k++) {
+        benchmarkCase.availableColumns.unselect(k);
+    }
+
+    benchmarkCase.selectRows.clear(numRows);
+    for (size_t row = 0; row < numRows; row++) {
+        if (!benchmarkCase.values[benchmarkCase.targetColumn][row].na) {
+            benchmarkCase.selectRows.select(row);
+        }
+    }
+
+    benchmarkCase.columnsPerTree = -1;
+    benchmarkCase.maxDepth = 10;
+    benchmarkCase.minDepth = 2;
+    benchmarkCase.doPrune = false;
+    benchmarkCase.minLeafCount = 4;
+    benchmarkCase.maxSplitsPerNumericAttribute = 2;
+    benchmarkCase.maxTrees = 20;
+    benchmarkCase.maxNodes = 1000;
+}
+
+// make synthetic case of numRows rows, numAttributeCols attribute columns and target column of
+// targetType; every fifth attribute column is categorical with 8 categories, others are numeric
+// in [0, 1); target depends on columns 0, 1 and 4, with noise; data are same for every run
+void makeSyntheticCase(size_t numRows,
+                       size_t numAttributeCols,
+                       ValueType targetType,
+                       index_t maxTrees,
+                       BenchmarkCase& benchmarkCase)
+{
+    const size_t numCategories = 8;
+    size_t numCols = numAttributeCols + 1;
+
+    benchmarkCase.name = "synthetic";
+    benchmarkCase.targetColumn = numAttributeCols;
+    benchmarkCase.targetName = targetType == kNumeric ? "numeric" : "categorical";
+
+    benchmarkCase.values.resize(numCols);
+    benchmarkCase.valueTypes.resize(numCols);
+    benchmarkCase.categoryMaps.resize(numCols);
+    benchmarkCase.colNames.resize(numCols);
+
+    // category indexes of each categorical column, and of target if categorical
+    vector< vector<index_t> > categoryIndexes(numCols);
+
+    for (size_t col = 0; col < numCols; col++) {
+        bool isTarget = col == numAttributeCols;
+        bool categorical = isTarget ? targetType == kCategorical : col % 5 == 4;
+
+        ostringstream oss;
+        oss << (isTarget ? "Y" : "X") << col;
+        benchmarkCase.colNames[col] = oss.str();
+
+        benchmarkCase.valueTypes[col] = categorical ? kCategorical : kNumeric;
+        benchmarkCase.values[col].resize(numRows);
+
+        if (categorical) {
+            size_t count = isTarget ? 3 : numCategories;
+            for (size_t k = 0; k < count; k++) {
+                string category(1, (char)((isTarget ? 'A' : 'a') + k));
+                categoryIndexes[col].push_back(
+                    benchmarkCase.categoryMaps[col].findOrInsertCategory(category));
+            }
+        }
+    }
+
+    unsigned long seed = 12345;
+
+    for (size_t row = 0; row < numRows; row++) {
+        for (size_t col = 0; col < numAttributeCols; col++) {
+            Value& value = benchmarkCase.values[col][row];
+            value.na = false;
+
+            double uniform = nextUniform(seed);
+
+            if (benchmarkCase.valueTypes[col] == kCategorical) {
+                value.number.i = categoryIndexes[col][(size_t)(uniform * numCategories)];
+
+            } else {
+                value.number.d = uniform;
+            }
+        }
+
+        const vector< vector<Value> >& values = benchmarkCase.values;
+
+        double score = 3.0 * values[0][row].number.d + 2.0 * values[1][row].number.d +
+            0.5 * nextUniform(seed);
+
+        if (numAttributeCols > 4 &&
+            values[4][row].number.i < categoryIndexes[4][numCategories / 2]) {
+            score += 1.0;
+        }
+
+        Value& target = benchmarkCase.values[numAttributeCols][row];
+        target.na = false;
+
+        if (targetType == kCategorical) {
+            const vector<index_t>& targetCategories = categoryIndexes[numAttributeCols];
+            target.number.i = score < 2.5 ? targetCategories[0] :
+                (score < 4.0 ? targetCategories[1] : targetCategories[2]);
+
+        } else {
+            target.number.d = score;
+        }
+    }
+
+    benchmarkCase.selectRows.selectAll(numRows);
+    benchmarkCase.availableColumns.selectAll(numCols);
+    benchmarkCase.availableColumns.unselect(benchmarkCase.targetColumn);
+
+    benchmarkCase.columnsPerTree = -1;
+    benchmarkCase.maxDepth = 20;
+    benchmarkCase.minDepth = 1;
+    benchmarkCase.doPrune = false;
+    benchmarkCase.minLeafCount = 4;
+    benchmarkCase.maxSplitsPerNumericAttribute = -1;
+    benchmarkCase.maxTrees = maxTrees;
+    benchmarkCase.maxNodes = -1;
+}
+
+// train and predict for case, then write results to os as one line of JSON
+void runBenchmarkCase(BenchmarkCase& benchmarkCase, size_t numThreads, ostream& os)
+{
+    size_t numRows = benchmarkCase.selectRows.countSelected();
+    size_t numAttributeCols = benchmarkCase.availableColumns.countSelected();
+
+    vector<ImputeOption> imputeOptions(benchmarkCase.values.size(), kToDefault);
+    vector<CompactTree> trees;
+    SelectIndexes selectColumns;
+
+    // only final progress is wanted, for counts of nodes and rows
+    TrainProgress progress = { 0, 0, 0, 0, 0, 0.0, 0.0, 0.0 };
+    setTrainProgress(keepTrainProgress, &progress, 1.0e9);
+
+    double startSeconds = wallSeconds();
+
+    train(trees, benchmarkCase.columnsPerTree, benchmarkCase.maxDepth, benchmarkCase.minDepth,
+          benchmarkCase.doPrune, 0.0, benchmarkCase.minLeafCount,
+          benchmarkCase.maxSplitsPerNumericAttribute, benchmarkCase.maxTrees,
+          benchmarkCase.maxNodes, benchmarkCase.selectRows, benchmarkCase.availableColumns,
+          selectColumns, benchmarkCase.values, benchmarkCase.valueTypes,
+          benchmarkCase.categoryMaps, benchmarkCase.targetColumn, benchmarkCase.colNames,
+          imputeOptions, numThreads);
+
+    double trainSeconds = wallSeconds() - startSeconds;
+
+    setTrainProgress(NULL, NULL, 0.0);
+
+    // predictions replace target column, which is not needed again
+    startSeconds = wallSeconds();
+
+    predict(benchmarkCase.values, benchmarkCase.valueTypes, benchmarkCase.categoryMaps,
+            benchmarkCase.targetColumn, benchmarkCase.selectRows, selectColumns, trees,
+            benchmarkCase.colNames);
+
+    double predictSeconds = wallSeconds() - startSeconds;
+
+    double trainRate = trainSeconds > 0.0 ? 1.0 / trainSeconds : 0.0;
+    double predictRate = predictSeconds > 0.0 ? 1.0 / predictSeconds : 0.0;
+
+    ostringstream oss;
+    oss << "{\"name\": \"" << benchmarkCase.name << "\", \"rows\": " << numRows <<
+    ", \"columns\": " << numAttributeCols << ", \"target\": \"" << benchmarkCase.targetName <<
+    "\", \"threads\": " << numThreads << ", \"trees\": " << trees.size() <<
+    ", \"nodesSplit\": " << progress.nodesSplit << ", \"rowsScanned\": " << progress.rowsScanned <<
+    fixed << setprecision(6) <<
+    ", \"trainSeconds\": " << trainSeconds << ", \"predictSeconds\": " << predictSeconds <<
+    setprecision(0) <<
+    ", \"trainRowsPerSecond\": " << numRows * trainRate <<
+    ", \"scannedRowsPerSecond\": " << progress.rowsScanned * trainRate <<
+    ", \"nodesPerSecond\": " << progress.nodesSplit * trainRate <<
+    ", \"predictRowsPerSecond\": " << numRows * predictRate <<
+    ", \"peakRssKilobytes\": " << peakRssKilobytes() << "}";
+
+    os << oss.str() << endl;
+}
+
+// return uniform random number in [0, 1) from linear congruential generator
+double nextUniform(unsigned long& seed)
+{
+    seed = (seed * 1103515245 + 12345) % 2147483648UL;
+
+    return (double)seed / 2147483648.0;
+}
+
+// return peak resident set size of process so far, in kilobytes
+long peakRssKilobytes()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+#ifdef __APPLE__
+    long kilobytes = (long)usage.ru_maxrss / 1024;  // in bytes on OS X
+#else
+    long kilobytes = (long)usage.ru_maxrss;         // in kilobytes on Linux
+#endif
+
+    return kilobytes;
+}
+
+// TrainProgressFunction that copies progress to TrainProgress at context
+void keepTrainProgress(const TrainProgress& progress, void *context)
+{
+    *(TrainProgress *)context = progress;
+}
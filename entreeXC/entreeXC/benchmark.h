@@ -0,0 +1,30 @@
+//
+//  benchmark.h
+//  entree
+//
+//  Created by MPB on 10/18/26.
+//  Copyright (c) 2026 Quadrivio Corporation. All rights reserved.
+//  License http://opensource.org/licenses/BSD-2-Clause
+//          <YEAR> = 2026
+//          <OWNER> = Quadrivio Corporation
+//
+
+//
+// Timing of train() and predict() on iris, crime and synthetic data, called when --benchmark
+// argument is used
+//
+
+#ifndef entree_benchmark_h
+#define entree_benchmark_h
+
+#include <string>
+
+// run train and predict on each benchmark data set, writing one line of JSON per data set to
+// stdout; synthetic data sets with more than maxCells attribute values are skipped; empty strings
+// select default parameters
+void benchmark(const std::string& maxTreesStr,
+               const std::string& numThreadsStr,
+               const std::string& maxCellsStr,
+               bool verbose);
+
+#endif
@@ -10,7 +10,7 @@
 //
 
 //
-// Process command-line arguments and call train() or predict()
+// Process command-line arguments and call train(), predict() or selectTrees()
 //
 
 #include <fstream>  // must preceed .h includes
@@ -22,12 +22,75 @@
 #include "predict.h"
 #include "train.h"
 
+#include <deque>
 #include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+#include <pthread.h>
 
 using namespace std;
 
+// ========== Local Types ==========================================================================
+
+// rows of attributes read from file, replaced by rows of predicted responses before writing; last
+// is true for final block
+struct PredictBlock {
+    std::vector< std::vector<std::string> > cells;
+    std::vector< std::vector<bool> > quoted;
+    bool last;
+};
+typedef struct PredictBlock PredictBlock;
+
+// bounded queue for passing blocks between threads of prediction pipeline; after abort, push
+// deletes block and returns false, and pop returns NULL
+class BlockQueue {
+public:
+    BlockQueue(size_t capacity);
+    virtual ~BlockQueue();
+    
+    // add block to queue, waiting while queue is full; return false if aborted
+    bool push(PredictBlock *block);
+    
+    // remove block from queue, waiting while queue is empty; return NULL if aborted
+    PredictBlock *pop();
+    
+    // stop passing blocks and wake waiting threads
+    void abort();
+    
+private:
+    size_t capacity;
+    bool aborted;
+    std::deque<PredictBlock *> blocks;
+    
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+};
+
+// state shared by threads of prediction pipeline
+struct PredictPipeline {
+    std::istream *is;
+    std::ostream *os;
+    size_t blockRows;
+    BlockQueue *readQueue;      // attribute blocks, from reader to predictor
+    BlockQueue *writeQueue;     // response blocks, from predictor to writer
+    
+    pthread_mutex_t errorMutex;
+    std::string errorMessage;   // empty if no error in reader or writer
+};
+typedef struct PredictPipeline PredictPipeline;
+
 // ========== Local Headers ========================================================================
 
+// thread for prediction pipeline; read blocks of attribute rows from file
+void *readBlocks(void *pipelineP);
+
+// thread for prediction pipeline; write blocks of response rows to file
+void *writeBlocks(void *pipelineP);
+
+// record error in prediction pipeline and stop passing blocks
+void setPipelineError(PredictPipeline& pipeline, const std::string& message);
+
 void writeModel(const string& modelFile,
                 const vector<ValueType>& valueTypes,
                 const vector<CategoryMaps>& categoryMaps,
@@ -61,7 +124,10 @@ void callTrain(const std::string& attributesFile,
                const std::string& doPruneStr,
                const std::string& minDepthStr,
                const std::string& maxNodesStr,
-               const std::string& minImprovementStr)
+               const std::string& minImprovementStr,
+               const std::string& maxCategoriesStr,
+               const std::string& numThreadsStr,
+               const std::string& progressIntervalStr)
 {
     vector<CompactTree> trees;
     index_t columnsPerTree = -1;
@@ -73,6 +139,9 @@ void callTrain(const std::string& attributesFile,
     index_t maxSplitsPerNumericAttribute = -1;
     index_t maxTrees = 1000;
     index_t maxNodes = -1;
+    index_t maxCategories = -1;
+    size_t numThreads = 0;
+    double progressInterval = 0.0;
     SelectIndexes selectRows;
     SelectIndexes availableColumns;
     SelectIndexes selectColumns;
@@ -121,6 +190,18 @@ void callTrain(const std::string& attributesFile,
         minImprovement = toDouble(minImprovementStr);    
     }
     
+    if (!maxCategoriesStr.empty()) {
+        maxCategories = (index_t)toLong(maxCategoriesStr);    
+    }
+    
+    if (!numThreadsStr.empty()) {
+        numThreads = (size_t)toLong(numThreadsStr);    
+    }
+    
+    if (!progressIntervalStr.empty()) {
+        progressInterval = toDouble(progressIntervalStr);    
+    }
+    
     // read files
     
     if (!typeFile.empty()) {
@@ -157,6 +238,14 @@ void callTrain(const std::string& attributesFile,
                 
         cellsToValues(cells, quoted, valueTypes, true, "NA", values, false, categoryMaps);
         
+        if (maxCategories > 0) {
+            for (size_t col = 0; col < values.size(); col++) {
+                if (valueTypes[col] == kCategorical) {
+                    foldRareCategories((size_t)maxCategories, values[col], categoryMaps[col]);
+                }
+            }
+        }
+        
         numRows = values[0].size();
         
     } else {
@@ -231,104 +320,476 @@ void callTrain(const std::string& attributesFile,
 
     // train
 
+    if (progressInterval > 0.0) {
+        setTrainProgress(printTrainProgress, NULL, progressInterval);
+        
+    } else {
+        setTrainProgress(NULL, NULL, 0.0);
+    }
+    
     train(trees, columnsPerTree, maxDepth, minDepth, doPrune, minImprovement, minLeafCount,
           maxSplitsPerNumericAttribute, maxTrees, maxNodes, selectRows, availableColumns,
-          selectColumns, values, valueTypes, categoryMaps, targetColumn, colNames, imputeOptions);
+          selectColumns, values, valueTypes, categoryMaps, targetColumn, colNames, imputeOptions,
+          numThreads);
     
     // write model
     
     writeModel(modelFile, valueTypes, categoryMaps, targetColumn, selectColumns, imputeOptions,
                trees, colNames);
     
+#ifdef INSTRUMENT
+    // for profiling; counts of work done in train
+    writeInstrumentCounts(cerr);
+#endif
 }
 
 void callPredict(const std::string& attributesFile,
                  const std::string& responseFile,
-                 const std::string& modelFile)
+                 const std::string& modelFile,
+                 const std::string& blockRowsStr)
 {
-    vector< vector<Value> > values;
     vector<ValueType> valueTypes;
     vector<CategoryMaps> categoryMaps;
     size_t targetColumn;
     vector<ImputeOption> imputeOptions;
-    SelectIndexes selectRows;
     SelectIndexes selectColumns;
     vector<CompactTree> trees;
     vector<string> colNames;
     
-    // read files
+    size_t blockRows = 10000;
+    
+    if (!blockRowsStr.empty()) {
+        long value = toLong(blockRowsStr);
+        RUNTIME_ERROR_IF(value <= 0, "rows per block must be positive");
+        blockRows = (size_t)value;
+    }
+    
+    // read model
+    
+    readModel(modelFile, valueTypes, categoryMaps, targetColumn, selectColumns, imputeOptions,
+              trees, colNames);
+    
+    size_t numCols = valueTypes.size();
+    
+    targetColumn = numCols - 1;
+    
+    RUNTIME_ERROR_IF(attributesFile.empty(), "empty attributes file");
+    
+    // check attributes header
+    
+    ifstream ifs(attributesFile.c_str());
+    
+    RUNTIME_ERROR_IF(!ifs.good(), badPathErrorMessage(attributesFile));
+    
+    vector<string> attributeColNames;
+    readCsvHeader(ifs, attributeColNames);
+    
+    RUNTIME_ERROR_IF(attributeColNames.size() != numCols - 1, "attributes and model size mismatch");
+    
+    for (size_t col = 0; col < attributeColNames.size(); col++) {
+        RUNTIME_ERROR_IF(attributeColNames[col] != colNames[col], "attributes and model columns mismatch");
+    }
+    
+    // write response header
+    
+    ofstream ofs(responseFile.c_str());
+    
+    RUNTIME_ERROR_IF(!ofs.good(), badPathErrorMessage(responseFile));
+    
+    vector<ValueType> yValueTypes(1, valueTypes.at(targetColumn));
+    vector<CategoryMaps> yCategoryMaps(1, categoryMaps.at(targetColumn));
+    vector<string> yColNames(1, colNames.at(targetColumn));
+    
+    writeCsv(ofs, true, vector< vector<string> >(), vector< vector<bool> >(), yColNames);
+    
+    // attribute columns only, for converting cells to values
+    
+    vector<ValueType> xValueTypes = valueTypes;
+    vector<CategoryMaps> xCategoryMaps = categoryMaps;
+    
+    xValueTypes.resize(numCols - 1);
+    xCategoryMaps.resize(numCols - 1);
+    
+    // read, predict and write blocks of rows; reading and writing are on separate threads, and at
+    // most a few blocks are in memory at once
+    
+    BlockQueue readQueue(2);
+    BlockQueue writeQueue(2);
+    
+    PredictPipeline pipeline;
+    pipeline.is = &ifs;
+    pipeline.os = &ofs;
+    pipeline.blockRows = blockRows;
+    pipeline.readQueue = &readQueue;
+    pipeline.writeQueue = &writeQueue;
+    pthread_mutex_init(&pipeline.errorMutex, NULL);
+    
+    pthread_t readThread;
+    pthread_t writeThread;
+    
+    RUNTIME_ERROR_IF(pthread_create(&readThread, NULL, readBlocks, &pipeline) != 0,
+                     "unable to start reader thread");
+    
+    if (pthread_create(&writeThread, NULL, writeBlocks, &pipeline) != 0) {
+        readQueue.abort();
+        pthread_join(readThread, NULL);
+        RUNTIME_ERROR_IF(true, "unable to start writer thread");
+    }
+    
+    // block being predicted, owned here until pushed to writer, so it's freed on error
+    PredictBlock *block = NULL;
+    
+    try {
+        bool done = false;
+        
+        while (!done) {
+            block = readQueue.pop();
+            
+            if (block == NULL) {
+                // reader or writer failed
+                done = true;
+                
+            } else {
+                done = block->last;
+                
+                if (block->cells.size() > 0) {
+                    RUNTIME_ERROR_IF(!uniformRowLengths(block->cells, attributeColNames),
+                                     "mismatched row lengths in attributes");
+                    
+                    vector< vector<Value> > values;
+                    
+                    cellsToValues(block->cells, block->quoted, xValueTypes, true, "NA", values, true,
+                                  xCategoryMaps);
+                    
+                    size_t numRows = values[0].size();
+                    
+                    values.push_back(vector<Value>(numRows, gNaValue));
+                    
+                    SelectIndexes selectRows;
+                    selectRows.selectAll(numRows);
+                    
+                    predict(values, valueTypes, categoryMaps, targetColumn, selectRows,
+                            selectColumns, trees, colNames);
+                    
+                    vector< vector<Value> > yValues(1);
+                    yValues[0].swap(values.at(targetColumn));
+                    
+                    valuesToCells(yValues, yValueTypes, yCategoryMaps, true, "NA", block->cells,
+                                  block->quoted);
+                }
+                
+                PredictBlock *pushBlock = block;
+                block = NULL;
+                
+                if (!writeQueue.push(pushBlock)) {
+                    done = true;
+                }
+            }
+        }
+        
+    } catch (...) {
+        delete block;
+        readQueue.abort();
+        writeQueue.abort();
+        pthread_join(readThread, NULL);
+        pthread_join(writeThread, NULL);
+        pthread_mutex_destroy(&pipeline.errorMutex);
+        
+        throw;
+    }
+    
+    pthread_join(readThread, NULL);
+    pthread_join(writeThread, NULL);
+    pthread_mutex_destroy(&pipeline.errorMutex);
+    
+    RUNTIME_ERROR_IF(!pipeline.errorMessage.empty(), pipeline.errorMessage);
+    
+#ifdef INSTRUMENT
+    // for profiling; counts of work done in predict
+    writeInstrumentCounts(cerr);
+#endif
+}
 
+void callSelect(const std::string& attributesFile,
+                const std::string& responseFile,
+                const std::string& modelFile,
+                const std::string& outputModelFile,
+                const std::string& maxSplitsPerRowStr)
+{
+    vector<ValueType> valueTypes;
+    vector<CategoryMaps> categoryMaps;
+    size_t targetColumn;
+    vector<ImputeOption> imputeOptions;
+    SelectIndexes selectColumns;
+    vector<CompactTree> trees;
+    vector<string> colNames;
+    
+    RUNTIME_ERROR_IF(maxSplitsPerRowStr.empty(), "missing splits per row");
+    
+    double maxSplitsPerRow = toDouble(maxSplitsPerRowStr);
+    
+    // read model
+    
     readModel(modelFile, valueTypes, categoryMaps, targetColumn, selectColumns, imputeOptions,
               trees, colNames);
     
     size_t numCols = valueTypes.size();
-    size_t numRows = 0;
     
     targetColumn = numCols - 1;
     
-    if (!attributesFile.empty()) {
+    // read validation set, using categories of model
+    
+    RUNTIME_ERROR_IF(attributesFile.empty(), "empty attributes file");
+    RUNTIME_ERROR_IF(responseFile.empty(), "empty response file");
+    
+    vector< vector<Value> > values;
+    
+    {
         vector< vector<string> > cells;
         vector< vector<bool> > quoted;
         vector<string> attributeColNames;
         
         readCsvPath(attributesFile, cells, quoted, attributeColNames);
         
-        RUNTIME_ERROR_IF(!uniformRowLengths(cells, attributeColNames), "mismatched row lengths in attributes");
-        
-        RUNTIME_ERROR_IF(attributeColNames.size() != numCols - 1, "attributes and model size mismatch");
+        RUNTIME_ERROR_IF(!uniformRowLengths(cells, attributeColNames),
+                         "mismatched row lengths in attributes");
+        RUNTIME_ERROR_IF(attributeColNames.size() != numCols - 1,
+                         "attributes and model size mismatch");
         
         for (size_t col = 0; col < attributeColNames.size(); col++) {
-            RUNTIME_ERROR_IF(attributeColNames[col] != colNames[col], "attributes and model columns mismatch");
+            RUNTIME_ERROR_IF(attributeColNames[col] != colNames[col],
+                             "attributes and model columns mismatch");
         }
         
-        ValueType yValueType = valueTypes.at(numCols - 1);
-        CategoryMaps yCategoryMaps = categoryMaps.at(numCols - 1);
+        vector<ValueType> xValueTypes = valueTypes;
+        vector<CategoryMaps> xCategoryMaps = categoryMaps;
         
-        valueTypes.resize(numCols - 1);
-        categoryMaps.resize(numCols - 1);
+        xValueTypes.resize(numCols - 1);
+        xCategoryMaps.resize(numCols - 1);
         
-        cellsToValues(cells, quoted, valueTypes, true, "NA", values, true, categoryMaps);
+        cellsToValues(cells, quoted, xValueTypes, true, "NA", values, true, xCategoryMaps);
+    }
+    
+    {
+        vector< vector<string> > cells;
+        vector< vector<bool> > quoted;
+        vector<string> yColNames;
         
-        numRows = values[0].size();
+        readCsvPath(responseFile, cells, quoted, yColNames);
         
-        valueTypes.push_back(yValueType);
-        categoryMaps.push_back(yCategoryMaps);
+        RUNTIME_ERROR_IF(!uniformRowLengths(cells, yColNames),
+                         "mismatched row lengths in response");
         
-    } else {
-        RUNTIME_ERROR_IF(true, "empty attributes file");    
+        vector< vector<Value> > yValues;
+        vector<ValueType> yValueTypes(1, valueTypes.at(targetColumn));
+        vector<CategoryMaps> yCategoryMaps(1, categoryMaps.at(targetColumn));
+        
+        cellsToValues(cells, quoted, yValueTypes, true, "NA", yValues, true, yCategoryMaps);
+        
+        RUNTIME_ERROR_IF(values.at(0).size() != yValues.at(0).size(),
+                         "attributes and response size mismatch");
+        
+        values.push_back(yValues.at(0));
     }
     
-    values.push_back(vector<Value>(numRows, gNaValue));
-    selectRows.selectAll(numRows);
+    SelectIndexes selectRows;
+    selectRows.selectAll(values[0].size());
+    
+    // select trees
+    
+    vector<size_t> keptTrees;
+    selectTrees(keptTrees, maxSplitsPerRow, values, valueTypes, categoryMaps, targetColumn,
+                selectRows, selectColumns, trees, colNames);
+    
+    vector<CompactTree> keptEnsemble;
+    for (size_t k = 0; k < keptTrees.size(); k++) {
+        keptEnsemble.push_back(trees[keptTrees[k]]);
+    }
+    
+    cerr << "kept " << keptEnsemble.size() << " of " << trees.size() << " trees" << endl;
+    
+    // write model
+    
+    writeModel(outputModelFile, valueTypes, categoryMaps, targetColumn, selectColumns,
+               imputeOptions, keptEnsemble, colNames);
+}
 
-    // predict
+// ========== Local Classes ========================================================================
 
-    predict(values, valueTypes, categoryMaps, targetColumn, selectRows, selectColumns, trees,
-            colNames);
-   
-    // write prediction
+// bounded queue for passing blocks between threads of prediction pipeline; after abort, push
+// deletes block and returns false, and pop returns NULL
 
-    vector< vector<Value> > yValues;
-    vector<ValueType> yValueTypes;
-    vector<CategoryMaps> yCategoryMaps;
-    vector<string> yColNames;
+BlockQueue::BlockQueue(size_t capacity) :
+capacity(capacity),
+aborted(false)
+{
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&changed, NULL);
+}
+
+BlockQueue::~BlockQueue()
+{
+    for (size_t k = 0; k < blocks.size(); k++) {
+        delete blocks[k];
+    }
     
-    yValues.push_back(values.at(targetColumn));
-    yValueTypes.push_back(valueTypes.at(targetColumn));
-    yCategoryMaps.push_back(categoryMaps.at(targetColumn));
-    yColNames.push_back(colNames.at(targetColumn));
+    pthread_cond_destroy(&changed);
+    pthread_mutex_destroy(&mutex);
+}
+
+// add block to queue, waiting while queue is full; return false if aborted
+bool BlockQueue::push(PredictBlock *block)
+{
+    pthread_mutex_lock(&mutex);
+    
+    while (!aborted && blocks.size() >= capacity) {
+        pthread_cond_wait(&changed, &mutex);
+    }
+    
+    bool pushed = !aborted;
+    
+    if (pushed) {
+        blocks.push_back(block);
+        pthread_cond_broadcast(&changed);
+        
+    } else {
+        delete block;
+    }
+    
+    pthread_mutex_unlock(&mutex);
+    
+    return pushed;
+}
+
+// remove block from queue, waiting while queue is empty; return NULL if aborted
+PredictBlock *BlockQueue::pop()
+{
+    PredictBlock *block = NULL;
     
-    vector< vector<string> > yCells;
-    vector< vector<bool> > yQuoted;
+    pthread_mutex_lock(&mutex);
+    
+    while (!aborted && blocks.empty()) {
+        pthread_cond_wait(&changed, &mutex);
+    }
+    
+    if (!aborted) {
+        block = blocks.front();
+        blocks.pop_front();
+        pthread_cond_broadcast(&changed);
+    }
+    
+    pthread_mutex_unlock(&mutex);
+    
+    return block;
+}
 
-    valuesToCells(yValues, yValueTypes, yCategoryMaps, true, "NA", yCells, yQuoted);
+// stop passing blocks and wake waiting threads
+void BlockQueue::abort()
+{
+    pthread_mutex_lock(&mutex);
     
-    writeCsvPath(responseFile, yCells, yQuoted, yColNames);
+    aborted = true;
+    pthread_cond_broadcast(&changed);
     
+    pthread_mutex_unlock(&mutex);
 }
 
 // ========== Local Functions ======================================================================
 
+// thread for prediction pipeline; read blocks of attribute rows from file
+void *readBlocks(void *pipelineP)
+{
+    PredictPipeline& pipeline = *(PredictPipeline *)pipelineP;
+    
+    // block being read, owned here until pushed to predictor, so it's freed on error
+    PredictBlock *block = NULL;
+    
+    try {
+        bool more = true;
+        
+        while (more) {
+            block = new PredictBlock;
+            
+            more = readCsvRows(*pipeline.is, pipeline.blockRows, block->cells, block->quoted);
+            block->last = !more;
+            
+            PredictBlock *pushBlock = block;
+            block = NULL;
+            
+            if (!pipeline.readQueue->push(pushBlock)) {
+                // predictor stopped
+                more = false;
+            }
+        }
+        
+    } catch (const exception& x) {
+        delete block;
+        setPipelineError(pipeline, x.what());
+        
+    } catch (...) {
+        delete block;
+        setPipelineError(pipeline, "unknown error reading attributes");
+    }
+    
+    return NULL;
+}
+
+// thread for prediction pipeline; write blocks of response rows to file
+void *writeBlocks(void *pipelineP)
+{
+    PredictPipeline& pipeline = *(PredictPipeline *)pipelineP;
+    
+    // block being written, owned here until deleted, so it's freed on error
+    PredictBlock *block = NULL;
+    
+    try {
+        bool more = true;
+        
+        while (more) {
+            block = pipeline.writeQueue->pop();
+            
+            if (block == NULL) {
+                // predictor stopped
+                more = false;
+                
+            } else {
+                more = !block->last;
+                
+                writeCsv(*pipeline.os, false, block->cells, block->quoted, vector<string>());
+                delete block;
+                block = NULL;
+                
+                RUNTIME_ERROR_IF(!pipeline.os->good(), "error writing response file");
+            }
+        }
+        
+    } catch (const exception& x) {
+        delete block;
+        setPipelineError(pipeline, x.what());
+        
+    } catch (...) {
+        delete block;
+        setPipelineError(pipeline, "unknown error writing response");
+    }
+    
+    return NULL;
+}
+
+// record error in prediction pipeline and stop passing blocks
+void setPipelineError(PredictPipeline& pipeline, const std::string& message)
+{
+    pthread_mutex_lock(&pipeline.errorMutex);
+    
+    if (pipeline.errorMessage.empty()) {
+        pipeline.errorMessage = message;
+    }
+    
+    pthread_mutex_unlock(&pipeline.errorMutex);
+    
+    pipeline.readQueue->abort();
+    pipeline.writeQueue->abort();
+}
+
 void writeModel(const string& modelFile,
                 const vector<ValueType>& valueTypes,
                 const vector<CategoryMaps>& categoryMaps,
@@ -471,6 +932,20 @@ void writeModel(const string& modelFile,
         
         ofs << endl;
         
+        ofs << "categorySetIndex." << tree << endl;
+        for (size_t k = 0; k < trees[tree].categorySetIndex.size(); k++) {
+            ofs << trees[tree].categorySetIndex[k] << endl;
+        }
+        
+        ofs << endl;
+        
+        ofs << "categorySets." << tree << endl;
+        for (size_t k = 0; k < trees[tree].categorySets.size(); k++) {
+            ofs << trees[tree].categorySets[k] << endl;
+        }
+        
+        ofs << endl;
+        
     }
     
     // ~~~~~~~~ colNames ~~~~~~~~
@@ -530,6 +1005,7 @@ void readModel(const string& modelFile,
     for (size_t category = 0; category < categoryMaps.size(); category++) {
         readCsv(ifs, true, cells, quoted, cellColNames);
 
+        categoryMaps[category].reserve(cells.size());
         for (size_t row = 0; row < cells.size(); row++) {
             categoryMaps[category].insertCategory(cells[row][0]);
         }
@@ -624,6 +1100,31 @@ void readModel(const string& modelFile,
             
             trees[tree].value.push_back(number);  
         }
+        
+        // models written before splits on sets of categories have no categorySetIndex and
+        // categorySets sections; peek at next header to see which kind this is
+        
+        streampos position = ifs.tellg();
+        readCsvHeader(ifs, cellColNames);
+        ifs.clear();
+        ifs.seekg(position);
+        
+        if (cellColNames.empty() || cellColNames[0].find("categorySetIndex.") != 0) {
+            trees[tree].categorySetIndex.assign(trees[tree].value.size(), NO_INDEX);
+            
+        } else {
+            readCsv(ifs, true, cells, quoted, cellColNames);
+            
+            for (size_t row = 0; row < cells.size(); row++) {
+                trees[tree].categorySetIndex.push_back((index_t)toLong(cells[row][0]));  
+            }
+            
+            readCsv(ifs, true, cells, quoted, cellColNames);
+            
+            for (size_t row = 0; row < cells.size(); row++) {
+                trees[tree].categorySets.push_back((unsigned int)toLong(cells[row][0]));  
+            }
+        }
     }
     
     // ~~~~~~~~ colNames ~~~~~~~~
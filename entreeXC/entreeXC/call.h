@@ -10,7 +10,7 @@
 //
 
 //
-// Process command-line arguments and call train() or predict()
+// Process command-line arguments and call train(), predict() or selectTrees()
 //
 
 #ifndef entree_call_h
@@ -31,10 +31,20 @@ void callTrain(const std::string& attributesFile,
                const std::string& doPruneStr,
                const std::string& minDepthStr,
                const std::string& maxNodesStr,
-               const std::string& minImprovementStr);
+               const std::string& minImprovementStr,
+               const std::string& maxCategoriesStr,
+               const std::string& numThreadsStr,
+               const std::string& progressIntervalStr);
 
 void callPredict(const std::string& attributesFile,
                  const std::string& responseFile,
-                 const std::string& modelFile);
+                 const std::string& modelFile,
+                 const std::string& blockRowsStr);
+
+void callSelect(const std::string& attributesFile,
+                const std::string& responseFile,
+                const std::string& modelFile,
+                const std::string& outputModelFile,
+                const std::string& maxSplitsPerRowStr);
 
 #endif
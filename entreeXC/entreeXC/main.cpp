@@ -29,6 +29,7 @@
 // Interpret command-line arguments
 //
 
+#include "benchmark.h"
 #include "call.h"
 #include "develop.h"
 #include "test.h"
@@ -52,6 +53,7 @@ int main (int argc, const char * argv[])
     //
     //  -T  (train)
     //  -P  (predict)
+    //  -S  (select trees of model to fit budget)
     //
     //  -a  path to attributes csv file
     //  -r  path to response csv file
@@ -68,11 +70,22 @@ int main (int argc, const char * argv[])
     //  -e  minDepth
     //  -n  maxNodes
     //  -i  minImprovement
+    //  -k  maxCategories
+    //  -j  numThreads (0 for one per processor)
+    //  -p  seconds between progress reports when training (none if 0)
+    //
+    //  -b  rows per block when predicting
+    //
+    //  -o  path to serialized model of selected trees
+    //  -x  maximum average count of split nodes visited per row by selected trees
+    //
+    //  -g  maximum count of attribute values of synthetic benchmark data sets
     //
     //  -v  verbose
     //
     //  --develop   (run development code)
     //  --test      (run test code)
+    //  --benchmark (time train and predict on benchmark data sets)
     //  --version   (print version number)
     
     int status = 1;
@@ -81,8 +94,10 @@ int main (int argc, const char * argv[])
         bool printUsage = argc <= 1; 
         bool developFlag = false;
         bool testFlag = false;
+        bool benchmarkFlag = false;
         bool trainFlag = false;
         bool predictFlag = false;
+        bool selectFlag = false;
         bool verboseFlag = false;
         
         string columnsPerTree("");
@@ -94,12 +109,19 @@ int main (int argc, const char * argv[])
         string minDepth("");
         string maxNodes("");
         string minImprovement("");
+        string maxCategories("");
+        string numThreads("");
+        string progressInterval("");
+        string blockRows("");
+        string maxSplitsPerRow("");
+        string maxCells("");
         
         string attributesFile("");
         string responseFile("");
         string modelFile("");
         string typeFile("");
         string imputeFile("");
+        string outputModelFile("");
         
         for (int index = 1; index < argc; index++) {
             if (strcmp(argv[index], "--version") == 0) {
@@ -111,12 +133,18 @@ int main (int argc, const char * argv[])
             } else if (strcmp(argv[index], "--test") == 0) {
                 testFlag = true;
                 
+            } else if (strcmp(argv[index], "--benchmark") == 0) {
+                benchmarkFlag = true;
+                
             } else if (strcmp(argv[index], "-T") == 0) {
                 trainFlag = true;
                 
             } else if (strcmp(argv[index], "-P") == 0) {
                 predictFlag = true;
                 
+            } else if (strcmp(argv[index], "-S") == 0) {
+                selectFlag = true;
+                
             } else if (strcmp(argv[index], "-v") == 0) {
                 verboseFlag = true;
                 
@@ -162,6 +190,27 @@ int main (int argc, const char * argv[])
             } else if (strcmp(argv[index], "-i") == 0 && index + 1 < argc) {
                 minImprovement = argv[++index];
                 
+            } else if (strcmp(argv[index], "-k") == 0 && index + 1 < argc) {
+                maxCategories = argv[++index];
+                
+            } else if (strcmp(argv[index], "-j") == 0 && index + 1 < argc) {
+                numThreads = argv[++index];
+                
+            } else if (strcmp(argv[index], "-p") == 0 && index + 1 < argc) {
+                progressInterval = argv[++index];
+                
+            } else if (strcmp(argv[index], "-b") == 0 && index + 1 < argc) {
+                blockRows = argv[++index];
+                
+            } else if (strcmp(argv[index], "-o") == 0 && index + 1 < argc) {
+                outputModelFile = argv[++index];
+                
+            } else if (strcmp(argv[index], "-x") == 0 && index + 1 < argc) {
+                maxSplitsPerRow = argv[++index];
+                
+            } else if (strcmp(argv[index], "-g") == 0 && index + 1 < argc) {
+                maxCells = argv[++index];
+                
             } else {
                 printUsage = true;
             }
@@ -176,13 +225,20 @@ int main (int argc, const char * argv[])
         } else if (testFlag) {
             test(verboseFlag);
             
+        } else if (benchmarkFlag) {
+            benchmark(maxTrees, numThreads, maxCells, verboseFlag);
+            
         } else if (predictFlag) {
-            callPredict(attributesFile, responseFile, modelFile);
+            callPredict(attributesFile, responseFile, modelFile, blockRows);
+            
+        } else if (selectFlag) {
+            callSelect(attributesFile, responseFile, modelFile, outputModelFile, maxSplitsPerRow);
             
         } else if (trainFlag) {
             callTrain(attributesFile, responseFile, modelFile, typeFile, imputeFile, columnsPerTree,
                       maxDepth, minLeafCount, maxSplitsPerNumericAttribute, maxTrees, doPrune,
-                      minDepth, maxNodes, minImprovement);
+                      minDepth, maxNodes, minImprovement, maxCategories, numThreads,
+                      progressInterval);
         }
         
         status = 0;
@@ -203,12 +259,17 @@ int main (int argc, const char * argv[])
 void usage()
 {
     cerr <<
-    "usage: entree [-T] [-P] [-a attributesFile] [-r responseFile]" << endl <<
+    "usage: entree [-T] [-P] [-S] [-a attributesFile] [-r responseFile]" << endl <<
     "              [-m modelFile] [-y typeFile] [-i imputeFile]" << endl <<
     "              [-c columnsPerTree] [-d maxDepth] [-l minLeafCount]" << endl <<
     "              [-s maxSplitsPerNumericAttribute] [-t maxTrees]" << endl <<
     "              [-u prune] [-e minDepth] [-n maxNodes] [-i minImprovement]" << endl <<
+    "              [-k maxCategories] [-j numThreads] [-p progressInterval]" << endl <<
+    "              [-b blockRows] [-o outputModelFile] [-x maxSplitsPerRow]" << endl <<
+    "       entree --benchmark [-t maxTrees] [-j numThreads] [-g maxCells]" << endl <<
     endl <<
     "  To train model, supply -T -a -r -m and optional parameters" << endl <<
-    "  To predict from model, supply -P -a -m -r only" << endl;
+    "  To predict from model, supply -P -a -m -r and optional -b" << endl <<
+    "  To select trees of model, supply -S -a -r -m -o -x" << endl <<
+    "  To time train and predict, supply --benchmark and optional -t -j -g" << endl;
 }
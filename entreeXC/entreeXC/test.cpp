@@ -28,6 +28,7 @@
 #include <cmath>
 #include <iostream>
 #include <iomanip>
+#include <sstream>
 
 using namespace std;
 
@@ -137,6 +138,10 @@ bool test_commandLine(bool verbose)
 #define RESPONSE_PATH "iris.response.csv"
 #define MODEL_PATH "iris.model.csv"
 #define PREDICT_PATH "iris.predict.csv"
+#define OLD_MODEL_PATH "iris.oldModel.csv"
+#define OLD_PREDICT_PATH "iris.oldPredict.csv"
+#define BAD_ATTRIBUTES_PATH "iris.badAttributes.csv"
+#define BAD_PREDICT_PATH "iris.badPredict.csv"
     
     vector< vector<string> > cells;
     vector< vector<bool> > quoted;
@@ -229,7 +234,7 @@ bool test_commandLine(bool verbose)
     // call predict
     
     {
-        int argc = 8;
+        int argc = 10;
         const char *argv[] = {
             (char *)"entree",
             (char *)"-P",
@@ -238,7 +243,56 @@ bool test_commandLine(bool verbose)
             (char *)"-r",
             (char *)PREDICT_PATH,
             (char *)"-m",
-            (char *)MODEL_PATH
+            (char *)MODEL_PATH,
+            (char *)"-b",
+            (char *)"7"     // rows per block; iris data spans several blocks
+        };
+        
+        main(argc, argv);
+    }
+    
+    // ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ 
+    // call predict with copy of model in format written before splits on sets of categories,
+    // without categorySetIndex and categorySets sections
+    
+    bool hadCategorySets = false;
+    
+    {
+        string model;
+        fileToString(MODEL_PATH, model);
+        
+        istringstream iss(model);
+        ostringstream oss;
+        string line;
+        bool skip = false;
+        
+        while (getline(iss, line)) {
+            if (line.find("categorySet") == 0) {
+                hadCategorySets = true;
+                skip = true;
+            }
+            
+            if (!skip) {
+                oss << line << endl;
+            }
+            
+            if (line.empty()) {
+                skip = false;
+            }
+        }
+        
+        stringToFile(oss.str(), OLD_MODEL_PATH);
+        
+        int argc = 8;
+        const char *argv[] = {
+            (char *)"entree",
+            (char *)"-P",
+            (char *)"-a",
+            (char *)ATTRIBUTES_PATH,
+            (char *)"-r",
+            (char *)OLD_PREDICT_PATH,
+            (char *)"-m",
+            (char *)OLD_MODEL_PATH
         };
         
         main(argc, argv);
@@ -277,6 +331,73 @@ bool test_commandLine(bool verbose)
     if (verbose || !success) {
         CERR << "command line iris data compareMatch = " << fixed << setprecision(2) << result << endl;
     }
+    
+    vector< vector<string> > oldPredictCells;
+    vector< vector<bool> > oldPredictQuoted;
+    vector<string> oldPredictColNames;
+    
+    readCsvPath(OLD_PREDICT_PATH, oldPredictCells, oldPredictQuoted, oldPredictColNames);
+    
+    bool oldSuccess = hadCategorySets && oldPredictCells == predictCells;
+    
+    if (verbose || !oldSuccess) {
+        CERR << "command line iris data from old model format " <<
+        (oldSuccess ? "matches" : "does not match") << endl;
+    }
+    
+    success = success && oldSuccess;
+
+    // ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ 
+    // call predict with attributes having a short row in a block after the first, which fails
+    // while blocks are in flight
+    
+    int badStatus = 0;
+    
+    {
+        string attributes;
+        fileToString(ATTRIBUTES_PATH, attributes);
+        
+        istringstream iss(attributes);
+        ostringstream oss;
+        string line;
+        
+        for (size_t lineIndex = 0; getline(iss, line); lineIndex++) {
+            if (lineIndex == 21) {
+                // drop last cell of row 20, after header line
+                line.erase(line.rfind(','));
+            }
+            
+            oss << line << endl;
+        }
+        
+        stringToFile(oss.str(), BAD_ATTRIBUTES_PATH);
+        
+        int argc = 10;
+        const char *argv[] = {
+            (char *)"entree",
+            (char *)"-P",
+            (char *)"-a",
+            (char *)BAD_ATTRIBUTES_PATH,
+            (char *)"-r",
+            (char *)BAD_PREDICT_PATH,
+            (char *)"-m",
+            (char *)MODEL_PATH,
+            (char *)"-b",
+            (char *)"7"     // rows per block; short row is in third block
+        };
+        
+        CERR << "one \"mismatched row lengths\" error follows:" << endl;
+        badStatus = main(argc, argv);
+    }
+    
+    bool badSuccess = badStatus != 0;
+    
+    if (verbose || !badSuccess) {
+        CERR << "command line iris data with short row " <<
+        (badSuccess ? "fails" : "does not fail") << endl;
+    }
+    
+    success = success && badSuccess;
 
     // ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ 
     // delete test files
@@ -288,6 +409,10 @@ bool test_commandLine(bool verbose)
         remove(RESPONSE_PATH);    
         remove(MODEL_PATH);    
         remove(PREDICT_PATH);    
+        remove(OLD_MODEL_PATH);
+        remove(OLD_PREDICT_PATH);
+        remove(BAD_ATTRIBUTES_PATH);
+        remove(BAD_PREDICT_PATH);
     }
     
     return success;
@@ -346,7 +471,7 @@ bool test_iris(bool verbose)
     train(trees, columnsPerTree, maxDepth, minDepth, doPrune, minImprovement, minLeafCount,
           maxSplitsPerNumericAttribute, maxTrees, maxNodes, selectRows, availableColumns,
           selectColumns, trainValues, valueTypes, categoryMaps, targetColumn, colNames,
-          imputeOptions);
+          imputeOptions, 1);
     
     if (verbose) {
         printCompactTrees(trees, valueTypes, targetColumn, selectColumns, colNames,
@@ -447,7 +572,7 @@ bool test_crime(bool verbose)
     train(trees, columnsPerTree, maxDepth, minDepth, doPrune, minImprovement, minLeafCount,
           maxSplitsPerNumericAttribute, maxTrees, maxNodes, selectRows, availableColumns,
           selectColumns, trainValues, valueTypes, categoryMaps, targetColumn, colNames,
-          imputeOptions);
+          imputeOptions, 1);
     
     if (verbose) {
         printCompactTrees(trees, valueTypes, targetColumn, selectColumns, colNames,
@@ -467,7 +592,7 @@ bool test_crime(bool verbose)
     
     double result = compareRms(trainValues[targetColumn], predictValues[targetColumn], selectRows);
     
-    double benchmark = 235.702179;
+    double benchmark = 235.870554;
     
     // probably safe against this much difference due to rounding or numerics on different systems
     bool success = abs(benchmark - result) < 0.001 * benchmark;
@@ -545,7 +670,7 @@ bool test_allCategorical(bool verbose)
     train(trees, columnsPerTree, maxDepth, minDepth, doPrune, minImprovement, minLeafCount,
           maxSplitsPerNumericAttribute, maxTrees, maxNodes, selectRows, availableColumns,
           selectColumns, trainValues, valueTypes, categoryMaps, targetColumn, colNames,
-          imputeOptions);
+          imputeOptions, 1);
     
     if (verbose) {
         printCompactTrees(trees, valueTypes, targetColumn, selectColumns, colNames, categoryMaps);